@@ -725,6 +725,8 @@ static int load_devices(struct devs *devices, char *devmap,
 				ident->uuid_set = 1;
 				memcpy(ident->uuid, content->uuid, 16);
 			}
+			/* e.g. --update=metadata leaves two superblocks */
+			probe_hint_forget(dfd);
 			if (tst->ss->store_super(tst, dfd))
 				pr_err("Could not re-write superblock on %s.\n",
 				       devname);
@@ -1007,6 +1009,61 @@ static int force_array(struct mdinfo *content,
 	return okcnt;
 }
 
+static void phase_begin(struct timespec *ts)
+{
+	clock_gettime(CLOCK_MONOTONIC, ts);
+}
+
+static void phase_end(struct context *c, char *mddev, char *phase,
+		      struct timespec *ts)
+{
+	struct timespec now;
+	long ms;
+
+	if (c->verbose <= 0)
+		return;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	ms = (now.tv_sec - ts->tv_sec) * 1000 +
+		(now.tv_nsec - ts->tv_nsec) / 1000000;
+	pr_err("%s: %s took %ld.%03lds\n", mddev, phase, ms / 1000, ms % 1000);
+	*ts = now;
+}
+
+static void prepare_member(char *devname)
+{
+	int dfd;
+
+	dfd = dev_open(devname, O_RDWR|O_EXCL);
+	if (dfd >= 0) {
+		remove_partitions(dfd);
+		close(dfd);
+	}
+}
+
+/*
+ * Claim every member about to be added and drop any partitions on it,
+ * before the first add_disk(), so the adds themselves run back to back.
+ * This is a few BLKPG ioctls per member, cheaper than handing them to
+ * child processes.  Adding the members must stay serial anyway: the
+ * kernel handles ADD_NEW_DISK and new_dev with the array locked, which
+ * is also where it reads the superblock.
+ */
+static void prepare_members(struct devs *devices, int *best, int bestcnt,
+			    int chosen_drive)
+{
+	int i;
+
+	for (i = 0; i <= bestcnt; i++) {
+		int j = i < bestcnt ? best[i] : chosen_drive;
+
+		if (j < 0 || devices[j].included)
+			continue;
+		if (i < bestcnt && j == chosen_drive)
+			continue;
+		prepare_member(devices[j].devname);
+	}
+}
+
 static int start_array(int mdfd,
 		       char *mddev,
 		       struct mdinfo *content,
@@ -1029,6 +1086,7 @@ static int start_array(int mdfd,
 	int rv;
 	int i;
 	unsigned int req_cnt;
+	struct timespec phase;
 
 	if (content->journal_device_required && (content->journal_clean == 0)) {
 		if (!c->force) {
@@ -1049,6 +1107,10 @@ static int start_array(int mdfd,
 		return 1;
 	}
 
+	phase_begin(&phase);
+	prepare_members(devices, best, bestcnt, chosen_drive);
+	phase_end(c, mddev, "preparing members", &phase);
+
 	/* First, add the raid disks, but add the chosen one last */
 	for (i = 0; i <= bestcnt; i++) {
 		int j;
@@ -1060,13 +1122,6 @@ static int start_array(int mdfd,
 			j = chosen_drive;
 
 		if (j >= 0 && !devices[j].included) {
-			int dfd;
-
-			dfd = dev_open(devices[j].devname, O_RDWR|O_EXCL);
-			if (dfd >= 0) {
-				remove_partitions(dfd);
-				close(dfd);
-			}
 			rv = add_disk(mdfd, st, content, &devices[j].i);
 
 			if (rv) {
@@ -1103,6 +1158,7 @@ static int start_array(int mdfd,
 			pr_err("no uptodate device for slot %d of %s\n",
 			       i/2, mddev);
 	}
+	phase_end(c, mddev, "adding members", &phase);
 
 	if (is_container(content->array.level)) {
 		sysfs_rules_apply(mddev, content, st);
@@ -1184,6 +1240,7 @@ static int start_array(int mdfd,
 		} else
 			rv = ioctl(mdfd, RUN_ARRAY, NULL);
 		reopen_mddev(mdfd); /* drop O_EXCL */
+		phase_end(c, mddev, "starting array", &phase);
 		if (rv == 0) {
 			sysfs_rules_apply(mddev, content, st);
 			if (c->verbose >= 0) {
@@ -1973,6 +2030,7 @@ int assemble_container_content(struct supertype *st, int mdfd,
 			       char *chosen_name, int *result)
 {
 	struct mdinfo *dev, *sra, *dev2;
+	struct sysfs_txn txn;
 	struct assembly_array_info array = {chosen_name, 0, 0, 0};
 	int old_raid_disks;
 	int start_reshape;
@@ -1980,12 +2038,14 @@ int assemble_container_content(struct supertype *st, int mdfd,
 	int err;
 	int is_clean, all_disks;
 	bool is_raid456;
+	struct timespec phase;
 
 	if (sysfs_init(content, mdfd, NULL)) {
 		pr_err("Unable to initialize sysfs\n");
 		return 1;
 	}
 
+	phase_begin(&phase);
 	sra = sysfs_read(mdfd, NULL, GET_VERSION|GET_DEVS);
 	if (sra == NULL) {
 		pr_err("Failed to read sysfs parameters\n");
@@ -2030,12 +2090,15 @@ int assemble_container_content(struct supertype *st, int mdfd,
 		}
 		sysfs_set_str(sra, dev2, "state", "remove");
 	}
+	phase_end(c, chosen_name, "configuring array", &phase);
+
 	old_raid_disks = content->array.raid_disks - content->delta_disks;
 	avail = xcalloc(content->array.raid_disks, 1);
+	sysfs_txn_begin(&txn, content);
 	for (dev = content->devs; dev; dev = dev->next) {
 		if (dev->disk.raid_disk >= 0)
 			avail[dev->disk.raid_disk] = 1;
-		if (sysfs_add_disk(content, dev, 1) == 0) {
+		if (sysfs_add_disk_txn(&txn, dev, 1) == 0) {
 			if (dev->disk.raid_disk >= old_raid_disks &&
 			    content->reshape_active)
 				array.exp_cnt++;
@@ -2044,7 +2107,9 @@ int assemble_container_content(struct supertype *st, int mdfd,
 		} else if (errno == EEXIST)
 			array.preexist_cnt++;
 	}
+	sysfs_txn_end(&txn);
 	sysfs_free(sra);
+	phase_end(c, chosen_name, "adding members", &phase);
 
 	all_disks = array.new_cnt + array.exp_cnt + array.preexist_cnt;
 
@@ -2207,6 +2272,7 @@ int assemble_container_content(struct supertype *st, int mdfd,
 			}
 			break;
 		}
+	phase_end(c, chosen_name, "starting array", &phase);
 	if (!err)
 		sysfs_set_safemode(content, content->safe_mode_delay);
 
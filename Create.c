@@ -292,8 +292,10 @@ static int add_disk_to_super(int mdfd, struct shape *s, struct context *c,
 		info->disk.major = major(rdev);
 		info->disk.minor = minor(rdev);
 	}
-	if (fd >= 0)
+	if (fd >= 0) {
 		remove_partitions(fd);
+		probe_hint_forget(fd);
+	}
 	if (st->ss->add_to_super(st, &info->disk, fd, dv->devname,
 				 dv->data_offset)) {
 		ioctl(mdfd, STOP_ARRAY, NULL);
@@ -830,6 +830,218 @@ out:
 	return rv;
 }
 
+/* arrays examined at the same time by Detail_list() */
+#define DETAIL_MAX_CHILDREN CHILD_POOL_MAX
+
+struct detail_job {
+	char *dev;
+	FILE *out, *err;
+	int rv;
+	bool done;
+};
+
+/* Run Detail() with its output going to the job's files */
+static int detail_captured(struct detail_job *job, struct context *c)
+{
+	int saved_out = dup(fileno(stdout));
+	int saved_err = dup(fileno(stderr));
+	int rv;
+
+	fflush(stdout);
+	fflush(stderr);
+	dup2(fileno(job->out), fileno(stdout));
+	dup2(fileno(job->err), fileno(stderr));
+	rv = Detail(job->dev, c);
+	fflush(stdout);
+	fflush(stderr);
+	dup2(saved_out, fileno(stdout));
+	dup2(saved_err, fileno(stderr));
+	close(saved_out);
+	close(saved_err);
+	return rv;
+}
+
+static void json_string(const char *s, int len)
+{
+	putchar('"');
+	for (; len > 0; s++, len--) {
+		unsigned char ch = *s;
+
+		if (ch == '"' || ch == '\\')
+			printf("\\%c", ch);
+		else if (ch < 0x20)
+			printf("\\u%04x", ch);
+		else
+			putchar(ch);
+	}
+	putchar('"');
+}
+
+/* Turn the key=value lines of --export into one JSON object per line */
+static void detail_print_json(struct detail_job *job)
+{
+	char *line = NULL;
+	size_t size = 0;
+	ssize_t len;
+
+	printf("{\"device\":");
+	json_string(job->dev, strlen(job->dev));
+	printf(",\"status\":%d", job->rv);
+	while ((len = getline(&line, &size, job->out)) > 0) {
+		char *eq = memchr(line, '=', len);
+
+		if (line[len - 1] == '\n')
+			len--;
+		if (!eq || eq == line)
+			continue;
+		putchar(',');
+		json_string(line, eq - line);
+		putchar(':');
+		json_string(eq + 1, line + len - eq - 1);
+	}
+	printf("}\n");
+	free(line);
+}
+
+static void detail_print(struct detail_job *job, struct context *c)
+{
+	char buf[4096];
+	size_t n;
+
+	rewind(job->out);
+	rewind(job->err);
+	if (c->json)
+		detail_print_json(job);
+	else
+		while ((n = fread(buf, 1, sizeof(buf), job->out)) > 0)
+			fwrite(buf, 1, n, stdout);
+	fflush(stdout);
+	while ((n = fread(buf, 1, sizeof(buf), job->err)) > 0)
+		fwrite(buf, 1, n, stderr);
+	fclose(job->out);
+	fclose(job->err);
+}
+
+static int detail_max_children(void)
+{
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+	if (cpus < 1)
+		return 1;
+	return min(cpus * 2, (long)DETAIL_MAX_CHILDREN);
+}
+
+static void detail_job_done(void *data, int status)
+{
+	struct detail_job *job = data;
+
+	job->rv = status;
+	job->done = true;
+}
+
+/* Start examining one array, -1 if its output cannot be captured */
+static int detail_start(struct detail_job *job, char *dev,
+			struct child_pool *cp, struct context *c)
+{
+	pid_t pid;
+
+	job->dev = dev;
+	job->out = tmpfile();
+	if (!job->out)
+		return -1;
+	job->err = tmpfile();
+	if (!job->err) {
+		fclose(job->out);
+		return -1;
+	}
+	pid = cp ? child_pool_fork(cp, job) : -1;
+	if (pid == 0)
+		_exit(detail_captured(job, c));
+	if (pid < 0) {
+		job->rv = detail_captured(job, c);
+		job->done = true;
+	}
+	return 0;
+}
+
+/* Examine one array with nothing else pending, printing straight away */
+static int detail_direct(char *dev, struct context *c)
+{
+	if (!c->json)
+		return Detail(dev, c);
+
+	pr_err("cannot create temporary file for %s: %s\n", dev,
+	       strerror(errno));
+	printf("{\"device\":");
+	json_string(dev, strlen(dev));
+	printf(",\"status\":1}\n");
+	fflush(stdout);
+	return 1;
+}
+
+/**
+ * Detail_list() - print details of several arrays.
+ * @devs: md devices to report on.
+ * @cnt: number of entries in @devs.
+ * @c: context, as for Detail().
+ *
+ * Each array is examined by Detail() in a child process, several at a
+ * time, with the output collected and printed in the order of @devs as
+ * soon as all arrays before it are done.  At most twice as many arrays
+ * as there are children are examined ahead of the first one not printed
+ * yet, which bounds the temporary files kept open.  The list of names in
+ * /dev is built once up front and shared by all children.  With --json
+ * every array is printed as one JSON object per line, holding the values
+ * --export gives.
+ *
+ * Return: the results of Detail() or-ed together.
+ */
+int Detail_list(char **devs, int cnt, struct context *c)
+{
+	struct detail_job *jobs;
+	struct child_pool cp;
+	int next = 0, printed = 0;
+	int rv = 0;
+
+	if (cnt == 1 && !c->json)
+		return Detail(devs[0], c);
+
+	map_dev_load();
+	jobs = xcalloc(cnt, sizeof(*jobs));
+	child_pool_init(&cp, detail_max_children(), detail_job_done);
+
+	while (printed < cnt) {
+		/* print whatever is finished, in order */
+		if (jobs[printed].done) {
+			detail_print(&jobs[printed], c);
+			rv |= jobs[printed].rv;
+			printed++;
+			continue;
+		}
+
+		if (next < cnt && cp.running < cp.max &&
+		    next - printed < 2 * cp.max &&
+		    detail_start(&jobs[next], devs[next], cnt > 1 ? &cp : NULL,
+				 c) == 0) {
+			next++;
+			continue;
+		}
+
+		if (next == printed) {
+			/* out of files with nothing pending, go without */
+			rv |= detail_direct(devs[next], c);
+			next++;
+			printed++;
+			continue;
+		}
+
+		/* earlier arrays must finish, and free their files */
+		child_pool_reap(&cp, true);
+	}
+	free(jobs);
+	return rv;
+}
+
 int Detail_Platform(struct superswitch *ss, int scan, int verbose, int export, char *controller_path)
 {
 	/* display platform capabilities for the given metadata format
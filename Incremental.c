@@ -34,8 +34,11 @@
 #include	"udev.h"
 
 #include	<sys/wait.h>
+#include	<sys/socket.h>
+#include	<sys/un.h>
 #include	<dirent.h>
 #include	<ctype.h>
+#include	<poll.h>
 
 static int count_active(struct supertype *st, struct mdinfo *sra,
 			int mdfd, char **availp,
@@ -1858,3 +1861,433 @@ out:
 	free_mdstat(mdstat);
 	return rv;
 }
+
+/*
+ * Incremental assembly service.
+ *
+ * At boot udev runs "mdadm -I" for every device that appears.  Each of
+ * those processes parses mdadm.conf, then serialises on the map lock.
+ * When "mdadm --incremental --serve" is running, "mdadm -I" becomes a
+ * thin client: it hands its stdout, stderr and arguments to the server
+ * over INCREMENTAL_SOCK and waits for the exit status.  The server keeps
+ * the parsed config, by-path index and policy cache in memory, collects
+ * bursts of requests and handles each burst taking the map lock once per
+ * INCR_HOLD_MAX requests.  The index is rescanned when a device is not in
+ * it and /dev/disk/by-path has changed, and both are dropped after a
+ * removal.
+ *
+ * If the server isn't running (or goes away before answering) the
+ * client falls back to handling the device in-process.  The server
+ * acknowledges each request before acting on it.  If no acknowledgement
+ * arrives in time the client shuts the socket down for reading, so the
+ * server can no longer acknowledge, and handles the device itself.  Once
+ * acknowledged, the request belongs to the server, and a client that
+ * times out waiting for the status leaves the device alone.  The server
+ * runs with its own environment,
+ * so a client with any of the testing or override variables set handles
+ * the device itself.
+ */
+
+#define INCR_MAGIC 0x6d64496e
+#define INCR_MAX_PAYLOAD 65536
+#define INCR_MAX_BATCH 128
+#define INCR_BATCH_WAIT_MSEC 20
+/* requests handled before the map lock is offered to others */
+#define INCR_HOLD_MAX 8
+/* together below the 180s after which udev kills the worker running us */
+#define INCR_ACK_TIMEOUT_SEC 30
+#define INCR_STATUS_TIMEOUT_SEC 120
+
+static char *incr_local_env[] = {
+	"IMSM_NO_PLATFORM", "IMSM_DEVNAME_AS_SERIAL", "IMSM_SAFE_OROM_SCAN",
+	"IMSM_TEST_OROM", "IMSM_TEST_AHCI_EFI", "IMSM_TEST_SCU_EFI",
+	"MDADM_NO_MDMON", "MDADM_NO_SYSTEMCTL", "MDADM_NO_UDEV",
+	"MDADM_CONF_AUTO", NULL
+};
+
+struct incr_request {
+	__u32 magic;
+	int op;		/* 'a' for add, 'f' for fail/remove */
+	int runstop;
+	int verbose;
+	int export;
+	int require_homehost;
+	int payload_len;
+	/* payload: homehost, path, then device names, all nul terminated */
+};
+
+struct incr_client {
+	int fd;
+	int out_fd;
+	int err_fd;
+	struct incr_request req;
+	char *payload;
+};
+
+static volatile sig_atomic_t incr_sigterm;
+
+static void incr_catch_term(int sig)
+{
+	incr_sigterm = 1;
+}
+
+static int incr_sock_addr(struct sockaddr_un *addr)
+{
+	memset(addr, 0, sizeof(*addr));
+	addr->sun_family = AF_LOCAL;
+	return snprintf(addr->sun_path, sizeof(addr->sun_path), "%s",
+			INCREMENTAL_SOCK) >= (int)sizeof(addr->sun_path);
+}
+
+static ssize_t incr_read_timeout(int sfd, int *val, int sec)
+{
+	struct timeval tmo = { sec, 0 };
+
+	setsockopt(sfd, SOL_SOCKET, SO_RCVTIMEO, &tmo, sizeof(tmo));
+	return read(sfd, val, sizeof(*val));
+}
+
+/* Wait for the server to take the request, then for its exit status */
+static int incr_client_wait(int sfd, char *devname)
+{
+	int ack, status;
+	ssize_t n;
+
+	n = incr_read_timeout(sfd, &ack, INCR_ACK_TIMEOUT_SEC);
+	if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+		/* After this the server cannot acknowledge any more, so
+		 * either it already has and owns the device, or it never
+		 * will and it is ours.
+		 */
+		shutdown(sfd, SHUT_RD);
+		n = recv(sfd, &ack, sizeof(ack), MSG_DONTWAIT);
+		if (n != sizeof(ack) || ack != INCR_MAGIC)
+			return -1;
+		pr_err("incremental service is slow, leaving %s to it\n",
+		       devname);
+		return 0;
+	}
+	if (n != sizeof(ack) || ack != INCR_MAGIC)
+		return -1;
+
+	n = incr_read_timeout(sfd, &status, INCR_STATUS_TIMEOUT_SEC);
+	if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+		/* don't race the server for the device */
+		pr_err("no answer from incremental service, leaving %s to it\n",
+		       devname);
+		return 0;
+	}
+	if (n != sizeof(status))
+		return -1;
+	return status;
+}
+
+/**
+ * Incremental_client() - pass an incremental request to the server.
+ * @devlist: devices, the first one is the device to act on.
+ * @c: context.
+ * @op: 'a' to add, 'f' to fail and remove.
+ * @path: id path for --fail, may be NULL.
+ *
+ * Return: the exit status reported by the server, or -1 if the server
+ * couldn't be reached and the caller should handle the device itself.
+ * If the server took the request but doesn't answer in time, 0 is
+ * returned and the device is left to the server.
+ */
+int Incremental_client(struct mddev_dev *devlist, struct context *c,
+		       int op, char *path)
+{
+	struct incr_request req = {
+		.magic = INCR_MAGIC,
+		.op = op,
+		.runstop = c->runstop,
+		.verbose = c->verbose,
+		.export = c->export,
+		.require_homehost = c->require_homehost,
+	};
+	int fds[2] = { fileno(stdout), fileno(stderr) };
+	char cbuf[CMSG_SPACE(sizeof(fds))];
+	struct sockaddr_un addr;
+	struct mddev_dev *dv;
+	struct cmsghdr *cmsg;
+	struct msghdr msg;
+	struct iovec iov[2];
+	char *payload, *p;
+	int len, status, i;
+	int sfd;
+
+	for (i = 0; incr_local_env[i]; i++)
+		if (getenv(incr_local_env[i]))
+			return -1;
+
+	len = strlen(c->homehost ?: "") + 1 + strlen(path ?: "") + 1;
+	for (dv = devlist; dv; dv = dv->next)
+		len += strlen(dv->devname) + 1;
+	if (len > INCR_MAX_PAYLOAD)
+		return -1;
+
+	if (incr_sock_addr(&addr))
+		return -1;
+	sfd = socket(AF_LOCAL, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (!is_fd_valid(sfd))
+		return -1;
+	if (connect(sfd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+		close(sfd);
+		return -1;
+	}
+	p = payload = xmalloc(len);
+	p = stpcpy(p, c->homehost ?: "") + 1;
+	p = stpcpy(p, path ?: "") + 1;
+	for (dv = devlist; dv; dv = dv->next)
+		p = stpcpy(p, dv->devname) + 1;
+	req.payload_len = len;
+
+	fflush(stdout);
+	fflush(stderr);
+
+	iov[0].iov_base = &req;
+	iov[0].iov_len = sizeof(req);
+	iov[1].iov_base = payload;
+	iov[1].iov_len = len;
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = iov;
+	msg.msg_iovlen = 2;
+	msg.msg_control = cbuf;
+	msg.msg_controllen = sizeof(cbuf);
+	cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+	memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+	if (sendmsg(sfd, &msg, MSG_NOSIGNAL) != (ssize_t)(sizeof(req) + len))
+		status = -1;
+	else
+		status = incr_client_wait(sfd, devlist->devname);
+
+	free(payload);
+	close(sfd);
+	return status;
+}
+
+static int incr_recv_request(struct incr_client *cl)
+{
+	int fds[2];
+	char cbuf[CMSG_SPACE(sizeof(fds))];
+	struct timeval tmo = { 5, 0 };
+	struct cmsghdr *cmsg;
+	struct msghdr msg;
+	struct iovec iov;
+	int got;
+
+	cl->out_fd = cl->err_fd = -1;
+	cl->payload = NULL;
+
+	setsockopt(cl->fd, SOL_SOCKET, SO_RCVTIMEO, &tmo, sizeof(tmo));
+
+	iov.iov_base = &cl->req;
+	iov.iov_len = sizeof(cl->req);
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = cbuf;
+	msg.msg_controllen = sizeof(cbuf);
+
+	if (recvmsg(cl->fd, &msg, MSG_WAITALL | MSG_CMSG_CLOEXEC) !=
+	    sizeof(cl->req))
+		return -1;
+
+	cmsg = CMSG_FIRSTHDR(&msg);
+	if (!cmsg || cmsg->cmsg_level != SOL_SOCKET ||
+	    cmsg->cmsg_type != SCM_RIGHTS ||
+	    cmsg->cmsg_len != CMSG_LEN(sizeof(fds)))
+		return -1;
+	memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+	cl->out_fd = fds[0];
+	cl->err_fd = fds[1];
+
+	if (cl->req.magic != INCR_MAGIC ||
+	    (cl->req.op != 'a' && cl->req.op != 'f') ||
+	    cl->req.payload_len < 3 || cl->req.payload_len > INCR_MAX_PAYLOAD)
+		return -1;
+
+	cl->payload = xmalloc(cl->req.payload_len);
+	got = recv(cl->fd, cl->payload, cl->req.payload_len, MSG_WAITALL);
+	if (got != cl->req.payload_len ||
+	    cl->payload[cl->req.payload_len - 1] != '\0')
+		return -1;
+	return 0;
+}
+
+static int incr_handle_request(struct incr_client *cl, struct context *tmpl)
+{
+	struct context c = *tmpl;
+	struct mddev_dev *devlist = NULL, **dlp = &devlist, *dv;
+	char *end = cl->payload + cl->req.payload_len;
+	char *homehost = cl->payload;
+	char *path = homehost + strlen(homehost) + 1;
+	char *p;
+	int rv;
+
+	c.runstop = cl->req.runstop;
+	c.verbose = cl->req.verbose;
+	c.export = cl->req.export;
+	c.homehost = homehost[0] ? homehost : NULL;
+	c.require_homehost = cl->req.require_homehost;
+
+	if (path >= end)
+		return 1;
+	for (p = path + strlen(path) + 1; p < end; p += strlen(p) + 1) {
+		dv = xcalloc(1, sizeof(*dv));
+		dv->devname = p;
+		*dlp = dv;
+		dlp = &dv->next;
+	}
+	if (!devlist)
+		return 1;
+
+	if (cl->req.op == 'f')
+		rv = Incremental_remove(devlist->devname, path[0] ? path : NULL,
+					c.verbose);
+	else
+		rv = Incremental(devlist, &c, NULL);
+
+	while (devlist) {
+		dv = devlist;
+		devlist = dv->next;
+		free(dv);
+	}
+	return rv;
+}
+
+/*
+ * Accept everything that is already queued, then keep accepting for as
+ * long as requests keep arriving within INCR_BATCH_WAIT_MSEC.
+ */
+static int incr_accept_batch(int sfd, struct incr_client *batch)
+{
+	struct pollfd pfd = { .fd = sfd, .events = POLLIN };
+	int cnt = 0;
+
+	while (cnt < INCR_MAX_BATCH) {
+		int fd = accept4(sfd, NULL, NULL, SOCK_CLOEXEC);
+
+		if (is_fd_valid(fd)) {
+			batch[cnt++].fd = fd;
+			continue;
+		}
+		if (errno == EINTR)
+			continue;
+		if (errno != EAGAIN && errno != EWOULDBLOCK)
+			break;
+		if (poll(&pfd, 1, cnt ? INCR_BATCH_WAIT_MSEC : -1) <= 0)
+			break;
+	}
+	return cnt;
+}
+
+/**
+ * Incremental_serve() - run the incremental assembly service.
+ * @c: context, used as a template for each request.
+ *
+ * Return: 0 when terminated by a signal, 1 on setup error.
+ */
+int Incremental_serve(struct context *c)
+{
+	struct incr_client batch[INCR_MAX_BATCH];
+	struct sockaddr_un addr;
+	int saved_out, saved_err;
+	mode_t old_umask;
+	int sfd, rv;
+
+	if (incr_sock_addr(&addr)) {
+		pr_err("socket path %s is too long\n", INCREMENTAL_SOCK);
+		return 1;
+	}
+
+	(void)mkdir(MAP_DIR, 0755);
+	unlink(addr.sun_path);
+	sfd = socket(AF_LOCAL, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+	if (!is_fd_valid(sfd)) {
+		pr_err("cannot create socket: %s\n", strerror(errno));
+		return 1;
+	}
+	old_umask = umask(077); /* only root may hand us devices */
+	rv = bind(sfd, (struct sockaddr *)&addr, sizeof(addr));
+	umask(old_umask);
+	if (rv < 0 || listen(sfd, INCR_MAX_BATCH) < 0) {
+		pr_err("cannot listen on %s: %s\n", addr.sun_path,
+		       strerror(errno));
+		close(sfd);
+		return 1;
+	}
+
+	saved_out = fcntl(fileno(stdout), F_DUPFD_CLOEXEC, 3);
+	saved_err = fcntl(fileno(stderr), F_DUPFD_CLOEXEC, 3);
+
+	signal_s(SIGTERM, incr_catch_term);
+	signal_s(SIGINT, incr_catch_term);
+	signal_s(SIGPIPE, SIG_IGN);
+
+	/* Parse config once, all requests share it */
+	conf_get_devs();
+
+	while (!incr_sigterm) {
+		int cnt = incr_accept_batch(sfd, batch);
+		int held, i;
+
+		if (!cnt)
+			continue;
+
+		held = 0;
+		for (i = 0; i < cnt; i++) {
+			struct incr_client *cl = &batch[i];
+			int ack = INCR_MAGIC;
+			int rv = 1;
+
+			/* don't keep other mdadm out for a whole batch */
+			if (i % INCR_HOLD_MAX == 0) {
+				if (held)
+					map_release();
+				held = map_hold() == 0;
+			}
+
+			/* a client that stopped waiting makes the ack fail */
+			if (incr_recv_request(cl) == 0 &&
+			    write(cl->fd, &ack, sizeof(ack)) == sizeof(ack)) {
+				fflush(stdout);
+				fflush(stderr);
+				dup2(cl->out_fd, fileno(stdout));
+				dup2(cl->err_fd, fileno(stderr));
+
+				/* the disk may have been replaced since */
+				ddf_search_cache(true);
+				rv = incr_handle_request(cl, c);
+				ddf_search_cache(false);
+				/* a new disk may reuse the dev_t of this one */
+				if (cl->req.op == 'f')
+					policy_paths_invalidate();
+
+				fflush(stdout);
+				fflush(stderr);
+				dup2(saved_out, fileno(stdout));
+				dup2(saved_err, fileno(stderr));
+			}
+			if (write(cl->fd, &rv, sizeof(rv)) != sizeof(rv))
+				pr_err("lost client while reporting status\n");
+
+			close_fd(&cl->out_fd);
+			close_fd(&cl->err_fd);
+			close_fd(&cl->fd);
+			free(cl->payload);
+		}
+		if (held)
+			map_release();
+	}
+
+	unlink(addr.sun_path);
+	close(sfd);
+	close_fd(&saved_out);
+	close_fd(&saved_err);
+	return 0;
+}
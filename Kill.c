@@ -27,6 +27,8 @@
 
 #include	"mdadm.h"
 #include	"mdstat.h"
+#include	"xmalloc.h"
+
 
 int Kill(char *dev, struct supertype *st, int force, int verbose, int noexcl)
 {
@@ -65,9 +67,14 @@ int Kill(char *dev, struct supertype *st, int force, int verbose, int noexcl)
 	st->ignore_hw_compat = 1;
 	rv = st->ss->load_super(st, fd, dev);
 	if (rv == 0 || (force && rv >= 2)) {
+		if (rv == 0 && st->ss->clear_areas &&
+		    st->ss->clear_areas(st, fd) && verbose >= 0)
+			pr_err("Could not zero bitmap, PPL or bad block log on %s\n",
+			       dev);
 		st->ss->free_super(st);
 		st->ss->init_super(st, NULL, NULL, "", NULL, NULL,
 				   INVALID_SECTORS);
+		probe_hint_forget(fd);
 		if (st->ss->store_super(st, fd)) {
 			if (verbose >= 0)
 				pr_err("Could not zero superblock on %s\n",
@@ -87,6 +94,95 @@ int Kill(char *dev, struct supertype *st, int force, int verbose, int noexcl)
 	return rv;
 }
 
+/* devices wiped at the same time by Kill_devices() */
+#define KILL_MAX_CHILDREN 16
+
+/*
+ * Zero every superblock on @dev.  Without @st each recognised superblock
+ * is zeroed in turn until none is left.
+ * Returns as Kill(), 0 if at least one superblock was zeroed and 4 if
+ * there was none to begin with.
+ */
+static int kill_device(char *dev, struct supertype *st, int force,
+		       int verbose)
+{
+	int rv;
+
+	if (st)
+		return Kill(dev, st, force, verbose, 0);
+
+	rv = Kill(dev, NULL, force, verbose, 0);
+	if (rv)
+		return rv;
+	do {
+		rv = Kill(dev, NULL, force, -1, 0);
+	} while (rv == 0);
+	return rv == 4 ? 0 : rv;
+}
+
+static const char *kill_result(int rv)
+{
+	switch (rv) {
+	case 0:
+		return "superblock zeroed";
+	case 4:
+		return "no superblock found";
+	default:
+		return "not zeroed";
+	}
+}
+
+/**
+ * Kill_devices() - zero the superblocks of a list of devices.
+ * @devs: devices to wipe.
+ * @cnt: number of entries in @devs.
+ * @st: metadata to remove, NULL to remove whatever is found.
+ * @force: as for Kill().
+ * @verbose: as for Kill().
+ *
+ * Each device is probed and wiped by Kill() in a child of its own, up to
+ * KILL_MAX_CHILDREN at a time, so that a shelf of disks does not take one
+ * probe and write round trip per disk in sequence.  With more than one
+ * device a summary line per device is printed once all are done.
+ *
+ * Return: the results of Kill() or-ed together, except that finding no
+ * superblock is not an error when @st is NULL.
+ */
+int Kill_devices(char **devs, int cnt, struct supertype *st, int force,
+		 int verbose)
+{
+	struct child_pool cp;
+	int *results;
+	int rv = 0;
+	int i;
+
+	if (cnt == 1) {
+		rv = kill_device(devs[0], st, force, verbose);
+		return st ? rv : rv & ~4;
+	}
+
+	results = xcalloc(cnt, sizeof(*results));
+	child_pool_init(&cp, KILL_MAX_CHILDREN, child_store_status);
+
+	for (i = 0; i < cnt; i++) {
+		pid_t pid = child_pool_fork(&cp, &results[i]);
+
+		if (pid == 0)
+			_exit(kill_device(devs[i], st, force, verbose));
+		if (pid < 0)
+			results[i] = kill_device(devs[i], st, force, verbose);
+	}
+	child_pool_wait(&cp);
+
+	for (i = 0; i < cnt; i++) {
+		if (verbose >= 0)
+			printf("%s: %s\n", devs[i], kill_result(results[i]));
+		rv |= results[i];
+	}
+	free(results);
+	return st ? rv : rv & ~4;
+}
+
 int Kill_subarray(char *dev, char *subarray, int verbose)
 {
 	/* Delete a subarray out of a container, the subarry must be
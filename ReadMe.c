@@ -110,6 +110,7 @@ struct option long_options[] = {
 	{"udev-rules", 2, 0, UdevRules},
 	{"offroot", 0, 0, OffRootOpt},
 	{"examine-badblocks", 0, 0, ExamineBB},
+	{"estimate-recovery", 0, 0, EstimateRecoveryOpt},
 
 	{"dump", 1, 0, Dump},
 	{"restore", 1, 0, Restore},
@@ -183,6 +184,7 @@ struct option long_options[] = {
 	{"brief", 0, 0, Brief},
 	{"no-devices", 0, 0, NoDevices},
 	{"export", 0, 0, 'Y'},
+	{"json", 0, 0, JsonOpt},
 	{"sparc2.2", 0, 0, Sparc22},
 	{"test", 0, 0, 't'},
 	{"prefer", 1, 0, Prefer},
@@ -211,6 +213,7 @@ struct option long_options[] = {
 	/* For Incremental */
 	{"rebuild-map", 0, 0, RebuildMapOpt},
 	{"path", 1, 0, IncrementalPath},
+	{"serve", 0, 0, IncrementalServe},
 
 	{0, 0, 0, 0}
 };
@@ -271,6 +274,8 @@ char OptionHelp[] =
 "  --brief       -b   : Be less verbose, more brief\n"
 "  --export      -Y   : With --detail, --detail-platform or --examine use\n"
 "                       key=value format for easy import into environment\n"
+"  --json             : With --detail print the --export values as one\n"
+"                       JSON object per array and line\n"
 "  --force       -f   : Override normal checks and be more forceful\n"
 "\n"
 "  --assemble    -A   : Assemble an array\n"
@@ -463,6 +468,7 @@ char Help_misc[] =
 "  --examine     -E   : Examine superblock on an array component\n"
 "  --examine-bitmap -X: Display contents of a bitmap file\n"
 "  --examine-badblocks: Display list of known bad blocks on device\n"
+"  --estimate-recovery: Estimate data moved and time taken to --re-add device\n"
 "  --zero-superblock  : erase the MD superblock from a device.\n"
 "  --run         -R   : start a partially built array\n"
 "  --stop        -S   : deactivate array, releasing all resources\n"
@@ -555,6 +561,8 @@ char Help_incr[] =
 "                   : required number of devices, but are not yet started.\n"
 "  --fail        -f : First fail (if needed) and then remove device from\n"
 "                   : any array that it is a member of.\n"
+"  --serve          : Run as a service handling devices passed by other\n"
+"                   : 'mdadm --incremental' invocations.\n"
 ;
 
 char Help_config[] =
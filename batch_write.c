@@ -0,0 +1,143 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * Concurrent metadata writes.
+ *
+ * Metadata handlers update the same few sectors on every member of an
+ * array or container.  Member devices are opened O_DIRECT, so writing
+ * them one after another costs one device round trip per member.
+ * write_batch() hands a set of independent writes to the kernel at once
+ * using native AIO and waits for all of them.  Where AIO is unavailable
+ * it falls back to plain pwrite().
+ *
+ * Writes in one batch may complete in any order.  Callers that need an
+ * order on a device (e.g. a header before the anchor pointing at it)
+ * issue one batch per step.
+ */
+
+#include "mdadm.h"
+#include "xmalloc.h"
+
+#include <linux/aio_abi.h>
+#include <sys/syscall.h>
+
+/* requests in flight at once, larger batches are split */
+#define WRITE_BATCH_MAX 64
+
+static aio_context_t batch_ctx;
+static pid_t batch_ctx_pid;
+
+static void write_req_done(struct write_req *req, long long res)
+{
+	if (res < 0)
+		req->err = -res;
+	else if ((size_t)res != req->len)
+		req->err = EIO;
+	else
+		req->err = 0;
+}
+
+static void write_serial(struct write_req *reqs, int cnt)
+{
+	int i;
+
+	for (i = 0; i < cnt; i++) {
+		ssize_t n = pwrite(reqs[i].fd, reqs[i].buf, reqs[i].len,
+				   reqs[i].offset);
+
+		write_req_done(&reqs[i], n < 0 ? -errno : n);
+	}
+}
+
+/* the context does not survive fork(), set up one per process */
+static bool batch_ctx_ready(void)
+{
+	if (batch_ctx && batch_ctx_pid == getpid())
+		return true;
+
+	batch_ctx = 0;
+	if (syscall(SYS_io_setup, WRITE_BATCH_MAX, &batch_ctx) != 0) {
+		batch_ctx = 0;
+		return false;
+	}
+	batch_ctx_pid = getpid();
+	return true;
+}
+
+static void write_chunk(struct write_req *reqs, int cnt)
+{
+	struct iocb cbs[WRITE_BATCH_MAX], *cbp[WRITE_BATCH_MAX];
+	struct io_event events[WRITE_BATCH_MAX];
+	int submitted, done = 0;
+	int i;
+
+	memset(cbs, 0, sizeof(cbs[0]) * cnt);
+	for (i = 0; i < cnt; i++) {
+		cbs[i].aio_fildes = reqs[i].fd;
+		cbs[i].aio_lio_opcode = IOCB_CMD_PWRITE;
+		cbs[i].aio_buf = (unsigned long)reqs[i].buf;
+		cbs[i].aio_nbytes = reqs[i].len;
+		cbs[i].aio_offset = reqs[i].offset;
+		cbs[i].aio_data = i;
+		cbp[i] = &cbs[i];
+	}
+
+	submitted = syscall(SYS_io_submit, batch_ctx, cnt, cbp);
+	if (submitted < 0)
+		submitted = 0;
+
+	/* whatever the kernel did not take is written the slow way */
+	write_serial(reqs + submitted, cnt - submitted);
+
+	while (done < submitted) {
+		int n = syscall(SYS_io_getevents, batch_ctx, 1,
+				submitted - done, events, NULL);
+
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0) {
+			/* cannot tell how these ended, drop the context so
+			 * the buffers are no longer referenced
+			 */
+			syscall(SYS_io_destroy, batch_ctx);
+			batch_ctx = 0;
+			for (i = 0; i < cnt; i++)
+				if (reqs[i].err == EINPROGRESS)
+					reqs[i].err = EIO;
+			return;
+		}
+		for (i = 0; i < n; i++)
+			write_req_done(&reqs[events[i].data], events[i].res);
+		done += n;
+	}
+}
+
+/**
+ * write_batch() - issue independent writes concurrently.
+ * @reqs: writes to do, each target region written by at most one of them.
+ * @cnt: number of entries in @reqs.
+ *
+ * Returns once every write has finished.  Buffers must meet the
+ * alignment rules of the file descriptors they are written to.
+ *
+ * Return: number of writes that failed, see &write_req.err for each.
+ */
+int write_batch(struct write_req *reqs, int cnt)
+{
+	int failed = 0;
+	int i;
+
+	for (i = 0; i < cnt; i++)
+		reqs[i].err = EINPROGRESS;
+
+	if (cnt == 1 || !batch_ctx_ready()) {
+		write_serial(reqs, cnt);
+	} else {
+		for (i = 0; i < cnt; i += WRITE_BATCH_MAX)
+			write_chunk(reqs + i, min(cnt - i, WRITE_BATCH_MAX));
+	}
+
+	for (i = 0; i < cnt; i++)
+		if (reqs[i].err)
+			failed++;
+	return failed;
+}
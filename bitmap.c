@@ -70,62 +70,125 @@ static const char *human_chunksize(unsigned long bytes)
 	return buf;
 }
 
+/* a run of dirty bits, in bitmap chunks */
+struct bitmap_extent {
+	unsigned long long start;
+	unsigned long long len;
+};
+
 typedef struct bitmap_info_s {
 	bitmap_super_t sb;
 	unsigned long long total_bits;
 	unsigned long long dirty_bits;
+	struct bitmap_extent *extents;	/* only collected when asked for */
+	unsigned int nr_extents;
+	unsigned int alloc_extents;
 } bitmap_info_t;
 
-/* count the dirty bits in the first num_bits of byte */
-static inline int count_dirty_bits_byte(char byte, int num_bits)
+/* bitmap contents are read this much at a time */
+#define BITMAP_READ_SIZE (1 << 20)
+
+static void free_bitmap_info(bitmap_info_t *info)
+{
+	if (!info)
+		return;
+	free(info->extents);
+	free(info);
+}
+
+/* count the dirty bits in the first num_bits of buf */
+static unsigned long long count_dirty_bits(unsigned char *buf,
+					   unsigned long long num_bits)
 {
-	int num = 0;
+	unsigned long long i, num = 0;
+	__u64 word;
 
-	switch (num_bits) { /* fall through... */
-		case 8:	if (byte & 128) num++;
-		case 7:	if (byte &  64) num++;
-		case 6:	if (byte &  32) num++;
-		case 5:	if (byte &  16) num++;
-		case 4:	if (byte &   8) num++;
-		case 3: if (byte &   4) num++;
-		case 2:	if (byte &   2) num++;
-		case 1:	if (byte &   1) num++;
-		default: break;
+	for (i = 0; i < num_bits / 64; i++) {
+		memcpy(&word, buf + i * 8, 8);
+		num += __builtin_popcountll(word);
 	}
+	for (i *= 8; i < num_bits / 8; i++)
+		num += __builtin_popcount(buf[i]);
+
+	if (num_bits % 8) /* not an even byte boundary */
+		num += __builtin_popcount(buf[i] & ((1 << (num_bits % 8)) - 1));
 
 	return num;
 }
 
-static int count_dirty_bits(char *buf, int num_bits)
+static void add_extent(bitmap_info_t *info, unsigned long long start,
+		       unsigned long long end)
 {
-	int i, num = 0;
+	if (info->nr_extents == info->alloc_extents) {
+		info->alloc_extents = info->alloc_extents * 2 ?: 64;
+		info->extents = xrealloc(info->extents, info->alloc_extents *
+					 sizeof(*info->extents));
+	}
+	info->extents[info->nr_extents].start = start;
+	info->extents[info->nr_extents].len = end - start;
+	info->nr_extents++;
+}
 
-	for (i = 0; i < num_bits / 8; i++)
-		num += count_dirty_bits_byte(buf[i], 8);
+/*
+ * Record runs of dirty bits in the first num_bits of buf, which hold bits
+ * from 'base' on.  Bits are little endian, bit 0 of byte 0 is chunk 0.
+ * *run is the start of a run still open from the previous buffer, or ~0.
+ */
+static void find_dirty_extents(bitmap_info_t *info, unsigned char *buf,
+			       unsigned long long base,
+			       unsigned long long num_bits,
+			       unsigned long long *run)
+{
+	unsigned long long i = 0;
 
-	if (num_bits % 8) /* not an even byte boundary */
-		num += count_dirty_bits_byte(buf[i], num_bits % 8);
+	while (i < num_bits) {
+		unsigned int n = min(num_bits - i, 64ULL);
+		__u64 word = 0;
 
-	return num;
+		memcpy(&word, buf + i / 8, (n + 7) / 8);
+		word = __le64_to_cpu(word);
+		if (n < 64)
+			word &= (1ULL << n) - 1;
+
+		/* the common cases: nothing changes within the word */
+		if (word == 0 && *run == ~0ULL) {
+			i += n;
+			continue;
+		}
+		if (n == 64 && word == ~0ULL && *run != ~0ULL) {
+			i += n;
+			continue;
+		}
+		for (; n; n--, i++, word >>= 1) {
+			if ((word & 1) && *run == ~0ULL) {
+				*run = base + i;
+			} else if (!(word & 1) && *run != ~0ULL) {
+				add_extent(info, *run, base + i);
+				*run = ~0ULL;
+			}
+		}
+	}
 }
 
-static bitmap_info_t *bitmap_fd_read(int fd, int brief)
+static bitmap_info_t *bitmap_fd_read(int fd, int brief, bool extents)
 {
 	/* Note: fd might be open O_DIRECT, so we must be
 	 * careful to align reads properly
 	 */
 	unsigned long long total_bits = 0, read_bits = 0, dirty_bits = 0;
+	unsigned long long run = ~0ULL;
 	bitmap_info_t *info;
 	void *buf;
 	unsigned int n, skip;
 
-	if (posix_memalign(&buf, 4096, 8192) != 0) {
-		pr_err("failed to allocate 8192 bytes\n");
+	if (posix_memalign(&buf, 4096, BITMAP_READ_SIZE) != 0) {
+		pr_err("failed to allocate %d bytes\n", BITMAP_READ_SIZE);
 		return NULL;
 	}
-	n = read(fd, buf, 8192);
+	/* the superblock and, for small bitmaps, all the bits */
+	n = read(fd, buf, brief ? 4096 : BITMAP_READ_SIZE);
 
-	info = xmalloc(sizeof(*info));
+	info = xcalloc(1, sizeof(*info));
 
 	if (n < sizeof(info->sb)) {
 		pr_err("failed to read superblock of bitmap file: %s\n", strerror(errno));
@@ -154,19 +217,24 @@ static bitmap_info_t *bitmap_fd_read(int fd, int brief)
 		unsigned long long remaining = total_bits - read_bits;
 
 		if (n == 0) {
-			n = read(fd, buf, 8192);
+			n = read(fd, buf, BITMAP_READ_SIZE);
 			skip = 0;
 			if (n <= 0)
 				break;
 		}
-		if (remaining > (n-skip) * 8) /* we want the full buffer */
-			remaining = (n-skip) * 8;
+		if (remaining > (n-skip) * 8ULL) /* we want the full buffer */
+			remaining = (n-skip) * 8ULL;
 
 		dirty_bits += count_dirty_bits(buf+skip, remaining);
+		if (extents)
+			find_dirty_extents(info, buf+skip, read_bits, remaining,
+					   &run);
 
 		read_bits += remaining;
 		n = 0;
 	}
+	if (run != ~0ULL)
+		add_extent(info, run, read_bits);
 
 	if (read_bits < total_bits) { /* file truncated... */
 		pr_err("WARNING: bitmap file is not large enough for array size %llu!\n\n",
@@ -180,6 +248,46 @@ out:
 	return info;
 }
 
+/* list dirty extents in sectors of the sync range, and their sizes */
+static void print_dirty_extents(bitmap_info_t *info)
+{
+	unsigned long long sectors = info->sb.chunksize >> 9;
+	unsigned long long hist[64] = { 0 };
+	unsigned int i;
+	int b, top = -1;
+
+	printf("   Dirty Extents : %u (start+length in sectors)\n",
+	       info->nr_extents);
+	for (i = 0; i < info->nr_extents; i++) {
+		struct bitmap_extent *e = &info->extents[i];
+		unsigned long long len = e->len * sectors;
+
+		/* the last chunk may stretch beyond the end of the array */
+		if ((e->start + e->len) * sectors > info->sb.sync_size)
+			len = info->sb.sync_size - e->start * sectors;
+		printf("                   %llu+%llu\n", e->start * sectors, len);
+
+		b = 63 - __builtin_clzll(e->len);
+		hist[b]++;
+		if (b > top)
+			top = b;
+	}
+	if (top < 0)
+		return;
+
+	printf("Extent Histogram : chunks per extent: count\n");
+	for (b = 0; b <= top; b++) {
+		char range[48];
+
+		if (b == 0)
+			snprintf(range, sizeof(range), "1");
+		else
+			snprintf(range, sizeof(range), "%llu-%llu",
+				 1ULL << b, (2ULL << b) - 1);
+		printf("                   %s: %llu\n", range, hist[b]);
+	}
+}
+
 static int
 bitmap_file_open(char *filename, struct supertype **stp, int node_num, int fd)
 {
@@ -211,9 +319,11 @@ bitmap_file_open(char *filename, struct supertype **stp, int node_num, int fd)
 		st = guess_super(fd);
 
 	if (!st) {
-		/* just look at device... */
-		lseek(fd, 0, 0);
-	} else if (!st->ss->locate_bitmap) {
+		pr_err("No md superblock detected on %s\n", filename);
+		close(fd);
+		return -1;
+	}
+	if (!st->ss->locate_bitmap) {
 		pr_err("No bitmap possible with %s metadata\n", st->ss->name);
 		close(fd);
 		return -1;
@@ -241,14 +351,14 @@ static __u32 swapl(__u32 l)
 	c[2] = t;
 	return l;
 }
-int ExamineBitmap(char *filename, int brief, struct supertype *st)
+int ExamineBitmap(char *filename, int brief, int verbose, struct supertype *st)
 {
 	/*
 	 * Read the bitmap file and display its contents
 	 */
 
 	bitmap_super_t *sb;
-	bitmap_info_t *info;
+	bitmap_info_t *info, *next;
 	int rv = 1;
 	char buf[64];
 	int swap;
@@ -259,10 +369,9 @@ int ExamineBitmap(char *filename, int brief, struct supertype *st)
 	if (fd < 0)
 		return rv;
 
-	info = bitmap_fd_read(fd, brief);
+	info = bitmap_fd_read(fd, brief, verbose > 0);
 	if (!info) {
 		close_fd(&fd);
-		free(info);
 		return rv;
 	}
 	sb = &info->sb;
@@ -334,6 +443,8 @@ int ExamineBitmap(char *filename, int brief, struct supertype *st)
 		printf("          Bitmap : %llu bits (chunks), %llu dirty (%2.1f%%)\n",
 		       info->total_bits, info->dirty_bits,
 		       100.0 * info->dirty_bits / (info->total_bits?:1));
+		if (verbose > 0)
+			print_dirty_extents(info);
 	} else {
 		printf("   Cluster nodes : %d\n", sb->nodes);
 		printf("    Cluster name : %-64s\n", sb->cluster_name);
@@ -344,12 +455,14 @@ int ExamineBitmap(char *filename, int brief, struct supertype *st)
 				printf("   Unable to open bitmap file on node: %i\n", i);
 				continue;
 			}
-			info = bitmap_fd_read(fd, brief);
-			if (!info) {
+			next = bitmap_fd_read(fd, brief, verbose > 0);
+			if (!next) {
 				printf("   Unable to read bitmap on node: %i\n", i);
 				continue;
 			}
-			free(sb);
+			/* sb points into info, so drop it only once replaced */
+			free_bitmap_info(info);
+			info = next;
 			sb = &info->sb;
 			if (sb->magic != BITMAP_MAGIC)
 				pr_err("invalid bitmap magic 0x%x, the bitmap file appears to be corrupted\n", sb->magic);
@@ -365,12 +478,249 @@ int ExamineBitmap(char *filename, int brief, struct supertype *st)
 			printf("          Bitmap : %llu bits (chunks), %llu dirty (%2.1f%%)\n",
 			       info->total_bits, info->dirty_bits,
 			       100.0 * info->dirty_bits / (info->total_bits?:1));
+			if (verbose > 0)
+				print_dirty_extents(info);
 		}
 	}
 
 free_info:
 	close(fd);
-	free(info);
+	free_bitmap_info(info);
+	return rv;
+}
+
+/* a speed in KiB/s from sync_speed_min/max or speed_limit_min/max */
+static unsigned long read_speed(char *path)
+{
+	char buf[64];
+
+	if (load_sys(path, buf, sizeof(buf)) != 0)
+		return 0;
+	return strtoul(buf, NULL, 10);
+}
+
+/*
+ * Recovery runs at sync_speed_max when the array is otherwise idle and
+ * is throttled down to sync_speed_min under load.  Use the limits of the
+ * running array if there is one, else the system wide defaults.
+ */
+static void recovery_speed_limits(int uuid[4], unsigned long *min,
+				  unsigned long *max, char *from, int len)
+{
+	struct map_ent *map = NULL, *me;
+	char path[PATH_MAX];
+
+	*min = read_speed("/proc/sys/dev/raid/speed_limit_min");
+	*max = read_speed("/proc/sys/dev/raid/speed_limit_max");
+	snprintf(from, len, "system");
+
+	map_read(&map);
+	me = map_by_uuid(&map, uuid);
+	if (me) {
+		unsigned long v;
+
+		snprintf(path, sizeof(path), "/sys/block/%s/md/sync_speed_min",
+			 me->devnm);
+		v = read_speed(path);
+		if (v)
+			*min = v;
+		snprintf(path, sizeof(path), "/sys/block/%s/md/sync_speed_max",
+			 me->devnm);
+		v = read_speed(path);
+		if (v)
+			*max = v;
+		snprintf(from, len, "%s", me->devnm);
+	}
+	map_free(map);
+}
+
+/* sequential read throughput of a member in KiB/s, 0 if unknown */
+static unsigned long measure_member_speed(char *devname,
+					  unsigned long long offset)
+{
+	const int bufsize = 1 << 20, count = 64;
+	struct timespec start, end;
+	unsigned long long usec;
+	void *buf;
+	int fd, i;
+
+	fd = open(devname, O_RDONLY | O_DIRECT);
+	if (!is_fd_valid(fd))
+		return 0;
+	if (posix_memalign(&buf, 4096, bufsize) != 0) {
+		close(fd);
+		return 0;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < count; i++)
+		if (pread(fd, buf, bufsize, offset + (off_t)i * bufsize) != bufsize)
+			break;
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	free(buf);
+	close(fd);
+
+	usec = (end.tv_sec - start.tv_sec) * 1000000ULL +
+	       (end.tv_nsec - start.tv_nsec) / 1000;
+	if (i == 0 || usec == 0)
+		return 0;
+	return (unsigned long long)i * (bufsize >> 10) * 1000000 / usec;
+}
+
+static const char *duration(unsigned long long kib, unsigned long speed)
+{
+	static char buf[32];
+	unsigned long long secs;
+
+	if (!speed)
+		return "unknown";
+	secs = (kib + speed - 1) / speed;
+	snprintf(buf, sizeof(buf), "%llu:%02llu:%02llu", secs / 3600,
+		 secs / 60 % 60, secs % 60);
+	return buf;
+}
+
+/*
+ * Work out what recovering one member from this bitmap moves.  For all
+ * levels but raid10 the sync range is the space on each member; for
+ * raid10 it is the array space, of which each member holds copies /
+ * raid_disks.
+ */
+static void print_recovery_estimate(bitmap_info_t *bi, struct mdinfo *info,
+				    unsigned long min, unsigned long max,
+				    unsigned long measured, char *from)
+{
+	int disks = info->array.raid_disks;
+	unsigned long long dirty, member;
+
+	dirty = min(bi->dirty_bits * bi->sb.chunksize,
+		    (unsigned long long)bi->sb.sync_size * 512) >> 10;
+
+	switch (info->array.level) {
+	case 1:
+	case 4:
+	case 5:
+	case 6:
+		member = dirty;
+		break;
+	case 10: {
+		int copies = (info->array.layout & 255) *
+			     ((info->array.layout >> 8) & 255);
+
+		member = dirty * copies / (disks ?: 1);
+		break;
+	}
+	default:
+		printf("        Recovery : not possible for %s\n",
+		       map_num_s(pers, info->array.level));
+		return;
+	}
+
+	printf("           Dirty : %llu KiB%s of the sync range\n", dirty,
+	       human_size(dirty << 10));
+	printf("           Write : %llu KiB%s to the recovered member\n", member,
+	       human_size(member << 10));
+	if (info->array.level == 1 || info->array.level == 10)
+		printf("            Read : %llu KiB%s from the other members\n",
+		       member, human_size(member << 10));
+	else
+		printf("            Read : %llu KiB%s from each of %d other members\n",
+		       member, human_size(member << 10), disks - 1);
+	printf("           Speed : %lu-%lu KiB/s (limits of %s)\n", min, max, from);
+	/* the speed limits apply to each member, so time what one does */
+	printf("        Time Min : %s at %lu KiB/s\n", duration(member, max), max);
+	printf("        Time Max : %s at %lu KiB/s\n", duration(member, min), min);
+	if (measured) {
+		unsigned long speed = max ? min(measured, max) : measured;
+
+		printf("        Expected : %s, member reads at %lu KiB/s\n",
+		       duration(member, speed), measured);
+	}
+}
+
+/**
+ * EstimateRecovery() - estimate the cost of a bitmap based recovery.
+ * @devname: member device holding the bitmap.
+ * @verbose: also measure the read throughput of @devname.
+ * @st: metadata type if given on the command line.
+ *
+ * Converts the dirty chunks of the bitmap into the amount of data a
+ * --re-add of @devname would move, and the time that takes at the
+ * recovery speed limits.  Clustered bitmaps are reported per node.
+ *
+ * Return: 0 on success, 1 on error.
+ */
+int EstimateRecovery(char *devname, int verbose, struct supertype *st)
+{
+	unsigned long min, max, measured = 0;
+	bitmap_info_t *bi = NULL;
+	struct mdinfo info;
+	char from[32];
+	int fd, node, nodes = 1;
+	int rv = 1;
+
+	fd = open(devname, O_RDONLY|O_DIRECT);
+	if (fd < 0) {
+		pr_err("cannot open %s: %s\n", devname, strerror(errno));
+		return 1;
+	}
+	if (!st)
+		st = guess_super(fd);
+	if (!st) {
+		pr_err("No md superblock detected on %s\n", devname);
+		close(fd);
+		return 1;
+	}
+	/*
+	 * bitmap_file_open() needs the metadata type, and locate_bitmap()
+	 * only keeps a superblock that was loaded before it.
+	 */
+	if (st->ss->load_super(st, fd, devname) != 0) {
+		pr_err("Cannot load metadata from %s\n", devname);
+		goto out;
+	}
+	fd = bitmap_file_open(devname, &st, 0, fd);
+	if (fd < 0) {
+		st->ss->free_super(st);
+		return 1;
+	}
+	st->ss->getinfo_super(st, &info, NULL);
+
+	recovery_speed_limits(info.uuid, &min, &max, from, sizeof(from));
+	if (verbose > 0)
+		measured = measure_member_speed(devname,
+						info.data_offset << 9);
+
+	printf("           Level : %s, %d members\n",
+	       map_num_s(pers, info.array.level), info.array.raid_disks);
+	for (node = 0; node < nodes; node++) {
+		if (st->ss->locate_bitmap(st, fd, node) != 0) {
+			pr_err("%s doesn't have bitmap\n", devname);
+			goto out;
+		}
+		free_bitmap_info(bi);
+		bi = bitmap_fd_read(fd, 0, false);
+		if (!bi)
+			goto out;
+		if (bi->sb.magic != BITMAP_MAGIC) {
+			pr_err("invalid bitmap magic 0x%x on %s\n",
+			       bi->sb.magic, devname);
+			goto out;
+		}
+		if (node == 0 && bi->sb.nodes > 1)
+			nodes = bi->sb.nodes;
+		if (nodes > 1)
+			printf("       Node Slot : %d\n", node);
+		printf("          Bitmap : %llu of %llu chunks of %s dirty\n",
+		       bi->dirty_bits, bi->total_bits,
+		       human_chunksize(bi->sb.chunksize));
+		print_recovery_estimate(bi, &info, min, max, measured, from);
+	}
+	rv = 0;
+out:
+	free_bitmap_info(bi);
+	st->ss->free_super(st);
+	close(fd);
 	return rv;
 }
 
@@ -393,7 +743,8 @@ int IsBitmapDirty(char *filename)
 	if (fd < 0)
 		goto out;
 
-	info = bitmap_fd_read(fd, 0);
+	/* only the node count is needed here, bits are read per node below */
+	info = bitmap_fd_read(fd, 1, false);
 	if (!info) {
 		close(fd);
 		goto out;
@@ -402,7 +753,7 @@ int IsBitmapDirty(char *filename)
 	sb = &info->sb;
 	for (i = 0; i < (int)sb->nodes; i++) {
 		st = NULL;
-		free(info);
+		free_bitmap_info(info);
 		info = NULL;
 
 		fd = bitmap_file_open(filename, &st, i, fd);
@@ -410,7 +761,7 @@ int IsBitmapDirty(char *filename)
 		if (fd < 0)
 			goto out;
 
-		info = bitmap_fd_read(fd, 0);
+		info = bitmap_fd_read(fd, 0, false);
 		if (!info) {
 			close(fd);
 			goto out;
@@ -418,7 +769,7 @@ int IsBitmapDirty(char *filename)
 
 		sb = &info->sb;
 		if (sb->magic != BITMAP_MAGIC) { /* invalid bitmap magic */
-			free(info);
+			free_bitmap_info(info);
 			close(fd);
 			goto out;
 		}
@@ -427,7 +778,7 @@ int IsBitmapDirty(char *filename)
 			rv = 1;
 	}
 	close(fd);
-	free(info);
+	free_bitmap_info(info);
 	return rv;
 out:
 	return -1;
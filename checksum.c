@@ -0,0 +1,446 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * Checksums of on-disk metadata.
+ *
+ * All metadata handlers go through here:
+ * - csum_crc32c() for PPL headers and the raid5 journal (crc32c_le()
+ *   semantics: no inversion on entry or exit),
+ * - csum_crc32() for DDF sections (zlib crc32() semantics as built in
+ *   crc32.c, which also leaves inversion to the caller),
+ * - csum_sum32() and csum_sum32_le() for the 32 bit word sums of version
+ *   0.90 and 1.x superblocks and IMSM anchors.
+ *
+ * On x86_64 the CRC32 instruction of SSE4.2, carry-less multiplication
+ * (PCLMULQDQ) and SSE2 are used when the CPU has them, anything else
+ * takes the portable table driven or scalar path.  Build with -DMAIN for
+ * a program that checks every path against the original implementations
+ * and measures throughput.
+ */
+
+#include "mdadm.h"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define CSUM_X86 1
+#include <immintrin.h>
+#endif
+
+unsigned long crc32(unsigned long crc, const unsigned char *buf, unsigned len);
+
+/* set by the self test to compare the portable paths with the fast ones */
+static bool csum_generic_only;
+
+/* CRC32C (Castagnoli), reflected polynomial 0x82F63B78 */
+static const __u32 crc32c_table[256] = {
+	0x00000000, 0xf26b8303, 0xe13b70f7, 0x1350f3f4,
+	0xc79a971f, 0x35f1141c, 0x26a1e7e8, 0xd4ca64eb,
+	0x8ad958cf, 0x78b2dbcc, 0x6be22838, 0x9989ab3b,
+	0x4d43cfd0, 0xbf284cd3, 0xac78bf27, 0x5e133c24,
+	0x105ec76f, 0xe235446c, 0xf165b798, 0x030e349b,
+	0xd7c45070, 0x25afd373, 0x36ff2087, 0xc494a384,
+	0x9a879fa0, 0x68ec1ca3, 0x7bbcef57, 0x89d76c54,
+	0x5d1d08bf, 0xaf768bbc, 0xbc267848, 0x4e4dfb4b,
+	0x20bd8ede, 0xd2d60ddd, 0xc186fe29, 0x33ed7d2a,
+	0xe72719c1, 0x154c9ac2, 0x061c6936, 0xf477ea35,
+	0xaa64d611, 0x580f5512, 0x4b5fa6e6, 0xb93425e5,
+	0x6dfe410e, 0x9f95c20d, 0x8cc531f9, 0x7eaeb2fa,
+	0x30e349b1, 0xc288cab2, 0xd1d83946, 0x23b3ba45,
+	0xf779deae, 0x05125dad, 0x1642ae59, 0xe4292d5a,
+	0xba3a117e, 0x4851927d, 0x5b016189, 0xa96ae28a,
+	0x7da08661, 0x8fcb0562, 0x9c9bf696, 0x6ef07595,
+	0x417b1dbc, 0xb3109ebf, 0xa0406d4b, 0x522bee48,
+	0x86e18aa3, 0x748a09a0, 0x67dafa54, 0x95b17957,
+	0xcba24573, 0x39c9c670, 0x2a993584, 0xd8f2b687,
+	0x0c38d26c, 0xfe53516f, 0xed03a29b, 0x1f682198,
+	0x5125dad3, 0xa34e59d0, 0xb01eaa24, 0x42752927,
+	0x96bf4dcc, 0x64d4cecf, 0x77843d3b, 0x85efbe38,
+	0xdbfc821c, 0x2997011f, 0x3ac7f2eb, 0xc8ac71e8,
+	0x1c661503, 0xee0d9600, 0xfd5d65f4, 0x0f36e6f7,
+	0x61c69362, 0x93ad1061, 0x80fde395, 0x72966096,
+	0xa65c047d, 0x5437877e, 0x4767748a, 0xb50cf789,
+	0xeb1fcbad, 0x197448ae, 0x0a24bb5a, 0xf84f3859,
+	0x2c855cb2, 0xdeeedfb1, 0xcdbe2c45, 0x3fd5af46,
+	0x7198540d, 0x83f3d70e, 0x90a324fa, 0x62c8a7f9,
+	0xb602c312, 0x44694011, 0x5739b3e5, 0xa55230e6,
+	0xfb410cc2, 0x092a8fc1, 0x1a7a7c35, 0xe811ff36,
+	0x3cdb9bdd, 0xceb018de, 0xdde0eb2a, 0x2f8b6829,
+	0x82f63b78, 0x709db87b, 0x63cd4b8f, 0x91a6c88c,
+	0x456cac67, 0xb7072f64, 0xa457dc90, 0x563c5f93,
+	0x082f63b7, 0xfa44e0b4, 0xe9141340, 0x1b7f9043,
+	0xcfb5f4a8, 0x3dde77ab, 0x2e8e845f, 0xdce5075c,
+	0x92a8fc17, 0x60c37f14, 0x73938ce0, 0x81f80fe3,
+	0x55326b08, 0xa759e80b, 0xb4091bff, 0x466298fc,
+	0x1871a4d8, 0xea1a27db, 0xf94ad42f, 0x0b21572c,
+	0xdfeb33c7, 0x2d80b0c4, 0x3ed04330, 0xccbbc033,
+	0xa24bb5a6, 0x502036a5, 0x4370c551, 0xb11b4652,
+	0x65d122b9, 0x97baa1ba, 0x84ea524e, 0x7681d14d,
+	0x2892ed69, 0xdaf96e6a, 0xc9a99d9e, 0x3bc21e9d,
+	0xef087a76, 0x1d63f975, 0x0e330a81, 0xfc588982,
+	0xb21572c9, 0x407ef1ca, 0x532e023e, 0xa145813d,
+	0x758fe5d6, 0x87e466d5, 0x94b49521, 0x66df1622,
+	0x38cc2a06, 0xcaa7a905, 0xd9f75af1, 0x2b9cd9f2,
+	0xff56bd19, 0x0d3d3e1a, 0x1e6dcdee, 0xec064eed,
+	0xc38d26c4, 0x31e6a5c7, 0x22b65633, 0xd0ddd530,
+	0x0417b1db, 0xf67c32d8, 0xe52cc12c, 0x1747422f,
+	0x49547e0b, 0xbb3ffd08, 0xa86f0efc, 0x5a048dff,
+	0x8ecee914, 0x7ca56a17, 0x6ff599e3, 0x9d9e1ae0,
+	0xd3d3e1ab, 0x21b862a8, 0x32e8915c, 0xc083125f,
+	0x144976b4, 0xe622f5b7, 0xf5720643, 0x07198540,
+	0x590ab964, 0xab613a67, 0xb831c993, 0x4a5a4a90,
+	0x9e902e7b, 0x6cfbad78, 0x7fab5e8c, 0x8dc0dd8f,
+	0xe330a81a, 0x115b2b19, 0x020bd8ed, 0xf0605bee,
+	0x24aa3f05, 0xd6c1bc06, 0xc5914ff2, 0x37faccf1,
+	0x69e9f0d5, 0x9b8273d6, 0x88d28022, 0x7ab90321,
+	0xae7367ca, 0x5c18e4c9, 0x4f48173d, 0xbd23943e,
+	0xf36e6f75, 0x0105ec76, 0x12551f82, 0xe03e9c81,
+	0x34f4f86a, 0xc69f7b69, 0xd5cf889d, 0x27a40b9e,
+	0x79b737ba, 0x8bdcb4b9, 0x988c474d, 0x6ae7c44e,
+	0xbe2da0a5, 0x4c4623a6, 0x5f16d052, 0xad7d5351,
+};
+
+static __u32 crc32c_generic(__u32 crc, const unsigned char *p, size_t len)
+{
+	while (len--)
+		crc = crc32c_table[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+	return crc;
+}
+
+static __u64 sum32_generic(const void *buf, size_t len)
+{
+	const __u32 *p = buf;
+	__u64 sum = 0;
+
+	for (; len >= 4; len -= 4)
+		sum += *p++;
+	return sum;
+}
+
+#ifdef CSUM_X86
+
+__attribute__((target("sse4.2")))
+static __u32 crc32c_sse42(__u32 crc, const unsigned char *p, size_t len)
+{
+	__u64 c = crc;
+
+	for (; len && ((unsigned long)p & 7); len--)
+		c = _mm_crc32_u8(c, *p++);
+	for (; len >= 8; len -= 8, p += 8)
+		c = _mm_crc32_u64(c, *(const __u64 *)p);
+	for (; len; len--)
+		c = _mm_crc32_u8(c, *p++);
+	return c;
+}
+
+/*
+ * Fold 64 bytes at a time with carry-less multiplication and reduce with
+ * Barrett, see "Fast CRC Computation for Generic Polynomials Using
+ * PCLMULQDQ Instruction" (Intel, 2009).  The constants are those of the
+ * reflected CRC32 polynomial 0xEDB88320.  @len is at least 64 and a
+ * multiple of 16.
+ */
+__attribute__((target("pclmul,sse4.1")))
+static __u32 crc32_pclmul(__u32 crc, const unsigned char *buf, size_t len)
+{
+	const __m128i k1k2 = _mm_set_epi64x(0x01c6e41596, 0x0154442bd4);
+	const __m128i k3k4 = _mm_set_epi64x(0x00ccaa009e, 0x01751997d0);
+	const __m128i k5k0 = _mm_set_epi64x(0, 0x0163cd6124);
+	const __m128i poly = _mm_set_epi64x(0x01f7011641, 0x01db710641);
+	const __m128i mask = _mm_setr_epi32(~0, 0, ~0, 0);
+	__m128i x1, x2, x3, x4, x5, x6, x7, x8;
+
+	x1 = _mm_loadu_si128((const __m128i *)(buf + 0x00));
+	x2 = _mm_loadu_si128((const __m128i *)(buf + 0x10));
+	x3 = _mm_loadu_si128((const __m128i *)(buf + 0x20));
+	x4 = _mm_loadu_si128((const __m128i *)(buf + 0x30));
+	x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(crc));
+	buf += 64;
+	len -= 64;
+
+	for (; len >= 64; buf += 64, len -= 64) {
+		x5 = _mm_clmulepi64_si128(x1, k1k2, 0x00);
+		x6 = _mm_clmulepi64_si128(x2, k1k2, 0x00);
+		x7 = _mm_clmulepi64_si128(x3, k1k2, 0x00);
+		x8 = _mm_clmulepi64_si128(x4, k1k2, 0x00);
+		x1 = _mm_clmulepi64_si128(x1, k1k2, 0x11);
+		x2 = _mm_clmulepi64_si128(x2, k1k2, 0x11);
+		x3 = _mm_clmulepi64_si128(x3, k1k2, 0x11);
+		x4 = _mm_clmulepi64_si128(x4, k1k2, 0x11);
+		x1 = _mm_xor_si128(_mm_xor_si128(x1, x5),
+				   _mm_loadu_si128((const __m128i *)(buf + 0x00)));
+		x2 = _mm_xor_si128(_mm_xor_si128(x2, x6),
+				   _mm_loadu_si128((const __m128i *)(buf + 0x10)));
+		x3 = _mm_xor_si128(_mm_xor_si128(x3, x7),
+				   _mm_loadu_si128((const __m128i *)(buf + 0x20)));
+		x4 = _mm_xor_si128(_mm_xor_si128(x4, x8),
+				   _mm_loadu_si128((const __m128i *)(buf + 0x30)));
+	}
+
+	/* fold the four lanes into one */
+	x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+	x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+	x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+	for (; len >= 16; buf += 16, len -= 16) {
+		x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+		x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+		x1 = _mm_xor_si128(_mm_xor_si128(x1, x5),
+				   _mm_loadu_si128((const __m128i *)buf));
+	}
+
+	/* 128 bits to 64 */
+	x2 = _mm_clmulepi64_si128(x1, k3k4, 0x10);
+	x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+	x2 = _mm_srli_si128(x1, 4);
+	x1 = _mm_and_si128(x1, mask);
+	x1 = _mm_clmulepi64_si128(x1, k5k0, 0x00);
+	x1 = _mm_xor_si128(x1, x2);
+
+	/* Barrett reduction to 32 bits */
+	x2 = _mm_and_si128(x1, mask);
+	x2 = _mm_clmulepi64_si128(x2, poly, 0x10);
+	x2 = _mm_and_si128(x2, mask);
+	x2 = _mm_clmulepi64_si128(x2, poly, 0x00);
+	x1 = _mm_xor_si128(x1, x2);
+
+	return _mm_extract_epi32(x1, 1);
+}
+
+/* SSE2 is part of x86_64, no need to ask the CPU */
+static __u64 sum32_sse2(const void *buf, size_t len)
+{
+	const unsigned char *p = buf;
+	const __m128i zero = _mm_setzero_si128();
+	__m128i acc0 = zero, acc1 = zero;
+	__u64 lanes[2];
+
+	for (; len >= 16; len -= 16, p += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)p);
+
+		acc0 = _mm_add_epi64(acc0, _mm_unpacklo_epi32(v, zero));
+		acc1 = _mm_add_epi64(acc1, _mm_unpackhi_epi32(v, zero));
+	}
+	_mm_storeu_si128((__m128i *)lanes, _mm_add_epi64(acc0, acc1));
+	return lanes[0] + lanes[1] + sum32_generic(p, len);
+}
+
+#endif /* CSUM_X86 */
+
+/**
+ * csum_crc32c() - CRC32C of a buffer.
+ * @crc: seed, or the result for the preceding data.
+ * @buf: data.
+ * @len: length of @buf in bytes.
+ *
+ * Return: the same value as crc32c_le().
+ */
+__u32 csum_crc32c(__u32 crc, const void *buf, size_t len)
+{
+#ifdef CSUM_X86
+	if (!csum_generic_only && __builtin_cpu_supports("sse4.2"))
+		return crc32c_sse42(crc, buf, len);
+#endif
+	return crc32c_generic(crc, buf, len);
+}
+
+/**
+ * csum_crc32() - CRC32 (IEEE 802.3) of a buffer.
+ * @crc: seed, or the result for the preceding data.
+ * @buf: data.
+ * @len: length of @buf in bytes.
+ *
+ * Return: the same value as crc32() from crc32.c.
+ */
+__u32 csum_crc32(__u32 crc, const void *buf, size_t len)
+{
+	const unsigned char *p = buf;
+
+#ifdef CSUM_X86
+	if (!csum_generic_only && len >= 64 &&
+	    __builtin_cpu_supports("pclmul") &&
+	    __builtin_cpu_supports("sse4.1")) {
+		crc = crc32_pclmul(crc, p, len & ~15UL);
+		p += len & ~15UL;
+		len &= 15;
+	}
+#endif
+	return crc32(crc, p, len);
+}
+
+/**
+ * csum_sum32() - sum of the native endian 32 bit words of a buffer.
+ * @buf: data.
+ * @len: length of @buf in bytes, a trailing partial word is ignored.
+ *
+ * Return: the sum without any carry folding.
+ */
+__u64 csum_sum32(const void *buf, size_t len)
+{
+#ifdef CSUM_X86
+	if (!csum_generic_only)
+		return sum32_sse2(buf, len);
+#endif
+	return sum32_generic(buf, len);
+}
+
+/**
+ * csum_sum32_le() - sum of the little endian 32 bit words of a buffer.
+ * @buf: data.
+ * @len: length of @buf in bytes, a trailing partial word is ignored.
+ *
+ * Return: the sum without any carry folding.
+ */
+__u64 csum_sum32_le(const void *buf, size_t len)
+{
+#if __BYTE_ORDER == __LITTLE_ENDIAN
+	return csum_sum32(buf, len);
+#else
+	const __u32 *p = buf;
+	__u64 sum = 0;
+
+	for (; len >= 4; len -= 4)
+		sum += __le32_to_cpu(*p++);
+	return sum;
+#endif
+}
+
+#ifdef MAIN
+
+#include "xmalloc.h"
+#include <time.h>
+
+__u32 crc32c_le(__u32 crc, unsigned char const *p, size_t len);
+__u32 crc32_le(__u32 crc, unsigned char const *p, size_t len);
+
+/* calc_csum() as it was: the words summed one at a time */
+static __u64 sum32_reference(const void *buf, size_t len)
+{
+	const unsigned int *p = buf;
+	__u64 sum = 0;
+	size_t i;
+
+	for (i = 0; i < len / 4; i++)
+		sum += p[i];
+	return sum;
+}
+
+static int check(const char *what, size_t len, size_t off,
+		 unsigned long long got, unsigned long long want)
+{
+	if (got == want)
+		return 0;
+	fprintf(stderr, "%s%s: len %zu offset %zu: got %llx, want %llx\n",
+		what, csum_generic_only ? " (generic)" : "", len, off,
+		got, want);
+	return 1;
+}
+
+static int conformance(unsigned char *buf, size_t size)
+{
+	static const __u32 seeds[] = { 0, 0xffffffff, 0x12345678 };
+	int errors = 0;
+	size_t len, off;
+	int s;
+
+	for (len = 0; len <= 1024 + 64; len++)
+		for (off = 0; off < 16; off += 3)
+			for (s = 0; s < 3; s++) {
+				unsigned char *p = buf + off;
+				__u32 seed = seeds[s];
+
+				errors += check("crc32c", len, off,
+						csum_crc32c(seed, p, len),
+						crc32c_le(seed, p, len));
+				errors += check("crc32", len, off,
+						csum_crc32(seed, p, len),
+						crc32(seed, p, len));
+				errors += check("crc32 bitwise", len, off,
+						csum_crc32(seed, p, len),
+						crc32_le(seed, p, len));
+				if (s == 0)
+					errors += check("sum32", len, off,
+							csum_sum32(p, len),
+							sum32_reference(p, len));
+			}
+
+	/* the largest structures checksummed are a few MiB of DDF */
+	errors += check("crc32c", size, 0, csum_crc32c(0xffffffff, buf, size),
+			crc32c_le(0xffffffff, buf, size));
+	errors += check("crc32", size, 0, csum_crc32(0xffffffff, buf, size),
+			crc32(0xffffffff, buf, size));
+	errors += check("sum32", size, 0, csum_sum32(buf, size),
+			sum32_reference(buf, size));
+	return errors;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static volatile __u64 sink;
+
+#define BENCH(name, expr)						\
+	do {								\
+		double t = now();					\
+		int i;							\
+		for (i = 0; i < rounds; i++)				\
+			sink += (expr);					\
+		t = now() - t;						\
+		printf("%-14s %-8s %8zu bytes %10.1f MB/s\n", name,	\
+		       csum_generic_only ? "generic" : "fast", len,	\
+		       (double)len * rounds / t / 1e6);			\
+	} while (0)
+
+static void benchmark(unsigned char *buf, size_t len)
+{
+	int rounds = (256 << 20) / len;
+
+	BENCH("crc32c", csum_crc32c(0xffffffff, buf, len));
+	BENCH("crc32", csum_crc32(0xffffffff, buf, len));
+	BENCH("sum32", csum_sum32(buf, len));
+}
+
+int main(int argc, char *argv[])
+{
+	size_t size = 4 << 20;
+	unsigned char *buf = xmalloc(size + 16);
+	int errors = 0;
+	size_t i;
+
+	srandom(1);
+	for (i = 0; i < size + 16; i++)
+		buf[i] = random();
+
+	for (i = 0; i < 2; i++) {
+		csum_generic_only = i;
+		errors += conformance(buf, size);
+	}
+	if (errors) {
+		fprintf(stderr, "%d checksum mismatches\n", errors);
+		return 1;
+	}
+	printf("checksums match the reference implementations\n");
+
+	if (argc > 1 && strcmp(argv[1], "--bench") == 0) {
+		static const size_t sizes[] = { 512, 4096, 65536, 4 << 20 };
+		int s;
+
+		for (s = 0; s < 4; s++)
+			for (i = 0; i < 2; i++) {
+				csum_generic_only = !i;
+				benchmark(buf, sizes[s]);
+			}
+	}
+	free(buf);
+	return 0;
+}
+
+#endif /* MAIN */
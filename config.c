@@ -84,7 +84,8 @@ char DefaultAltConfDir[] = CONFFILE2 ".d";
 
 enum linetype { Devices, Array, Mailaddr, Mailfrom, Program, CreateDev,
 		Homehost, HomeCluster, AutoMode, Policy, PartPolicy, Sysfs,
-		MonitorDelay, EncryptionNoVerify, Probing, ImsmDisableOrom, LTEnd };
+		MonitorDelay, EncryptionNoVerify, Probing, ImsmDisableOrom, Metrics,
+		SafeMode, LTEnd };
 char *keywords[] = {
 	[Devices]  = "devices",
 	[Array]    = "array",
@@ -102,6 +103,8 @@ char *keywords[] = {
 	[EncryptionNoVerify] = "ENCRYPTION_NO_VERIFY",
 	[Probing] = "probing",
 	[ImsmDisableOrom] = "IMSM_DISABLE_OROM",
+	[Metrics]  = "metrics",
+	[SafeMode] = "safemode",
 	[LTEnd]    = NULL
 };
 
@@ -693,6 +696,7 @@ void encryption_no_verify_line(char *line)
 }
 
 static bool probing_ddf_extended;
+static char *probing_hints;
 void probing_line(char *line)
 {
 	char *word;
@@ -700,6 +704,10 @@ void probing_line(char *line)
 	for (word = dl_next(line); word != line; word = dl_next(word)) {
 		if (strcasecmp(word, "ddf_extended") == 0)
 			probing_ddf_extended = true;
+		else if (strcasecmp(word, "hints") == 0)
+			probing_hints = xstrdup(PROBE_HINTS_FILE);
+		else if (strncasecmp(word, "hints=", 6) == 0 && word[6] == '/')
+			probing_hints = xstrdup(word + 6);
 		else
 			pr_err("unrecognised word on PROBING line: %s\n", word);
 	}
@@ -720,6 +728,48 @@ void imsm_disable_orom_line(char *line)
 	}
 }
 
+static char *metrics_socket;
+static char *metrics_textfile;
+void metrics_line(char *line)
+{
+	char *word;
+
+	for (word = dl_next(line); word != line; word = dl_next(word)) {
+		if (strcasecmp(word, "socket") == 0)
+			metrics_socket = xstrdup(METRICS_SOCK);
+		else if (strncasecmp(word, "socket=", 7) == 0 && word[7] == '/')
+			metrics_socket = xstrdup(word + 7);
+		else if (strncasecmp(word, "textfile=", 9) == 0 && word[9] == '/')
+			metrics_textfile = xstrdup(word + 9);
+		else
+			pr_err("unrecognised word on METRICS line: %s\n", word);
+	}
+}
+
+static unsigned long safemode_min, safemode_max;
+void safemode_line(char *line)
+{
+	char *word, *end;
+	unsigned long ms;
+
+	for (word = dl_next(line); word != line; word = dl_next(word)) {
+		if (strncasecmp(word, "min=", 4) == 0) {
+			ms = strtoul(word + 4, &end, 10);
+			if (*end == '\0' && end != word + 4) {
+				safemode_min = ms;
+				continue;
+			}
+		} else if (strncasecmp(word, "max=", 4) == 0) {
+			ms = strtoul(word + 4, &end, 10);
+			if (*end == '\0' && end != word + 4) {
+				safemode_max = ms;
+				continue;
+			}
+		}
+		pr_err("unrecognised word on SAFEMODE line: %s\n", word);
+	}
+}
+
 char auto_yes[] = "yes";
 char auto_no[] = "no";
 char auto_homehost[] = "homehost";
@@ -913,6 +963,12 @@ void conf_file(FILE *f)
 		case ImsmDisableOrom:
 			imsm_disable_orom_line(line);
 			break;
+		case Metrics:
+			metrics_line(line);
+			break;
+		case SafeMode:
+			safemode_line(line);
+			break;
 		default:
 			pr_err("Unknown keyword %s\n", line);
 		}
@@ -1088,6 +1144,36 @@ bool conf_get_probing_ddf_extended(void)
 	return probing_ddf_extended;
 }
 
+char *conf_get_probing_hints(void)
+{
+	load_conffile();
+	return probing_hints;
+}
+
+char *conf_get_metrics_socket(void)
+{
+	load_conffile();
+	return metrics_socket;
+}
+
+char *conf_get_metrics_textfile(void)
+{
+	load_conffile();
+	return metrics_textfile;
+}
+
+/**
+ * conf_get_safemode_bounds() - limits for adapting safe_mode_delay.
+ * @min: set to the lower bound in ms, 0 if not configured.
+ * @max: set to the upper bound in ms, 0 if not configured.
+ */
+void conf_get_safemode_bounds(unsigned long *min, unsigned long *max)
+{
+	load_conffile();
+	*min = safemode_min;
+	*max = safemode_max;
+}
+
 bool conf_get_imsm_disable_orom(void)
 {
 	load_conffile();
@@ -245,6 +245,28 @@ int add_dev(const char *name, const struct stat *stb, int flag, struct FTW *s)
 	return 0;
 }
 
+/*
+ * (Re)build the list of names map_dev() looks in.  Callers about to
+ * fork workers that each map many devices call this first, so that the
+ * walk of /dev is done once and inherited.
+ */
+void map_dev_load(void)
+{
+	char *dev = "/dev";
+	struct stat stb;
+
+	while(devlist) {
+		struct devmap *d = devlist;
+		devlist = d->next;
+		free(d->name);
+		free(d);
+	}
+	if (lstat(dev, &stb) == 0 && S_ISLNK(stb.st_mode))
+		dev = "/dev/.";
+	nftw(dev, add_dev, 10, FTW_PHYS);
+	devlist_ready=1;
+}
+
 /*
  * Find a block device with the right major/minor number.
  * If we find multiple names, choose the shortest.
@@ -265,18 +287,7 @@ char *map_dev_preferred(int major, int minor, int create,
 
  retry:
 	if (!devlist_ready) {
-		char *dev = "/dev";
-		struct stat stb;
-		while(devlist) {
-			struct devmap *d = devlist;
-			devlist = d->next;
-			free(d->name);
-			free(d);
-		}
-		if (lstat(dev, &stb) == 0 && S_ISLNK(stb.st_mode))
-			dev = "/dev/.";
-		nftw(dev, add_dev, 10, FTW_PHYS);
-		devlist_ready=1;
+		map_dev_load();
 		did_check = 1;
 	}
 
@@ -433,6 +433,9 @@ static int disk_init_and_add(struct mdinfo *disk, struct mdinfo *clone,
 		close(disk->bb_fd);
 		return -1;
 	}
+	monitor_watch_fd(disk->state_fd);
+	monitor_watch_fd(disk->bb_fd);
+	monitor_watch_fd(disk->ubb_fd);
 	disk->prev_state = read_dev_state(disk->state_fd);
 	disk->curr_state = disk->prev_state;
 	disk->next = aa->info.devs;
@@ -659,8 +662,7 @@ static void manage_member(struct mdstat_ent *mdstat,
 		unsigned long long array_size;
 		struct active_array *newa = NULL;
 		a->check_reshape = 0;
-		info = sysfs_read(-1, mdstat->devnm,
-				  GET_DEVS|GET_OFFSET|GET_SIZE|GET_STATE);
+		info = sysfs_read(-1, mdstat->devnm, GET_DEVS);
 		if (!info)
 			goto out2;
 		for (d = info->devs; d; d = d->next) {
@@ -673,6 +675,9 @@ static void manage_member(struct mdstat_ent *mdstat,
 			if (d2)
 				/* already have this one */
 				continue;
+			if (sysfs_read_member(info, d, GET_OFFSET|GET_SIZE|
+					      GET_STATE))
+				continue;
 			if (!newa)
 				newa = duplicate_aa(a);
 
@@ -788,6 +793,9 @@ static void manage_new(struct mdstat_ent *mdstat,
 
 	dprintf("inst: %d action: %d state: %d\n", inst,
 		new->action_fd, new->info.state_fd);
+	monitor_watch_fd(new->info.state_fd);
+	monitor_watch_fd(new->action_fd);
+	monitor_watch_fd(new->sync_completed_fd);
 
 	if (mdi->safe_mode_delay >= 50)
 		/* Normal start, mdadm set this. */
@@ -795,6 +803,16 @@ static void manage_new(struct mdstat_ent *mdstat,
 	else
 		/* Restart, just pick a number */
 		new->info.safe_mode_delay = 5000;
+	conf_get_safemode_bounds(&new->safe_mode_min, &new->safe_mode_max);
+	if (!new->safe_mode_min)
+		new->safe_mode_min = new->info.safe_mode_delay;
+	if (new->safe_mode_max > new->safe_mode_min)
+		new->info.safe_mode_delay = min(max(new->info.safe_mode_delay,
+						    new->safe_mode_min),
+						new->safe_mode_max);
+	else
+		/* not adaptive */
+		new->safe_mode_max = 0;
 	sysfs_set_safemode(&new->info, new->info.safe_mode_delay);
 
 	/* reshape_position is set by mdadm in sysfs
@@ -879,48 +897,162 @@ void manage(struct mdstat_ent *mdstat, struct supertype *container)
 	}
 }
 
-static void handle_message(struct supertype *container, struct metadata_update *msg)
+/*
+ * mdstat is read on every wakeup of the manager, reuse one buffer and
+ * only rebuild the entry list when an array changed.  The list belongs
+ * to this function, callers must not free it.
+ */
+static struct mdstat_ent *manager_mdstat(void)
 {
-	/* queue this metadata update through to the monitor */
+	static struct mdstat_scan sc;
+	static struct mdstat_ent *ents;
+	int changes = mdstat_scan(&sc, 1);
+
+	if (changes < 0) {
+		free_mdstat(ents);
+		ents = NULL;
+	} else if (changes > 0 || !ents) {
+		free_mdstat(ents);
+		ents = mdstat_scan_ents(&sc, 0);
+	}
+	return ents;
+}
 
-	struct metadata_update *mu;
+/* hand everything queued to the monitor */
+static void drain_update_queue(struct supertype *container)
+{
+	while (update_queue_pending || update_queue) {
+		check_update_queue(container);
+		sleep_for(0, MSEC_TO_NSEC(15), true);
+	}
+}
 
-	if (msg->len <= 0)
-		while (update_queue_pending || update_queue) {
-			check_update_queue(container);
-			sleep_for(0, MSEC_TO_NSEC(15), true);
-		}
+/* wait until the monitor has been through a full loop */
+static void wait_monitor_pass(void)
+{
+	int cnt;
 
-	if (msg->len == 0) { /* ping_monitor */
-		int cnt;
+	cnt = monitor_loop_cnt;
+	if (cnt & 1)
+		cnt += 2; /* wait until next pselect */
+	else
+		cnt += 3; /* wait for 2 pselects */
+	wakeup_monitor();
 
-		cnt = monitor_loop_cnt;
-		if (cnt & 1)
-			cnt += 2; /* wait until next pselect */
-		else
-			cnt += 3; /* wait for 2 pselects */
-		wakeup_monitor();
+	while (monitor_loop_cnt - cnt < 0)
+		sleep_for(0, MSEC_TO_NSEC(10), true);
+}
 
-		while (monitor_loop_cnt - cnt < 0)
-			sleep_for(0, MSEC_TO_NSEC(10), true);
-	} else if (msg->len == -1) { /* ping_manager */
-		struct mdstat_ent *mdstat = mdstat_read(1, 0);
+static void queue_update(struct supertype *container, void *buf, int len)
+{
+	struct metadata_update *mu = xmalloc(sizeof(*mu));
+
+	mu->len = len;
+	mu->buf = buf;
+	mu->space = NULL;
+	mu->space_list = NULL;
+	mu->next = NULL;
+	if (container->ss->prepare_update)
+		if (!container->ss->prepare_update(container, mu))
+			free_updates(&mu);
+	queue_metadata_update(mu);
+}
 
-		manage(mdstat, container);
-		free_mdstat(mdstat);
-	} else if (!sigterm) {
-		mu = xmalloc(sizeof(*mu));
-		mu->len = msg->len;
-		mu->buf = msg->buf;
-		msg->buf = NULL;
+/* Check the framing of a batch, see send_update_batch() */
+static bool is_update_batch(struct metadata_update *msg)
+{
+	char *p = msg->buf, *end = msg->buf + msg->len;
+	__u32 hdr[2], ulen, i;
+
+	if (msg->len < (int)sizeof(hdr))
+		return false;
+	memcpy(hdr, p, sizeof(hdr));
+	if (hdr[0] != MSG_BATCH_MAGIC)
+		return false;
+
+	p += sizeof(hdr);
+	for (i = 0; i < hdr[1]; i++) {
+		if (end - p < (int)sizeof(ulen))
+			return false;
+		memcpy(&ulen, p, sizeof(ulen));
+		p += sizeof(ulen);
+		if (ulen == 0 || ulen > (__u32)(end - p))
+			return false;
+		p += ulen;
+	}
+	return p == end;
+}
+
+/*
+ * Queue all updates of a batch, they reach the monitor together.  If the
+ * metadata handler rejects any of them none is queued and false is
+ * returned, so the sender can tell the batch was not applied.
+ */
+static bool queue_update_batch(struct supertype *container,
+			       struct metadata_update *msg)
+{
+	char *p = msg->buf + 2 * sizeof(__u32);
+	char *end = msg->buf + msg->len;
+	struct metadata_update *batch = NULL, **tail = &batch;
+
+	while (p < end) {
+		struct metadata_update *mu = xmalloc(sizeof(*mu));
+		__u32 ulen;
+
+		memcpy(&ulen, p, sizeof(ulen));
+		p += sizeof(ulen);
+		mu->len = ulen;
+		mu->buf = xmalloc(ulen);
+		memcpy(mu->buf, p, ulen);
+		p += ulen;
 		mu->space = NULL;
 		mu->space_list = NULL;
 		mu->next = NULL;
-		if (container->ss->prepare_update)
-			if (!container->ss->prepare_update(container, mu))
-				free_updates(&mu);
-		queue_metadata_update(mu);
+		*tail = mu;
+		tail = &mu->next;
+		if (container->ss->prepare_update &&
+		    !container->ss->prepare_update(container, mu)) {
+			free_updates(&batch);
+			return false;
+		}
 	}
+	queue_metadata_update(batch);
+	return true;
+}
+
+/*
+ * Returns false if the message was dropped or rejected, it must not be
+ * acknowledged then.
+ */
+static bool handle_message(struct supertype *container, struct metadata_update *msg)
+{
+	/* queue this metadata update through to the monitor */
+
+	if (msg->len > 0 && is_update_batch(msg)) {
+		/* reply only once the monitor has written all of it */
+		bool queued = !sigterm && queue_update_batch(container, msg);
+
+		free(msg->buf);
+		msg->buf = NULL;
+		if (!queued)
+			return false;
+		drain_update_queue(container);
+		wait_monitor_pass();
+		return true;
+	}
+
+	if (msg->len <= 0)
+		drain_update_queue(container);
+
+	if (msg->len == 0) { /* ping_monitor */
+		wait_monitor_pass();
+	} else if (msg->len == -1) { /* ping_manager */
+		manage(manager_mdstat(), container);
+	} else if (!sigterm) {
+		queue_update(container, msg->buf, msg->len);
+		msg->buf = NULL;
+	}
+	return true;
 }
 
 void read_sock(struct supertype *container)
@@ -950,18 +1082,34 @@ void read_sock(struct supertype *container)
 		msg.buf = NULL;
 
 		/* read and validate the message */
-		if (receive_message(fd, &msg, tmo) == 0) {
-			handle_message(container, &msg);
-			if (msg.len == 0) {
-				/* ping reply with version */
-				msg.buf = Version;
-				msg.len = strlen(Version) + 1;
+		if (receive_message(fd, &msg, tmo) != 0) {
+			terminate = 1;
+		} else if (msg.len == MSG_LATENCY_REPORT) {
+			msg.buf = monitor_latency_report(container, &msg.len);
+			if (!msg.buf)
+				msg.len = 0;
+			if (send_message(fd, &msg, tmo) < 0)
+				terminate = 1;
+			free(msg.buf);
+		} else {
+			if (!handle_message(container, &msg)) {
+				/* hang up, the sender sees no ack */
+				terminate = 1;
+			} else if (msg.len == 0) {
+				/* ping reply with version, then capabilities */
+				char reply[256];
+				int vlen;
+
+				vlen = snprintf(reply, sizeof(reply), "%s", Version) + 1;
+				snprintf(reply + vlen, sizeof(reply) - vlen, "%s",
+					 MDMON_CAPS);
+				msg.buf = reply;
+				msg.len = vlen + strlen(MDMON_CAPS) + 1;
 				if (send_message(fd, &msg, tmo) < 0)
 					terminate = 1;
 			} else if (ack(fd, tmo) < 0)
 				terminate = 1;
-		} else
-			terminate = 1;
+		}
 
 	} while (!terminate);
 
@@ -972,13 +1120,15 @@ int exit_now = 0;
 int manager_ready = 0;
 void do_manager(struct supertype *container)
 {
-	struct mdstat_ent *mdstat;
 	sigset_t set;
 
 	sigprocmask(SIG_UNBLOCK, NULL, &set);
 	sigdelset(&set, SIGUSR1);
 	sigdelset(&set, SIGTERM);
 
+	/* only the manager calls sysfs_read() from here on */
+	sysfs_attr_cache(true);
+
 	do {
 
 		if (exit_now)
@@ -989,13 +1139,9 @@ void do_manager(struct supertype *container)
 		 * update_queue
 		 */
 		if (update_queue == NULL) {
-			mdstat = mdstat_read(1, 0);
-
-			manage(mdstat, container);
+			manage(manager_mdstat(), container);
 
 			read_sock(container);
-
-			free_mdstat(mdstat);
 		}
 		remove_old();
 
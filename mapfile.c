@@ -38,6 +38,21 @@
  *  UUID       -  uuid of the array
  *  path       -  path where device created: /dev/md/home
  *
+ * A new device is appended to the file rather than rewriting it, so
+ * adding arrays doesn't cost more the more arrays there are.  Changing or
+ * removing a device that is already listed rewrites the file as before.
+ * So each device has only one line, and the file reads the same to
+ * older mdadm and mdmon, e.g. in an initramfs.  Their map_write() puts
+ * the entries in reverse order, so duplicate lines would make the
+ * order meaningless.  Should a device still be listed twice, e.g. after
+ * two racing appends, the later line wins.  A line holding just the
+ * device id and "-" is still understood as a removal.  Once the
+ * unreadable lines outnumber the live ones, the file is compacted.
+ * That is only done while holding the map lock.
+ *
+ * In memory the entries are kept on a list as before, and the list
+ * most recently read is additionally hashed by devnm, uuid and name.
+ *
  * The best place for the mapfile is /run/mdadm/map.  Distros and users
  * which have not switched to /run yet can choose a different location
  * at compile time via MAP_DIR and MAP_FILE.
@@ -78,23 +93,36 @@ FILE *open_map(int modenum)
 	return NULL;
 }
 
+static int map_lines;	/* lines in the file when last read */
+static int map_live;	/* live entries in the file when last read */
+
+static void map_format(char *buf, int len, char *devnm, char *metadata,
+		       int uuid[4], char *path)
+{
+	snprintf(buf, len, "%s %s %08x:%08x:%08x:%08x %s\n",
+		 devnm, metadata, uuid[0], uuid[1], uuid[2], uuid[3],
+		 path ?: "");
+}
+
 int map_write(struct map_ent *mel)
 {
 	FILE *f;
 	int err;
+	int cnt = 0;
 
 	f = open_map(MAP_NEW);
 
 	if (!f)
 		return 0;
 	for (; mel; mel = mel->next) {
+		char line[PATH_MAX + 100];
+
 		if (mel->bad)
 			continue;
-		fprintf(f, "%s ", mel->devnm);
-		fprintf(f, "%s ", mel->metadata);
-		fprintf(f, "%08x:%08x:%08x:%08x ", mel->uuid[0],
-			mel->uuid[1], mel->uuid[2], mel->uuid[3]);
-		fprintf(f, "%s\n", mel->path?:"");
+		map_format(line, sizeof(line), mel->devnm, mel->metadata,
+			   mel->uuid, mel->path);
+		fputs(line, f);
+		cnt++;
 	}
 	fflush(f);
 	err = ferror(f);
@@ -103,11 +131,14 @@ int map_write(struct map_ent *mel)
 		unlink(mapname[1]);
 		return 0;
 	}
-	return rename(mapname[1],
-		      mapname[0]) == 0;
+	if (rename(mapname[1], mapname[0]) != 0)
+		return 0;
+	map_lines = map_live = cnt;
+	return 1;
 }
 
 static FILE *lf = NULL;
+static int lf_held;
 int map_lock(struct map_ent **melp)
 {
 	while (lf == NULL) {
@@ -138,17 +169,43 @@ int map_lock(struct map_ent **melp)
 
 void map_unlock(struct map_ent **melp)
 {
-	if (lf) {
+	if (lf && !lf_held) {
 		/* must unlink before closing the file,
 		 * as only the owner of the lock may
 		 * unlink the file
 		 */
 		unlink(mapname[2]);
 		fclose(lf);
+		lf = NULL;
 	}
 	if (*melp)
 		map_free(*melp);
-	lf = NULL;
+	*melp = NULL;
+}
+
+/*
+ * map_hold() takes the map lock and keeps it across any number of
+ * map_lock()/map_unlock() pairs until map_release() is called.
+ * This lets a caller handling a batch of devices pay for the lock
+ * once instead of once per device.
+ */
+int map_hold(void)
+{
+	struct map_ent *map = NULL;
+
+	if (map_lock(&map))
+		return -1;
+	map_free(map);
+	lf_held = 1;
+	return 0;
+}
+
+void map_release(void)
+{
+	struct map_ent *map = NULL;
+
+	lf_held = 0;
+	map_unlock(&map);
 }
 
 void map_fork(void)
@@ -160,6 +217,176 @@ void map_fork(void)
 		close(fileno(lf));
 		fclose(lf);
 		lf = NULL;
+		lf_held = 0;
+	}
+}
+
+/*
+ * map_append() - record a single change at the end of the map file.
+ */
+static int map_append(char *devnm, char *metadata, int uuid[4], char *path)
+{
+	char line[PATH_MAX + 100];
+	int len;
+	int fd;
+
+	fd = open(mapname[MAP_READ], O_WRONLY | O_APPEND);
+	if (!is_fd_valid(fd))
+		return 0;
+	map_format(line, sizeof(line), devnm, metadata, uuid, path);
+	len = strlen(line);
+	/* A single O_APPEND write, so readers never see a torn line
+	 * from a well behaved writer.
+	 */
+	if (write(fd, line, len) != len) {
+		close(fd);
+		return 0;
+	}
+	close(fd);
+	map_lines++;
+	return 1;
+}
+
+/*
+ * Compacting renames a new file over the old one, which would lose
+ * appends made concurrently by others, so it needs the lock.
+ */
+static int map_needs_compact(void)
+{
+	return lf && map_lines > 2 * map_live + 16;
+}
+
+/*
+ * Hash index of the most recently read list.
+ * Every entry of 'map_indexed' is on one chain of each table, except that
+ * only entries with a path in DEV_MD_DIR are hashed by name.
+ */
+#define MAP_HASH_SIZE 64
+
+enum map_idx {
+	MAP_IDX_DEVNM,
+	MAP_IDX_UUID,
+	MAP_IDX_NAME,
+};
+
+static struct map_ent *map_indexed;
+static struct map_ent *map_hash[3][MAP_HASH_SIZE];
+
+static unsigned int map_strhash(const char *s)
+{
+	unsigned int h = 5381;
+
+	while (*s)
+		h = h * 33 + (unsigned char)*s++;
+	return h % MAP_HASH_SIZE;
+}
+
+static unsigned int map_uuidhash(int uuid[4])
+{
+	return (unsigned int)(uuid[0] ^ uuid[1] ^ uuid[2] ^ uuid[3]) %
+		MAP_HASH_SIZE;
+}
+
+/* name used for lookup by map_by_name(), or NULL if there is none */
+static char *map_ent_name(struct map_ent *mp)
+{
+	if (!mp->path || strncmp(mp->path, DEV_MD_DIR, DEV_MD_DIR_LEN) != 0)
+		return NULL;
+	return mp->path + DEV_MD_DIR_LEN;
+}
+
+static struct map_ent **map_chain(struct map_ent *mp, enum map_idx idx)
+{
+	switch (idx) {
+	case MAP_IDX_DEVNM:
+		return &map_hash[idx][map_strhash(mp->devnm)];
+	case MAP_IDX_UUID:
+		return &map_hash[idx][map_uuidhash(mp->uuid)];
+	case MAP_IDX_NAME:
+		if (!map_ent_name(mp))
+			return NULL;
+		return &map_hash[idx][map_strhash(map_ent_name(mp))];
+	}
+	return NULL;
+}
+
+static void map_hash_add(struct map_ent *mp)
+{
+	enum map_idx idx;
+
+	for (idx = MAP_IDX_DEVNM; idx <= MAP_IDX_NAME; idx++) {
+		struct map_ent **chain = map_chain(mp, idx);
+
+		mp->hnext[idx] = NULL;
+		if (!chain)
+			continue;
+		mp->hnext[idx] = *chain;
+		*chain = mp;
+	}
+}
+
+static void map_hash_del(struct map_ent *mp)
+{
+	enum map_idx idx;
+
+	for (idx = MAP_IDX_DEVNM; idx <= MAP_IDX_NAME; idx++) {
+		struct map_ent **chain = map_chain(mp, idx);
+
+		for (; chain && *chain; chain = &(*chain)->hnext[idx])
+			if (*chain == mp) {
+				*chain = mp->hnext[idx];
+				break;
+			}
+	}
+}
+
+static void map_hash_clear(void)
+{
+	memset(map_hash, 0, sizeof(map_hash));
+	map_indexed = NULL;
+}
+
+/*
+ * Return the chain to search for @idx if @map is the indexed list,
+ * or the list itself linked by ->next otherwise.
+ */
+static struct map_ent *map_first(struct map_ent *map, enum map_idx idx,
+				 unsigned int hash)
+{
+	if (map && map == map_indexed)
+		return map_hash[idx][hash];
+	return map;
+}
+
+static struct map_ent *map_next(struct map_ent *map, struct map_ent *mp,
+				enum map_idx idx)
+{
+	if (map == map_indexed)
+		return mp->hnext[idx];
+	return mp->next;
+}
+
+/* remove all entries for @devnm from the list at @mapp */
+static void map_drop(struct map_ent **mapp, char *devnm)
+{
+	struct map_ent **head = mapp;
+	struct map_ent *mp;
+	int indexed = *head && *head == map_indexed;
+
+	for (mp = *mapp; mp; mp = *mapp) {
+		if (strcmp(mp->devnm, devnm) == 0) {
+			*mapp = mp->next;
+			if (indexed)
+				map_hash_del(mp);
+			free(mp->path);
+			free(mp);
+		} else
+			mapp = & mp->next;
+	}
+	if (indexed) {
+		map_indexed = *head;
+		if (!map_indexed)
+			map_hash_clear();
 	}
 }
 
@@ -167,6 +394,7 @@ void map_add(struct map_ent **melp,
 	     char * devnm, char *metadata, int uuid[4], char *path)
 {
 	struct map_ent *me = xmalloc(sizeof(*me));
+	int indexed = *melp && *melp == map_indexed;
 
 	snprintf(me->devnm, sizeof(me->devnm), "%s", devnm);
 	snprintf(me->metadata, sizeof(me->metadata), "%s", metadata);
@@ -175,6 +403,27 @@ void map_add(struct map_ent **melp,
 	me->next = *melp;
 	me->bad = 0;
 	*melp = me;
+	if (indexed) {
+		map_hash_add(me);
+		map_indexed = me;
+	}
+}
+
+/*
+ * Unhash the entry for @devnm in the list being read, and clear its
+ * devnm so that map_read() frees it once the whole file is read.
+ */
+static void map_read_drop(struct map_ent *map, char *devnm)
+{
+	struct map_ent *mp;
+
+	mp = map_first(map, MAP_IDX_DEVNM, map_strhash(devnm));
+	for (; mp; mp = map_next(map, mp, MAP_IDX_DEVNM))
+		if (strcmp(mp->devnm, devnm) == 0) {
+			map_hash_del(mp);
+			mp->devnm[0] = '\0';
+			return;
+		}
 }
 
 void map_read(struct map_ent **melp)
@@ -185,6 +434,8 @@ void map_read(struct map_ent **melp)
 	int uuid[4];
 	char devnm[32];
 	char metadata[30];
+	struct map_ent *mp, **mpp;
+	int lines = 0;
 
 	*melp = NULL;
 
@@ -196,19 +447,60 @@ void map_read(struct map_ent **melp)
 	if (!f)
 		return;
 
+	map_hash_clear();
 	while (fgets(buf, sizeof(buf), f)) {
+		int n;
+
+		/* ignore a line that is still being appended */
+		if (!strchr(buf, '\n'))
+			break;
+		lines++;
 		path[0] = 0;
-		if (sscanf(buf, " %s %s %x:%x:%x:%x %200s",
+		n = sscanf(buf, " %31s %29s %x:%x:%x:%x %200s",
 			   devnm, metadata, uuid, uuid+1,
-			   uuid+2, uuid+3, path) >= 7) {
-			map_add(melp, devnm, metadata, uuid, path);
+			   uuid+2, uuid+3, path);
+		if (n == 2 && strcmp(metadata, "-") == 0) {
+			map_read_drop(*melp, devnm);
+			continue;
+		}
+		if (n < 7 || !devnm[0])
+			continue;
+		/* a later line for the same device supersedes earlier ones */
+		map_read_drop(*melp, devnm);
+		map_add(melp, devnm, metadata, uuid, path);
+		if (!map_indexed) {
+			/* first entry, start indexing this list */
+			map_hash_add(*melp);
+			map_indexed = *melp;
 		}
 	}
 	fclose(f);
+
+	/* free superseded and removed entries, all of them unhashed */
+	for (mpp = melp; *mpp; ) {
+		mp = *mpp;
+		if (mp->devnm[0]) {
+			mpp = &mp->next;
+			continue;
+		}
+		*mpp = mp->next;
+		free(mp->path);
+		free(mp);
+	}
+	map_indexed = *melp;
+	if (!map_indexed)
+		map_hash_clear();
+
+	map_lines = lines;
+	map_live = 0;
+	for (mp = *melp; mp; mp = mp->next)
+		map_live++;
 }
 
 void map_free(struct map_ent *map)
 {
+	if (map && map == map_indexed)
+		map_hash_clear();
 	while (map) {
 		struct map_ent *mp = map;
 		map = mp->next;
@@ -228,39 +520,44 @@ int map_update(struct map_ent **mpp, char *devnm, char *metadata,
 	else
 		map_read(&map);
 
-	for (mp = map ; mp ; mp=mp->next)
+	mp = map_first(map, MAP_IDX_DEVNM, map_strhash(devnm));
+	for (; mp; mp = map_next(map, mp, MAP_IDX_DEVNM))
 		if (strcmp(mp->devnm, devnm) == 0) {
+			int indexed = map == map_indexed;
+
+			if (indexed)
+				map_hash_del(mp);
 			snprintf(mp->metadata, sizeof(mp->metadata), "%s", metadata);
 			memcpy(mp->uuid, uuid, 16);
 			free(mp->path);
 			mp->path = path ? xstrdup(path) : NULL;
 			mp->bad = 0;
+			if (indexed)
+				map_hash_add(mp);
 			break;
 		}
-	if (!mp)
+	if (!mp) {
 		map_add(&map, devnm, metadata, uuid, path);
+		map_live++;
+	}
 	if (mpp)
 		*mpp = NULL;
-	rv = map_write(map);
+	/* only a device not listed yet can be appended, see above */
+	if (mp || map_needs_compact() ||
+	    !map_append(devnm, metadata, uuid, path))
+		rv = map_write(map);
+	else
+		rv = 1;
 	map_free(map);
 	return rv;
 }
 
 void map_delete(struct map_ent **mapp, char *devnm)
 {
-	struct map_ent *mp;
-
 	if (*mapp == NULL)
 		map_read(mapp);
 
-	for (mp = *mapp; mp; mp = *mapp) {
-		if (strcmp(mp->devnm, devnm) == 0) {
-			*mapp = mp->next;
-			free(mp->path);
-			free(mp);
-		} else
-			mapp = & mp->next;
-	}
+	map_drop(mapp, devnm);
 }
 
 void map_remove(struct map_ent **mapp, char *devnm)
@@ -280,7 +577,8 @@ struct map_ent *map_by_uuid(struct map_ent **map, int uuid[4])
 	if (!*map)
 		map_read(map);
 
-	for (mp = *map ; mp ; mp = mp->next) {
+	mp = map_first(*map, MAP_IDX_UUID, map_uuidhash(uuid));
+	for (; mp; mp = map_next(*map, mp, MAP_IDX_UUID)) {
 		if (memcmp(uuid, mp->uuid, 16) != 0)
 			continue;
 		if (!mddev_busy(mp->devnm)) {
@@ -302,7 +600,8 @@ struct map_ent *map_by_devnm(struct map_ent **map, char *devnm)
 	if (!*map)
 		map_read(map);
 
-	for (mp = *map ; mp ; mp = mp->next) {
+	mp = map_first(*map, MAP_IDX_DEVNM, map_strhash(devnm));
+	for (; mp; mp = map_next(*map, mp, MAP_IDX_DEVNM)) {
 		if (strcmp(mp->devnm, devnm) != 0)
 			continue;
 		if (!mddev_busy(mp->devnm)) {
@@ -320,12 +619,11 @@ struct map_ent *map_by_name(struct map_ent **map, char *name)
 	if (!*map)
 		map_read(map);
 
-	for (mp = *map ; mp ; mp = mp->next) {
-		if (!mp->path)
-			continue;
-		if (strncmp(mp->path, DEV_MD_DIR, DEV_MD_DIR_LEN) != 0)
+	mp = map_first(*map, MAP_IDX_NAME, map_strhash(name));
+	for (; mp; mp = map_next(*map, mp, MAP_IDX_NAME)) {
+		if (!map_ent_name(mp))
 			continue;
-		if (strcmp(mp->path + DEV_MD_DIR_LEN, name) != 0)
+		if (strcmp(map_ent_name(mp), name) != 0)
 			continue;
 		if (!mddev_busy(mp->devnm)) {
 			mp->bad = 1;
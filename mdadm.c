@@ -169,6 +169,7 @@ int main(int argc, char *argv[])
 	char *shortopt = short_opts;
 	int dosyslog = 0;
 	int rebuild_map = 0;
+	int incr_serve = 0;
 	char *remove_path = NULL;
 	char *udev_filename = NULL;
 	char *dump_directory = NULL;
@@ -227,6 +228,11 @@ int main(int argc, char *argv[])
 		case 'Y': c.export++;
 			continue;
 
+		case JsonOpt:
+			c.export = 1;
+			c.json = 1;
+			continue;
+
 		case HomeHost:
 			if (is_devname_ignore(optarg) == true)
 				c.require_homehost = 0;
@@ -312,6 +318,7 @@ int main(int argc, char *argv[])
 		case 'X':
 		case 'Q':
 		case ExamineBB:
+		case EstimateRecoveryOpt:
 		case Dump:
 		case Restore:
 		case Action:
@@ -1036,6 +1043,7 @@ int main(int argc, char *argv[])
 		case O(MISC,'S'):
 		case O(MISC,'X'):
 		case O(MISC, ExamineBB):
+		case O(MISC, EstimateRecoveryOpt):
 		case O(MISC,'o'):
 		case O(MISC,'w'):
 		case O(MISC,'W'):
@@ -1196,6 +1204,9 @@ int main(int argc, char *argv[])
 		case O(INCREMENTAL, IncrementalPath):
 			remove_path = optarg;
 			continue;
+		case O(INCREMENTAL, IncrementalServe):
+			incr_serve = 1;
+			continue;
 		case O(CREATE, WriteJournal):
 			if (s.journaldisks) {
 				pr_err("Please specify only one journal device for the array.\n");
@@ -1325,6 +1336,19 @@ int main(int argc, char *argv[])
 		exit(2);
 	}
 
+	if (c.json) {
+		struct mddev_dev *dv;
+		bool detail = mode == MISC && devmode == 'D';
+
+		for (dv = devlist; dv; dv = dv->next)
+			if (dv->disposition != 'D')
+				detail = false;
+		if (!detail) {
+			pr_err("--json can only be used with --detail\n");
+			exit(2);
+		}
+	}
+
 	/* Ok, got the option parsing out of the way
 	 * hopefully it's mostly right but there might be some stuff
 	 * missing
@@ -1399,6 +1423,7 @@ int main(int argc, char *argv[])
 	rv = 0;
 
 	set_hooks(); /* set hooks from libs */
+	sysfs_set_verbose(c.verbose);
 
 	if (c.homecluster == NULL && (c.nodes > 0)) {
 		c.homecluster = conf_get_homecluster();
@@ -1448,6 +1473,15 @@ int main(int argc, char *argv[])
 		}
 	}
 
+	/* long running modes see disks come and go */
+	if (mode != MONITOR && !incr_serve)
+		ddf_search_cache(true);
+
+	/* read-only commands leave the probe hints file alone */
+	if (mode == ASSEMBLE || mode == INCREMENTAL || mode == MANAGE ||
+	    mode == GROW)
+		probe_hint_allow_save();
+
 	switch(mode) {
 	case MANAGE:
 		/* readonly, add/remove, readwrite, runstop */
@@ -1706,6 +1740,15 @@ int main(int argc, char *argv[])
 			pr_err("no changes to --grow\n");
 		break;
 	case INCREMENTAL:
+		if (incr_serve) {
+			if (devlist || c.scan || rebuild_map) {
+				pr_err("--serve cannot be combined with devices, --scan or --rebuild-map.\n");
+				rv = 1;
+				break;
+			}
+			rv = Incremental_serve(&c);
+			break;
+		}
 		if (rebuild_map) {
 			RebuildMap();
 		}
@@ -1732,14 +1775,24 @@ int main(int argc, char *argv[])
 			}
 			break;
 		}
-		if (devmode == 'f') {
-			if (devlist->next) {
-				pr_err("'--incremental --fail' can only handle one device.\n");
-				rv = 1;
+		if (devmode == 'f' && devlist->next) {
+			pr_err("'--incremental --fail' can only handle one device.\n");
+			rv = 1;
+			break;
+		}
+		/* Hand the device to a running --serve instance if there
+		 * is one and it would use the same config and metadata.
+		 */
+		if (!configfile && !ss) {
+			rv = Incremental_client(devlist, &c,
+						devmode == 'f' ? 'f' : 'a',
+						remove_path);
+			if (rv >= 0)
 				break;
-			}
+		}
+		if (devmode == 'f')
 			rv = Incremental_remove(devlist->devname, remove_path, c.verbose);
-		} else
+		else
 			rv = Incremental(devlist, &c, ss);
 		break;
 	case AUTODETECT:
@@ -1846,7 +1899,9 @@ static int misc_scan(char devmode, struct context *c)
 	struct mdstat_ent *ms = mdstat_read(0, 1);
 	struct mdstat_ent *e;
 	struct map_ent *map = NULL;
+	char **names = NULL;
 	int members;
+	int cnt = 0;
 	int rv = 0;
 
 	for (members = 0; members <= 1; members++) {
@@ -1870,9 +1925,12 @@ static int misc_scan(char devmode, struct context *c)
 					e->devnm);
 				continue;
 			}
-			if (devmode == 'D')
-				rv |= Detail(name, c);
-			else
+			if (devmode == 'D') {
+				/* collected and done together below */
+				names = xrealloc(names,
+						 sizeof(*names) * (cnt + 1));
+				names[cnt++] = xstrdup(name);
+			} else
 				rv |= WaitClean(name, c->verbose);
 			put_md_name(name);
 			map_free(map);
@@ -1880,6 +1938,11 @@ static int misc_scan(char devmode, struct context *c)
 		}
 	}
 	free_mdstat(ms);
+	if (cnt)
+		rv |= Detail_list(names, cnt, c);
+	while (cnt)
+		free(names[--cnt]);
+	free(names);
 	return rv;
 }
 
@@ -1937,30 +2000,50 @@ static int misc_list(struct mddev_dev *devlist,
 		int mdfd = -1;
 
 		switch(dv->disposition) {
-		case 'D':
-			rv |= Detail(dv->devname, c);
+		case 'D': {
+			/* arrays listed together are examined together */
+			char **devs = NULL;
+			int cnt = 0;
+
+			while (1) {
+				devs = xrealloc(devs, sizeof(*devs) * (cnt + 1));
+				devs[cnt++] = dv->devname;
+				if (!dv->next || dv->next->disposition != 'D')
+					break;
+				dv = dv->next;
+			}
+			rv |= Detail_list(devs, cnt, c);
+			free(devs);
 			continue;
-		case KillOpt: /* Zero superblock */
-			if (ss)
-				rv |= Kill(dv->devname, ss, c->force, c->verbose,0);
-			else {
-				int v = c->verbose;
-				do {
-					rv |= Kill(dv->devname, NULL, c->force, v, 0);
-					v = -1;
-				} while (rv == 0);
-				rv &= ~4;
+		}
+		case KillOpt: { /* Zero superblock */
+			/* wipe all devices listed together at once */
+			char **devs = NULL;
+			int cnt = 0;
+
+			while (1) {
+				devs = xrealloc(devs, sizeof(*devs) * (cnt + 1));
+				devs[cnt++] = dv->devname;
+				if (!dv->next || dv->next->disposition != KillOpt)
+					break;
+				dv = dv->next;
 			}
+			rv |= Kill_devices(devs, cnt, ss, c->force, c->verbose);
+			free(devs);
 			continue;
+		}
 		case 'Q':
 			rv |= Query(dv->devname);
 			continue;
 		case 'X':
-			rv |= ExamineBitmap(dv->devname, c->brief, ss);
+			rv |= ExamineBitmap(dv->devname, c->brief, c->verbose, ss);
 			continue;
 		case ExamineBB:
 			rv |= ExamineBadblocks(dv->devname, c->brief, ss);
 			continue;
+		case EstimateRecoveryOpt:
+			rv |= EstimateRecovery(dv->devname, c->verbose, ss);
+			continue;
 		case 'W':
 		case WaitOpt:
 			rv |= Wait(dv->devname);
@@ -89,6 +89,9 @@ struct dlm_lksb {
 #ifndef BLKGETSIZE64
 #define BLKGETSIZE64 _IOR(0x12,114,size_t) /* return device size in bytes (u64 *arg) */
 #endif
+#ifndef BLKZEROOUT
+#define BLKZEROOUT _IO(0x12,127) /* zero a byte range (u64 start, u64 len) */
+#endif
 
 #define DEFAULT_CHUNK 512
 #define DEFAULT_BITMAP_CHUNK 4096
@@ -129,6 +132,25 @@ struct dlm_lksb {
 #ifndef MAP_FILE
 #define MAP_FILE "map"
 #endif /* MAP_FILE */
+/* INCREMENTAL_SOCK is where "mdadm --incremental --serve" listens for
+ * devices handed over by "mdadm --incremental".
+ */
+#ifndef INCREMENTAL_SOCK
+#define INCREMENTAL_SOCK MAP_DIR "/incremental.sock"
+#endif /* INCREMENTAL_SOCK */
+/* PROBE_HINTS_FILE is the default place to keep superblock probe hints
+ * when enabled with "PROBING hints".  They are meant to speed up the
+ * next boot, so this must survive a reboot, unlike MAP_DIR.
+ */
+#ifndef PROBE_HINTS_FILE
+#define PROBE_HINTS_FILE "/var/lib/mdadm/probe-hints"
+#endif /* PROBE_HINTS_FILE */
+/* METRICS_SOCK is where "mdadm --monitor" serves array metrics
+ * when enabled with "METRICS socket".
+ */
+#ifndef METRICS_SOCK
+#define METRICS_SOCK MAP_DIR "/metrics.sock"
+#endif /* METRICS_SOCK */
 /* MDMON_DIR is where pid and socket files used for communicating
  * with mdmon normally live.  Best is /var/run/mdadm as
  * mdmon is needed at early boot then it needs to write there prior
@@ -453,6 +475,7 @@ enum special_options {
 	KillSubarray,
 	UpdateSubarray,
 	IncrementalPath,
+	IncrementalServe,
 	NoSharing,
 	HelpOptions,
 	Brief,
@@ -488,8 +511,10 @@ enum special_options {
 	OffRootOpt,
 	Prefer,
 	KillOpt,
+	JsonOpt,
 	DataOffset,
 	ExamineBB,
+	EstimateRecoveryOpt,
 	Dump,
 	Restore,
 	Action,
@@ -629,6 +654,7 @@ struct context {
 	int	require_homehost;
 	char	*prefer;
 	int	export;
+	int	json;
 	int	test;
 	char	*subarray;
 	enum	update_opt update;
@@ -691,6 +717,7 @@ struct map_ent {
 	int	uuid[4];
 	int	bad;
 	char	*path;
+	struct map_ent *hnext[3]; /* hash chains, see mapfile.c */
 };
 extern int map_update(struct map_ent **mpp, char *devnm, char *metadata,
 		      int uuid[4], char *path);
@@ -707,6 +734,8 @@ extern void map_add(struct map_ent **melp,
 extern int map_lock(struct map_ent **melp);
 extern void map_unlock(struct map_ent **melp);
 extern void map_fork(void);
+extern int map_hold(void);
+extern void map_release(void);
 
 /* various details can be requested */
 enum sysfs_read_flags {
@@ -765,8 +794,29 @@ extern void sysfs_init_dev(struct mdinfo *mdi, dev_t devid);
 extern void sysfs_free(struct mdinfo *sra);
 
 extern struct mdinfo *sysfs_read(int fd, char *devnm, unsigned long options);
+extern int sysfs_read_member(struct mdinfo *sra, struct mdinfo *dev,
+			     unsigned long options);
+extern void sysfs_attr_cache(bool enable);
 extern int sysfs_attr_match(const char *attr, const char *str);
 extern int sysfs_match_word(const char *word, char **list);
+/* see sysfs_txn_begin() */
+struct sysfs_txn {
+	struct mdinfo *sra;
+	int md_fd;
+	int dev_fd;
+	char dev_name[32];
+	int writes;
+	struct timespec start;
+};
+extern void sysfs_set_verbose(int verbose);
+extern void sysfs_txn_begin(struct sysfs_txn *txn, struct mdinfo *sra);
+extern int sysfs_txn_set_str(struct sysfs_txn *txn, struct mdinfo *dev,
+			     char *name, char *val);
+extern int sysfs_txn_set_num(struct sysfs_txn *txn, struct mdinfo *dev,
+			     char *name, unsigned long long val);
+extern void sysfs_txn_end(struct sysfs_txn *txn);
+extern int sysfs_add_disk_txn(struct sysfs_txn *txn, struct mdinfo *sd,
+			      int resume);
 extern int sysfs_set_str(struct mdinfo *sra, struct mdinfo *dev,
 			 char *name, char *val);
 extern int sysfs_set_num(struct mdinfo *sra, struct mdinfo *dev,
@@ -787,6 +837,8 @@ extern int sysfs_attribute_available(struct mdinfo *sra, struct mdinfo *dev,
 				     char *name);
 extern int sysfs_get_str(struct mdinfo *sra, struct mdinfo *dev,
 			 char *name, char *val, int size);
+extern int sysfs_get_str_cached(struct mdinfo *sra, struct mdinfo *dev,
+				char *name, char *val, int size);
 extern int sysfs_set_safemode(struct mdinfo *sra, unsigned long ms);
 extern int sysfs_set_array(struct mdinfo *info);
 extern int sysfs_add_disk(struct mdinfo *sra, struct mdinfo *sd, int resume);
@@ -796,6 +848,28 @@ extern int sysfs_freeze_array(struct mdinfo *sra);
 extern int sysfs_wait(int fd, int *msec);
 extern int load_sys(char *path, char *buf, int len);
 extern int zero_disk_range(int fd, unsigned long long sector, size_t count);
+#define CHILD_POOL_MAX 16
+typedef void (*child_done_fn)(void *data, int status);
+struct child_pool {
+	int max;
+	int running;
+	int failed;
+	unsigned long seq;
+	child_done_fn done;
+	struct {
+		pid_t pid;
+		unsigned long seq;	/* order of forking */
+		void *data;
+	} slots[CHILD_POOL_MAX];
+};
+extern void child_pool_init(struct child_pool *cp, int max, child_done_fn done);
+extern pid_t child_pool_fork(struct child_pool *cp, void *data);
+extern int child_pool_reap(struct child_pool *cp, bool block);
+extern int child_pool_wait(struct child_pool *cp);
+extern void child_store_status(void *data, int status);
+extern void member_write_done(void *data, int status);
+extern int zero_disk_ranges(int *fds, int cnt, unsigned long long sector,
+			    size_t count);
 extern int reshape_prepare_fdlist(char *devname,
 				  struct mdinfo *sra,
 				  int raid_disks,
@@ -845,6 +919,7 @@ extern mapping_t r0layout[], r5layout[], r6layout[],
 	pers[], modes[], faultylayout[];
 extern mapping_t consistency_policies[], sysfs_array_states[], update_options[];
 
+extern void map_dev_load(void);
 extern char *map_dev_preferred(int major, int minor, int create,
 			       char *prefer);
 static inline char *map_dev(int major, int minor, int create)
@@ -1142,6 +1217,11 @@ extern struct superswitch {
 	 * writes it out.
 	 */
 	int (*write_bitmap)(struct supertype *st, int fd, enum bitmap_update update);
+	/* Zero the areas kept next to the loaded superblock, such as the
+	 * bitmap, bad block log and PPL.  Used before the superblock
+	 * itself is erased.
+	 */
+	int (*clear_areas)(struct supertype *st, int fd);
 	/* Free the superblock and any other allocated data */
 	void (*free_super)(struct supertype *st);
 
@@ -1359,10 +1439,32 @@ struct supertype {
 extern struct supertype *super_by_fd(int fd, char **subarray);
 enum guess_types { guess_any, guess_array, guess_partitions };
 extern struct supertype *guess_super_type(int fd, enum guess_types guess_type);
+extern struct supertype *probe_hint_load(int fd, enum guess_types guess_type);
+extern void probe_hint_allow_save(void);
+extern void probe_hint_save(int fd, struct supertype *st);
+extern void probe_hint_forget(int fd);
 static inline struct supertype *guess_super(int fd) {
 	return guess_super_type(fd, guess_any);
 }
 extern struct supertype *dup_super(struct supertype *st);
+
+/**
+ * struct write_req - one write for write_batch().
+ * @fd: device to write to.
+ * @buf: data, aligned as @fd requires.
+ * @len: bytes to write.
+ * @offset: byte offset on @fd.
+ * @err: set to 0 on success or to an errno value.
+ */
+struct write_req {
+	int fd;
+	const void *buf;
+	size_t len;
+	off_t offset;
+	int err;
+};
+extern int write_batch(struct write_req *reqs, int cnt);
+
 extern int get_dev_size(int fd, char *dname, unsigned long long *sizep);
 extern int get_dev_sector_size(int fd, char *dname, unsigned int *sectsizep);
 extern int must_be_container(int fd);
@@ -1403,6 +1505,7 @@ extern char type_part[], type_disk[];
 extern void policyline(char *line, char *type);
 extern void policy_add(char *type, ...);
 extern void policy_free(void);
+extern void policy_paths_invalidate(void);
 
 extern struct dev_policy *path_policy(char **paths, char *type);
 extern struct dev_policy *disk_policy(struct mdinfo *disk);
@@ -1502,6 +1605,7 @@ extern int Create(struct supertype *st, struct mddev_ident *ident, int subdevs,
 		  struct mddev_dev *devlist, struct shape *s, struct context *c);
 
 extern int Detail(char *dev, struct context *c);
+extern int Detail_list(char **devs, int cnt, struct context *c);
 extern int Detail_Platform(struct superswitch *ss, int scan, int verbose, int export, char *controller_path);
 extern int Query(char *dev);
 extern int ExamineBadblocks(char *devname, int brief, struct supertype *forcest);
@@ -1515,6 +1619,8 @@ extern int Monitor(struct mddev_dev *devlist,
 		   int share);
 
 extern int Kill(char *dev, struct supertype *st, int force, int verbose, int noexcl);
+extern int Kill_devices(char **devs, int cnt, struct supertype *st,
+			int force, int verbose);
 extern int Kill_subarray(char *dev, char *subarray, int verbose);
 extern int Update_subarray(char *dev, char *subarray, enum update_opt update, struct mddev_ident *ident, int quiet);
 extern int Wait(char *dev);
@@ -1526,13 +1632,18 @@ extern int Incremental(struct mddev_dev *devlist, struct context *c,
 extern void RebuildMap(void);
 extern int IncrementalScan(struct context *c, char *devnm);
 extern int Incremental_remove(char *devname, char *path, int verbose);
+extern int Incremental_client(struct mddev_dev *devlist, struct context *c,
+			      int op, char *path);
+extern int Incremental_serve(struct context *c);
 extern int CreateBitmap(char *filename, int force, char uuid[16],
 			unsigned long chunksize, unsigned long daemon_sleep,
 			unsigned long write_behind,
 			unsigned long long array_size,
 			int major);
-extern int ExamineBitmap(char *filename, int brief, struct supertype *st);
+extern int ExamineBitmap(char *filename, int brief, int verbose,
+			 struct supertype *st);
 extern int IsBitmapDirty(char *filename);
+extern int EstimateRecovery(char *devname, int verbose, struct supertype *st);
 extern int Write_rules(char *rule_name);
 extern int bitmap_update_uuid(int fd, int *uuid, int swap);
 
@@ -1610,6 +1721,11 @@ extern char *conf_get_homecluster(void);
 extern int conf_get_monitor_delay(void);
 extern bool conf_get_sata_opal_encryption_no_verify(void);
 extern bool conf_get_probing_ddf_extended(void);
+extern void ddf_search_cache(bool on);
+extern char *conf_get_probing_hints(void);
+extern char *conf_get_metrics_socket(void);
+extern char *conf_get_metrics_textfile(void);
+extern void conf_get_safemode_bounds(unsigned long *min, unsigned long *max);
 extern bool conf_get_imsm_disable_orom(void);
 extern char *conf_line(FILE *file);
 extern char *conf_word(FILE *file, int allow_key);
@@ -1637,6 +1753,10 @@ extern void copy_uuid(void *a, int b[4], int swapuuid);
 extern char *__fname_from_uuid(int id[4], int swap, char *buf, char sep);
 extern char *fname_from_uuid(struct mdinfo *info, char *buf);
 extern unsigned long calc_csum(void *super, int bytes);
+extern __u32 csum_crc32c(__u32 crc, const void *buf, size_t len);
+extern __u32 csum_crc32(__u32 crc, const void *buf, size_t len);
+extern __u64 csum_sum32(const void *buf, size_t len);
+extern __u64 csum_sum32_le(const void *buf, size_t len);
 extern int enough(int level, int raid_disks, int layout, int clean,
 		   char *avail);
 extern int ask(char *mesg);
@@ -293,6 +293,7 @@ void usage(void)
 "  --all         -a   : All devices\n"
 "  --foreground  -F   : Run in foreground (do not fork)\n"
 "  --takeover    -t   : Takeover container\n"
+"  --latency     -L   : Report write_pending latency of a running mdmon\n"
 );
 	exit(2);
 }
@@ -308,6 +309,19 @@ static bool is_duplicate_opt(const int opt, const int set_val, const char *long_
 
 static int mdmon(char *devnm, int must_fork, int takeover);
 
+static int show_latency(char *devnm)
+{
+	char *report = mdmon_latency_report(devnm);
+
+	if (!report) {
+		pr_err("cannot get latency report from mdmon for %s\n", devnm);
+		return 1;
+	}
+	fputs(report, stdout);
+	free(report);
+	return 0;
+}
+
 int main(int argc, char *argv[])
 {
 	char *container_name = NULL;
@@ -318,12 +332,14 @@ int main(int argc, char *argv[])
 	int dofork = 1;
 	int mdfd = -1;
 	bool help = false;
+	bool latency = false;
 	static struct option options[] = {
 		{"all", 0, NULL, 'a'},
 		{"takeover", 0, NULL, 't'},
 		{"help", 0, NULL, 'h'},
 		{"offroot", 0, NULL, OffRootOpt},
 		{"foreground", 0, NULL, 'F'},
+		{"latency", 0, NULL, 'L'},
 		{NULL, 0, NULL, 0}
 	};
 
@@ -333,7 +349,7 @@ int main(int argc, char *argv[])
 	 */
 	imsm_set_no_platform(1);
 
-	while ((opt = getopt_long(argc, argv, "thaF", options, NULL)) != -1) {
+	while ((opt = getopt_long(argc, argv, "thaFL", options, NULL)) != -1) {
 		switch (opt) {
 		case 'a':
 			if (is_duplicate_opt(all, 1, "all"))
@@ -356,6 +372,11 @@ int main(int argc, char *argv[])
 				exit(1);
 			argv[0][0] = '@';
 			break;
+		case 'L':
+			if (is_duplicate_opt(latency, true, "latency"))
+				exit(1);
+			latency = true;
+			break;
 		case 'h':
 			if (is_duplicate_opt(help, true, "help"))
 				exit(1);
@@ -393,7 +414,7 @@ int main(int argc, char *argv[])
 	if (strcmp(container_name, "/proc/mdstat") == 0)
 		all = 1;
 
-	if (help)
+	if (help || (latency && all))
 		usage();
 
 	if (all) {
@@ -425,6 +446,8 @@ int main(int argc, char *argv[])
 
 		close(mdfd);
 
+		if (devnm && latency)
+			return show_latency(devnm);
 		if (devnm)
 			return mdmon(devnm, dofork && do_fork(), takeover);
 	}
@@ -573,6 +596,11 @@ static int mdmon(char *devnm, int must_fork, int takeover)
 
 	mlockall(MCL_CURRENT | MCL_FUTURE);
 
+	if (monitor_init_events() < 0) {
+		pr_err("failed to set up event monitoring: %s\n",
+			strerror(errno));
+		exit(2);
+	}
 	if (clone_monitor(container) < 0) {
 		pr_err("failed to start monitor process: %s\n",
 			strerror(errno));
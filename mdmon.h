@@ -25,6 +25,36 @@ enum array_state { clear, inactive, suspended, readonly, read_auto,
 
 enum sync_action { idle, reshape, resync, recover, check, repair, bad_action };
 
+/* Steps of handling write_pending: from the monitor waking up to seeing
+ * the state, writing the metadata, and writing 'active' back.
+ */
+enum wp_phase { WP_DISPATCH, WP_METADATA, WP_ACK, WP_TOTAL, WP_PHASES };
+
+/* bucket i counts totals below 16us << i, the last one everything else */
+#define WP_HIST_BUCKETS 20
+
+/* write_pending latencies in microseconds.  Written by the monitor,
+ * read without locking by the manager to answer queries.
+ */
+struct wp_latency {
+	unsigned long long events, slow;
+	unsigned long long sum[WP_PHASES], max[WP_PHASES];
+	unsigned long long hist[WP_HIST_BUCKETS];
+};
+
+/* What the monitor decided for an array, carried out only once the
+ * container metadata covering it has been written.
+ */
+struct array_decision {
+	bool pending;
+	bool dirty;
+	bool deactivate;
+	bool check_degraded;
+	bool check_reshape;
+	bool write_pending;
+	struct timespec write_pending_seen;
+};
+
 struct active_array {
 	struct mdinfo info;
 	struct supertype *container;
@@ -56,6 +86,14 @@ struct active_array {
 	 * Monitor must acknowledge faulty state first.
 	 */
 	bool check_member_remove : 1;
+
+	struct wp_latency wp_latency;
+	struct array_decision decision;
+
+	/* safe_mode_delay adapts between these (ms) if max is set */
+	unsigned long safe_mode_min, safe_mode_max;
+	unsigned long long safe_mode_changes;
+	struct timespec clean_since; /* when mdmon last marked it clean */
 };
 
 /*
@@ -80,6 +118,9 @@ extern struct md_generic_cmd *active_cmd;
 
 void remove_pidfile(char *devname);
 void do_monitor(struct supertype *container);
+int monitor_init_events(void);
+void monitor_watch_fd(int fd);
+char *monitor_latency_report(struct supertype *container, int *len);
 void do_manager(struct supertype *container);
 extern volatile sig_atomic_t sigterm;
 
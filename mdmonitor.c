@@ -24,10 +24,13 @@
 
 #include	"mdadm.h"
 #include	"mdstat.h"
+#include	"metrics.h"
 #include	"udev.h"
 #include	"xmalloc.h"
 
 #include	<sys/wait.h>
+#include	<sys/socket.h>
+#include	<sys/un.h>
 #include	<limits.h>
 #include	<syslog.h>
 
@@ -35,6 +38,13 @@
 #define EVENT_NAME_MAX 32
 #define AUTOREBUILD_PID_PATH MDMON_DIR "/autorebuild.pid"
 #define FALLBACK_DELAY 5
+#define MAX_PENDING_CHANGES 64
+#define ALERT_MAX_CHILDREN 4
+#define ALERT_MAX_MAIL_CHILDREN 2
+#define ALERT_MAIL_WINDOW 10
+#ifndef _PATH_LOG
+#define _PATH_LOG "/dev/log"
+#endif
 
 /**
  * struct state - external array or container properties.
@@ -44,6 +54,11 @@
  * @subarray: for a container it is a link to first subarray, for a subarray it is a link to next
  *	      subarray in the same container
  * @parent: for a subarray it is a link to its container
+ * @members: member devices and their state, sorted by device number
+ * @nmembers: number of entries in @members
+ * @mdstat_sig: signature of the mdstat entry seen by the last check
+ * @changed: a udev event was seen for the array or one of its members
+ * @metrics: state of the array as last seen, for export
  */
 struct state {
 	char devname[MD_NAME_MAX + sizeof(DEV_MD_DIR)];
@@ -55,9 +70,15 @@ struct state {
 	int from_config;
 	int from_auto;
 	int expected_spares;
-	int devstate[MAX_DISKS];
-	dev_t devid[MAX_DISKS];
+	struct member_state {
+		dev_t devid;
+		int state;
+	} *members;
+	int nmembers;
 	int percent;
+	unsigned int mdstat_sig;
+	bool changed;
+	struct metrics_array *metrics;
 	char parent_devnm[MD_NAME_MAX];
 	struct supertype *metadata;
 	struct state *subarray;
@@ -108,6 +129,17 @@ mapping_t events_map[] = {
 	{NULL, EVENT_UNKNOWN}
 };
 
+/*
+ * Devices named by udev events since the last pass over the arrays.
+ * If too many arrive, or the wait timed out, everything is checked.
+ */
+static struct {
+	int cnt;
+	bool full_sweep;
+	dev_t devid[MAX_PENDING_CHANGES];
+	char devnm[MAX_PENDING_CHANGES][MD_NAME_MAX];
+} pending;
+
 struct event_data {
 	enum event event_enum;
 	/*
@@ -129,8 +161,14 @@ static int check_one_sharer(int scan);
 static void link_containers_with_subarrays(struct state *list);
 static int make_daemon(char *pidfile);
 static void try_spare_migration(struct state *statelist);
+static bool array_flagged(struct state *st);
+static bool array_needs_check(struct state *st, struct mdstat_ent *mdstat);
+static void note_pending_changes(struct state *statelist);
+static void publish_metrics(struct state *statelist);
 static void wait_for_events(int *delay_for_event, int c_delay);
-static void wait_for_events_mdstat(int *delay_for_event, int c_delay);
+static void wait_for_events_mdstat(int *delay_for_event, int c_delay, int seconds);
+static void alert_dispatch(bool flush);
+static int alert_wait_limit(int seconds);
 static int write_autorebuild_pid(void);
 
 int Monitor(struct mddev_dev *devlist,
@@ -185,9 +223,11 @@ int Monitor(struct mddev_dev *devlist,
 	struct state *statelist = NULL;
 	int finished = 0;
 	struct mdstat_ent *mdstat = NULL;
+	struct mdstat_scan mdstat_snap = {0};
 	char *mailfrom;
 	struct mddev_ident *mdlist;
 	int delay_for_event = c->delay;
+	struct timespec last_sweep = {0, 0};
 
 	if (devlist && c->scan) {
 		pr_err("Devices list and --scan option cannot be combined - not monitoring.\n");
@@ -297,19 +337,54 @@ int Monitor(struct mddev_dev *devlist,
 		}
 	}
 
+	/* the same attributes are read every round, keep them open */
+	if (!oneshot)
+		sysfs_attr_cache(true);
+
+	pending.full_sweep = true;
 	while (!finished) {
 		int new_found = 0;
 		struct state *st, **stp;
 		int anydegraded = 0;
 		int anyredundant = 0;
+		struct timespec now;
+		bool quiet;
+		int changes;
 
 		if (mdstat)
 			free_mdstat(mdstat);
-		mdstat = mdstat_read(oneshot ? 0 : 1, 0);
+		mdstat = NULL;
+		changes = mdstat_scan(&mdstat_snap, oneshot ? 0 : 1);
+
+		/* Arrays are normally only checked when mdstat or a udev
+		 * event says something changed.  Still look at all of them
+		 * every 'delay' seconds in case anything was missed.
+		 */
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		if (now.tv_sec - last_sweep.tv_sec >= c->delay || info.test)
+			pending.full_sweep = true;
+		if (pending.full_sweep)
+			last_sweep = now;
+
+		/* Nothing in mdstat changed since the last pass, which checked
+		 * every array whose entry differed, so only flagged arrays
+		 * could need a check and no array can have appeared.
+		 */
+		quiet = changes == 0 && !pending.full_sweep;
+		for (st = statelist; quiet && st; st = st->next)
+			if (array_flagged(st))
+				quiet = false;
+		if (!quiet && changes >= 0)
+			mdstat = mdstat_scan_ents(&mdstat_snap, 0);
 
 		for (st = statelist; st; st = st->next) {
-			if (check_array(st, mdstat, increments, c->prefer))
+			if (quiet ||
+			    (!pending.full_sweep && !array_needs_check(st, mdstat))) {
+				if (st->active < st->raid && st->spare == 0)
+					anydegraded = 1;
+			} else if (check_array(st, mdstat, increments, c->prefer))
 				anydegraded = 1;
+			st->changed = false;
 			/* for external arrays, metadata is filled for
 			 * containers only
 			 */
@@ -319,8 +394,10 @@ int Monitor(struct mddev_dev *devlist,
 				anyredundant = 1;
 		}
 
+		publish_metrics(statelist);
+
 		/* now check if there are any new devices found in mdstat */
-		if (c->scan)
+		if (c->scan && !quiet)
 			new_found = add_new_arrays(mdstat, &statelist);
 
 		/* If an array has active < raid && spare == 0 && spare_group != NULL
@@ -337,7 +414,9 @@ int Monitor(struct mddev_dev *devlist,
 				break;
 			}
 
+			pending.full_sweep = false;
 			wait_for_events(&delay_for_event, c->delay);
+			note_pending_changes(statelist);
 		}
 		info.test = 0;
 
@@ -346,6 +425,8 @@ int Monitor(struct mddev_dev *devlist,
 				*stp = st->next;
 				if (st->spare_group)
 					free(st->spare_group);
+				free(st->members);
+				metrics_free(st->metrics);
 
 				free(st);
 			} else
@@ -354,12 +435,164 @@ int Monitor(struct mddev_dev *devlist,
 	}
 
 	free_statelist(statelist);
+	sysfs_attr_cache(false);
+	alert_dispatch(true);
+	metrics_close();
+	mdstat_scan_free(&mdstat_snap);
 
 	if (pidfile)
 		unlink(pidfile);
 	return 0;
 }
 
+/* checked regardless of mdstat: failing, touched by udev, or never seen */
+static bool array_flagged(struct state *st)
+{
+	return st->err || st->changed || st->devnm[0] == 0 || st->utime == 0;
+}
+
+/*
+ * array_needs_check() - Decide whether an array has to be checked again.
+ * @st: array state
+ * @mdstat: current mdstat
+ *
+ * An array that is skipped still claims its mdstat entry, as check_array()
+ * would, so that it is not picked up as a new array.
+ */
+static bool array_needs_check(struct state *st, struct mdstat_ent *mdstat)
+{
+	struct mdstat_ent *mse = NULL;
+
+	if (array_flagged(st))
+		return true;
+
+	for (; mdstat; mdstat = mdstat->next)
+		if (strcmp(mdstat->devnm, st->devnm) == 0)
+			mse = mdstat;
+	if (!mse || mse->sig != st->mdstat_sig || mse->percent != st->percent)
+		return true;
+
+	mse->devnm[0] = 0;
+	return false;
+}
+
+static bool state_has_member(struct state *st, dev_t devid)
+{
+	int i;
+
+	for (i = 0; i < st->nmembers; i++)
+		if (st->members[i].devid == devid)
+			return true;
+	return false;
+}
+
+/*
+ * note_pending_changes() - Flag arrays touched by the collected udev events.
+ * @statelist: all monitored arrays
+ *
+ * An event on an md device flags that array, an event on a block device
+ * flags every array using it.  Containers and their subarrays share
+ * members, so flagging either flags both.
+ */
+static void note_pending_changes(struct state *statelist)
+{
+	struct state *st, *st2;
+	int i;
+
+	for (i = 0; i < pending.cnt; i++)
+		for (st = statelist; st; st = st->next)
+			if (strcmp(st->devnm, pending.devnm[i]) == 0 ||
+			    (pending.devid[i] &&
+			     state_has_member(st, pending.devid[i])))
+				st->changed = true;
+	pending.cnt = 0;
+
+	for (st = statelist; st; st = st->next) {
+		if (!st->changed || st->parent_devnm[0] == 0)
+			continue;
+		for (st2 = statelist; st2; st2 = st2->next)
+			if (strcmp(st2->devnm, st->parent_devnm) == 0)
+				st2->changed = true;
+	}
+	for (st = statelist; st; st = st->next) {
+		if (st->changed || st->parent_devnm[0] == 0)
+			continue;
+		for (st2 = statelist; st2; st2 = st2->next)
+			if (st2->changed &&
+			    strcmp(st2->devnm, st->parent_devnm) == 0)
+				st->changed = true;
+	}
+}
+
+/*
+ * publish_metrics() - Exports what is known about the monitored arrays.
+ * @statelist: all monitored arrays
+ *
+ * Arrays that were not checked again in this pass are exported as they
+ * were last seen.
+ */
+static void publish_metrics(struct state *statelist)
+{
+	struct metrics_array **arrays;
+	struct state *st;
+	int cnt = 0;
+
+	if (!metrics_enabled())
+		return;
+	for (st = statelist; st; st = st->next)
+		cnt++;
+	arrays = xcalloc(cnt + 1, sizeof(*arrays));
+	cnt = 0;
+	for (st = statelist; st; st = st->next)
+		if (!st->err && st->metrics)
+			arrays[cnt++] = st->metrics;
+	metrics_publish(arrays, cnt);
+	free(arrays);
+}
+
+#ifndef NO_LIBUDEV
+/*
+ * wait_for_events_udev() - Waits for udev events and collects them.
+ * @delay_for_event: pointer to current event delay
+ * @seconds: how long to wait, at most @delay_for_event
+ *
+ * After the first event, whatever else is already queued is drained too,
+ * so a burst of events costs one pass over the arrays.
+ */
+static void wait_for_events_udev(int *delay_for_event, int seconds)
+{
+	enum udev_status ret;
+	int timeout = seconds;
+
+	while (1) {
+		dev_t devid = 0;
+		char devnm[MD_NAME_MAX];
+
+		ret = udev_wait_for_events(timeout, &devid, devnm);
+		if (ret != UDEV_STATUS_SUCCESS)
+			break;
+		/* devices may have come or gone, rescan by-path */
+		policy_paths_invalidate();
+		timeout = 0;
+
+		if (pending.cnt == MAX_PENDING_CHANGES) {
+			pending.full_sweep = true;
+			continue;
+		}
+		pending.devid[pending.cnt] = devid;
+		snprintf(pending.devnm[pending.cnt], MD_NAME_MAX, "%s", devnm);
+		pending.cnt++;
+	}
+
+	if (ret == UDEV_STATUS_ERROR) {
+		pr_err("Error while waiting for udev events.\n");
+		pending.full_sweep = true;
+	} else if (timeout && timeout == *delay_for_event)
+		/* nothing happened for a whole delay */
+		pending.full_sweep = true;
+}
+#endif
+
 /*
  * wait_for_events() - Waits for events on md devices.
  * @delay_for_event: pointer to current event delay
@@ -367,24 +600,30 @@ int Monitor(struct mddev_dev *devlist,
  */
 static void wait_for_events(int *delay_for_event, int c_delay)
 {
+	/* wake up in time to deliver queued alerts */
+	int seconds = alert_wait_limit(*delay_for_event);
+
 #ifndef NO_LIBUDEV
 	if (udev_is_available()) {
-		if (udev_wait_for_events(*delay_for_event) == UDEV_STATUS_ERROR)
-			pr_err("Error while waiting for udev events.\n");
+		wait_for_events_udev(delay_for_event, seconds);
+		alert_dispatch(false);
 		return;
 	}
 #endif
-	wait_for_events_mdstat(delay_for_event, c_delay);
+	wait_for_events_mdstat(delay_for_event, c_delay, seconds);
+	policy_paths_invalidate();
+	alert_dispatch(false);
 }
 
 /*
  * wait_for_events_mdstat() - Waits for events on mdstat.
  * @delay_for_event: pointer to current event delay
  * @c_delay: delay from config
+ * @seconds: how long to wait, at most @delay_for_event
  */
-static void wait_for_events_mdstat(int *delay_for_event, int c_delay)
+static void wait_for_events_mdstat(int *delay_for_event, int c_delay, int seconds)
 {
-	int wait_result = mdstat_wait(*delay_for_event);
+	int wait_result = mdstat_wait(seconds);
 
 	if (wait_result < 0) {
 		pr_err("Error while waiting for events on mdstat.\n");
@@ -397,8 +636,10 @@ static void wait_for_events_mdstat(int *delay_for_event, int c_delay)
 	if (wait_result != 0) {
 		if (c_delay > FALLBACK_DELAY)
 			*delay_for_event = FALLBACK_DELAY;
-	} else {
+	} else if (seconds == *delay_for_event) {
 		*delay_for_event = c_delay;
+		/* nothing happened for a whole delay */
+		pending.full_sweep = true;
 	}
 	mdstat_close();
 }
@@ -615,33 +856,147 @@ static bool is_email_event(const enum event event_enum)
 	return false;
 }
 
+/*
+ * struct queued_alert - event waiting for the alert program or for a mail.
+ */
+struct queued_alert {
+	enum event event_enum;
+	char event_name[EVENT_NAME_MAX];
+	char *dev;
+	char *disc;
+	char *message;
+	struct queued_alert *next;
+};
+
+/* an alert program finished, drop the array name it ran for */
+static void alert_done(void *data, int status)
+{
+	free(data);
+}
+
+/*
+ * Alerts are not delivered from the monitoring loop itself.  The alert
+ * program and sendmail run in child processes, at most ALERT_MAX_CHILDREN
+ * programs and ALERT_MAX_MAIL_CHILDREN mails at a time, so a slow program
+ * cannot delay noticing the next event, and a hung one cannot hold up
+ * mail.
+ * Mails for one kind of event are collected for ALERT_MAIL_WINDOW seconds
+ * and sent as one, so a failing controller does not cause a mail per array.
+ * The alert program still runs once per event, in order for each array.
+ */
+static struct {
+	struct queued_alert *cmds, **cmds_tail;
+	struct mail_batch {
+		struct queued_alert *head, **tail;
+		int cnt;
+		time_t due;
+	} mail[EVENT_UNKNOWN];
+	/* data of a child is the array the alert program runs for */
+	struct child_pool cmd_children;
+	struct child_pool mail_children;
+	int syslog_fd;
+	int syslog_dropped;
+} dispatch = {
+	.cmd_children = { .max = ALERT_MAX_CHILDREN, .done = alert_done },
+	.mail_children = { .max = ALERT_MAX_MAIL_CHILDREN },
+	.syslog_fd = -1,
+};
+
+static time_t monotonic_seconds(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec;
+}
+
+static struct queued_alert *queued_alert_new(const struct event_data *data)
+{
+	struct queued_alert *q = xcalloc(1, sizeof(*q));
+
+	q->event_enum = data->event_enum;
+	snprintf(q->event_name, sizeof(q->event_name), "%s", data->event_name);
+	q->dev = xstrdup(data->dev);
+	q->disc = data->disc ? xstrdup(data->disc) : NULL;
+	q->message = xstrdup(data->message);
+	return q;
+}
+
+static void queued_alert_free(struct queued_alert *q)
+{
+	free(q->dev);
+	free(q->disc);
+	free(q->message);
+	free(q);
+}
+
+static bool alert_free_child(struct child_pool *cp)
+{
+	return cp->running < cp->max;
+}
+
+static bool alert_children_running(void)
+{
+	return dispatch.cmd_children.running > 0 ||
+	       dispatch.mail_children.running > 0;
+}
+
+/* @block: wait for at least one child if none has finished yet */
+static void alert_reap_children(bool block)
+{
+	int reaped = 0;
+
+	if (dispatch.cmd_children.running)
+		reaped += child_pool_reap(&dispatch.cmd_children, false);
+	if (dispatch.mail_children.running)
+		reaped += child_pool_reap(&dispatch.mail_children, false);
+	if (!block || reaped)
+		return;
+	if (dispatch.mail_children.running)
+		child_pool_reap(&dispatch.mail_children, true);
+	else if (dispatch.cmd_children.running)
+		child_pool_reap(&dispatch.cmd_children, true);
+}
+
+static bool alert_cmd_running(const char *dev)
+{
+	int i;
+
+	for (i = 0; i < CHILD_POOL_MAX; i++)
+		if (dispatch.cmd_children.slots[i].pid > 0 &&
+		    strcmp(dispatch.cmd_children.slots[i].data, dev) == 0)
+			return true;
+	return false;
+}
+
 /*
  * execute_alert_cmd() - Forks and executes command provided as alert_cmd.
- * @data: event data
+ * @q: queued event, its dev is handed to the child's slot
  */
-static void execute_alert_cmd(const struct event_data *data)
+static void execute_alert_cmd(struct queued_alert *q)
 {
-	int pid = fork();
+	pid_t pid = child_pool_fork(&dispatch.cmd_children, q->dev);
 
 	switch (pid) {
 	default:
-		waitpid(pid, NULL, 0);
+		q->dev = NULL;
 		break;
 	case -1:
-		pr_err("Cannot fork to execute alert command");
+		pr_err("Cannot fork to execute alert command\n");
 		break;
 	case 0:
-		execl(info.alert_cmd, info.alert_cmd, data->event_name, data->dev, data->disc, NULL);
-		exit(2);
+		execl(info.alert_cmd, info.alert_cmd, q->event_name, q->dev, q->disc, NULL);
+		_exit(2);
 	}
 }
 
 /*
- * send_event_email() - Sends an email about event detected by monitor.
- * @data: event data
+ * send_event_email() - Sends an email about events detected by monitor.
+ * @batch: events of one kind, in the order they were detected
  */
-static void send_event_email(const struct event_data *data)
+static void send_event_email(const struct mail_batch *batch)
 {
+	struct queued_alert *q = batch->head;
 	FILE *mp = NULL, *mdstat;
 	char buf[BUFSIZ];
 	int n;
@@ -667,9 +1022,15 @@ static void send_event_email(const struct event_data *data)
 	else
 		fprintf(mp, "From: %s monitoring <root>\n", Name);
 	fprintf(mp, "To: %s\n", info.mailaddr);
-	fprintf(mp, "Subject: %s event on %s:%s\n\n", data->event_name, data->dev, info.hostname);
+	if (batch->cnt == 1)
+		fprintf(mp, "Subject: %s event on %s:%s\n\n",
+			q->event_name, q->dev, info.hostname);
+	else
+		fprintf(mp, "Subject: %s event on %s and %d more:%s\n\n",
+			q->event_name, q->dev, batch->cnt - 1, info.hostname);
 	fprintf(mp, "This is an automatically generated mail message.\n");
-	fprintf(mp, "%s\n", data->message);
+	for (; q; q = q->next)
+		fprintf(mp, "%s\n", q->message);
 
 	mdstat = fopen("/proc/mdstat", "r");
 	if (!mdstat) {
@@ -685,6 +1046,156 @@ static void send_event_email(const struct event_data *data)
 	pclose(mp);
 }
 
+/*
+ * send_mail_batch() - Hands a batch of events to sendmail in a child.
+ * @batch: batch to send, emptied afterwards
+ */
+static void send_mail_batch(struct mail_batch *batch)
+{
+	struct queued_alert *q;
+	pid_t pid = child_pool_fork(&dispatch.mail_children, NULL);
+
+	if (pid == 0) {
+		send_event_email(batch);
+		_exit(0);
+	}
+	if (pid < 0)
+		send_event_email(batch);
+
+	while ((q = batch->head) != NULL) {
+		batch->head = q->next;
+		queued_alert_free(q);
+	}
+	batch->cnt = 0;
+}
+
+/*
+ * alert_dispatch() - Starts alert programs and mails that are due.
+ * @flush: send everything now and wait until all of it is delivered.
+ */
+static void alert_dispatch(bool flush)
+{
+	do {
+		struct queued_alert *q, **qp;
+		time_t now = monotonic_seconds();
+		int e;
+
+		alert_reap_children(false);
+
+		for (qp = &dispatch.cmds; (q = *qp) != NULL; ) {
+			if (!alert_free_child(&dispatch.cmd_children))
+				break;
+			if (alert_cmd_running(q->dev)) {
+				/* keep events for one array in order */
+				qp = &q->next;
+				continue;
+			}
+			*qp = q->next;
+			if (!q->next)
+				dispatch.cmds_tail = qp;
+			execute_alert_cmd(q);
+			queued_alert_free(q);
+		}
+
+		for (e = 0; e < EVENT_UNKNOWN; e++) {
+			struct mail_batch *batch = &dispatch.mail[e];
+
+			if (!batch->cnt || (!flush && now < batch->due))
+				continue;
+			if (!alert_free_child(&dispatch.mail_children))
+				break;
+			send_mail_batch(batch);
+		}
+
+		if (flush && alert_children_running())
+			alert_reap_children(true);
+	} while (flush && (dispatch.cmds || alert_children_running()));
+}
+
+/*
+ * alert_wait_limit() - Limits a wait so that queued alerts are not delayed.
+ * @seconds: intended wait
+ *
+ * Return: number of seconds to wait at most.
+ */
+static int alert_wait_limit(int seconds)
+{
+	time_t now = monotonic_seconds();
+	int e;
+
+	if (dispatch.cmds || alert_children_running())
+		return seconds < 1 ? seconds : 1;
+	for (e = 0; e < EVENT_UNKNOWN; e++) {
+		int left;
+
+		if (!dispatch.mail[e].cnt)
+			continue;
+		left = dispatch.mail[e].due - now;
+		if (left < 1)
+			left = 1;
+		if (left < seconds)
+			seconds = left;
+	}
+	return seconds;
+}
+
+static int syslog_connect(void)
+{
+	struct sockaddr_un addr = {.sun_family = AF_UNIX};
+	int fd;
+
+	fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (!is_fd_valid(fd))
+		return -1;
+	snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", _PATH_LOG);
+	if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+/*
+ * syslog_send() - Sends a message to syslog without ever blocking.
+ * @priority: syslog priority
+ * @message: text to log
+ *
+ * Return: 0 if the message was sent or dropped, 1 if there is no syslog
+ * socket to send to.
+ */
+static int syslog_send(int priority, const char *message)
+{
+	char buf[BUFSIZ + 128];
+	char stamp[32];
+	time_t now = time(NULL);
+	int retry;
+	int len;
+
+	strftime(stamp, sizeof(stamp), "%b %e %T", localtime(&now));
+	len = snprintf(buf, sizeof(buf), "<%d>%s %s[%d]: %s",
+		       SYSLOG_FACILITY | priority, stamp, Name, getpid(),
+		       message);
+	if (len >= (int)sizeof(buf))
+		len = sizeof(buf) - 1;
+
+	for (retry = 0; retry < 2; retry++) {
+		if (!is_fd_valid(dispatch.syslog_fd))
+			dispatch.syslog_fd = syslog_connect();
+		if (!is_fd_valid(dispatch.syslog_fd))
+			return 1;
+		if (send(dispatch.syslog_fd, buf, len, MSG_NOSIGNAL) == len)
+			return 0;
+		if (errno == EAGAIN || errno == ENOBUFS) {
+			/* syslog is not keeping up, don't wait for it */
+			dispatch.syslog_dropped++;
+			return 0;
+		}
+		/* syslog daemon may have restarted */
+		close_fd(&dispatch.syslog_fd);
+	}
+	return 1;
+}
+
 /*
  * log_event_to_syslog() - Logs an event into syslog.
  * @data: event data
@@ -695,7 +1206,20 @@ static void log_event_to_syslog(const struct event_data *data)
 
 	priority = get_syslog_event_priority(data->event_enum);
 
-	syslog(priority, "%s\n", data->message);
+	if (dispatch.syslog_dropped) {
+		int dropped = dispatch.syslog_dropped;
+		char msg[80];
+
+		snprintf(msg, sizeof(msg), "%d events could not be logged",
+			 dropped);
+		dispatch.syslog_dropped = 0;
+		syslog_send(LOG_WARNING, msg);
+		if (dispatch.syslog_dropped)
+			/* still busy, try again with the next event */
+			dispatch.syslog_dropped = dropped;
+	}
+	if (syslog_send(priority, data->message) != 0)
+		syslog(priority, "%s\n", data->message);
 }
 
 /*
@@ -706,7 +1230,8 @@ static void log_event_to_syslog(const struct event_data *data)
  * @dev: md device name
  * @disc: component device
  *
- * If needed function executes alert command, sends an email or logs event to syslog.
+ * If needed function queues the event for the alert command and email,
+ * and logs event to syslog.
  */
 static void alert(const enum event event_enum, const char *description, const uint8_t progress,
 		  const char *dev, const char *disc)
@@ -731,14 +1256,41 @@ static void alert(const enum event event_enum, const char *description, const ui
 	}
 	pr_err("%s\n", data.message);
 
-	if (info.alert_cmd)
-		execute_alert_cmd(&data);
+	if (info.alert_cmd) {
+		struct queued_alert *q = queued_alert_new(&data);
 
-	if (info.mailaddr && is_email_event(event_enum))
-		send_event_email(&data);
+		if (!dispatch.cmds)
+			dispatch.cmds_tail = &dispatch.cmds;
+		*dispatch.cmds_tail = q;
+		dispatch.cmds_tail = &q->next;
+	}
+
+	if (info.mailaddr && is_email_event(event_enum)) {
+		struct mail_batch *batch = &dispatch.mail[event_enum];
+		struct queued_alert *q = queued_alert_new(&data);
+
+		if (!batch->cnt) {
+			batch->tail = &batch->head;
+			batch->due = monotonic_seconds() + ALERT_MAIL_WINDOW;
+		}
+		*batch->tail = q;
+		batch->tail = &q->next;
+		batch->cnt++;
+	}
 
 	if (info.dosyslog)
 		log_event_to_syslog(&data);
+
+	alert_dispatch(false);
+}
+
+static int cmp_member_state(const void *a, const void *b)
+{
+	const struct member_state *ma = a, *mb = b;
+
+	if (ma->devid == mb->devid)
+		return 0;
+	return ma->devid < mb->devid ? -1 : 1;
 }
 
 static int check_array(struct state *st, struct mdstat_ent *mdstat,
@@ -748,15 +1300,13 @@ static int check_array(struct state *st, struct mdstat_ent *mdstat,
 	 * or found by directly examining the array, and return
 	 * '1' if the array is degraded, or '0' if it is optimal (or dead).
 	 */
-	struct { int state, major, minor; } disks_info[MAX_DISKS];
-	struct mdinfo *sra = NULL;
+	struct member_state *members = NULL;
+	struct mdinfo *sra = NULL, *sd;
 	mdu_array_info_t array;
 	struct mdstat_ent *mse = NULL, *mse2;
 	char *dev = st->devname;
 	int fd;
-	int i;
-	int remaining_disks;
-	int last_disk;
+	int i, j, n;
 	int new_array = 0;
 	int retval;
 	int is_container = 0;
@@ -787,6 +1337,7 @@ static int check_array(struct state *st, struct mdstat_ent *mdstat,
 		st->err++;
 		goto out;
 	}
+	st->mdstat_sig = mse->sig;
 
 	if (mse->level == NULL)
 		is_container = 1;
@@ -804,7 +1355,8 @@ static int check_array(struct state *st, struct mdstat_ent *mdstat,
 		redundancy_only_flags |= GET_MISMATCH;
 
 	sra = sysfs_read(-1, st->devnm, GET_LEVEL | GET_DISKS | GET_DEVS |
-			GET_STATE | redundancy_only_flags);
+			GET_STATE | redundancy_only_flags |
+			metrics_extra_sysfs());
 
 	if (!sra)
 		goto disappeared;
@@ -819,6 +1371,9 @@ static int check_array(struct state *st, struct mdstat_ent *mdstat,
 		goto out;
 	}
 
+	if (metrics_enabled())
+		metrics_collect(&st->metrics, sra, mse);
+
 	/* this array is in /proc/mdstat */
 	if (array.utime == 0)
 		/* external arrays don't update utime, so
@@ -876,20 +1431,25 @@ static int check_array(struct state *st, struct mdstat_ent *mdstat,
 	}
 	st->percent = mse->percent;
 
-	remaining_disks = sra->array.nr_disks;
-	for (i = 0; i < MAX_DISKS && remaining_disks > 0; i++) {
-		mdu_disk_info_t disc;
-		disc.number = i;
-		if (md_get_disk_info(fd, &disc) >= 0) {
-			disks_info[i].state = disc.state;
-			disks_info[i].major = disc.major;
-			disks_info[i].minor = disc.minor;
-			if (disc.major || disc.minor)
-				remaining_disks --;
-		} else
-			disks_info[i].major = disks_info[i].minor = 0;
+	/* sysfs already lists every member with its slot and state, so build
+	 * a compact table from it instead of asking for each possible disk
+	 * number with GET_DISK_INFO.
+	 */
+	n = 0;
+	for (sd = sra->devs; sd; sd = sd->next)
+		n++;
+	if (n)
+		members = xcalloc(n, sizeof(*members));
+	for (n = 0, sd = sra->devs; sd; sd = sd->next) {
+		if (sd->disk.major == 0 && sd->disk.minor == 0)
+			continue;
+		members[n].devid = makedev(sd->disk.major, sd->disk.minor);
+		members[n].state = sd->disk.state;
+		if (sd->disk.raid_disk >= 0)
+			members[n].state |= (1 << MD_DISK_ACTIVE);
+		n++;
 	}
-	last_disk = i;
+	qsort(members, n, sizeof(*members), cmp_member_state);
 
 	if (is_mdstat_ent_subarray(mse)) {
 		char *sl;
@@ -903,40 +1463,49 @@ static int check_array(struct state *st, struct mdstat_ent *mdstat,
 	if (st->metadata == NULL && st->parent_devnm[0] == 0)
 		st->metadata = super_by_fd(fd, NULL);
 
-	for (i = 0; i < MAX_DISKS; i++) {
-		mdu_disk_info_t disc = {0, 0, 0, 0, 0};
-		int newstate = 0;
+	/* Walk both sorted tables, a member missing from either side
+	 * counts as removed.
+	 */
+	for (i = 0, j = 0; i < st->nmembers || j < n; ) {
+		dev_t devid;
+		int oldstate, newstate;
 		int change;
-		char *dv = NULL;
-		disc.number = i;
-		if (i < last_disk && (disks_info[i].major || disks_info[i].minor)) {
-			newstate = disks_info[i].state;
-			dv = map_dev_preferred(disks_info[i].major, disks_info[i].minor, 1,
-					       prefer);
-			disc.state = newstate;
-			disc.major = disks_info[i].major;
-			disc.minor = disks_info[i].minor;
-		} else
+
+		if (j == n || (i < st->nmembers &&
+			       st->members[i].devid < members[j].devid)) {
+			devid = st->members[i].devid;
+			oldstate = st->members[i++].state;
 			newstate = (1 << MD_DISK_REMOVED);
+		} else if (i == st->nmembers ||
+			   members[j].devid < st->members[i].devid) {
+			devid = members[j].devid;
+			oldstate = (1 << MD_DISK_REMOVED);
+			newstate = members[j++].state;
+		} else {
+			devid = members[j].devid;
+			oldstate = st->members[i++].state;
+			newstate = members[j++].state;
+		}
 
-		if (dv == NULL && st->devid[i])
-			dv = map_dev_preferred(major(st->devid[i]),
-					       minor(st->devid[i]), 1, prefer);
-		change = newstate ^ st->devstate[i];
+		change = newstate ^ oldstate;
 		if (st->utime && change && !st->err && !new_array) {
-			if ((st->devstate[i]&change) & (1 << MD_DISK_SYNC))
+			char *dv = map_dev_preferred(major(devid), minor(devid),
+						     1, prefer);
+
+			if ((oldstate & change) & (1 << MD_DISK_SYNC))
 				alert(EVENT_FAIL, NULL, 0, dev, dv);
 			else if ((newstate & (1 << MD_DISK_FAULTY)) &&
-				 (disc.major || disc.minor) &&
-				 st->devid[i] == makedev(disc.major,
-							 disc.minor))
+				 !(oldstate & (1 << MD_DISK_REMOVED)))
 				alert(EVENT_FAIL_SPARE, NULL, 0, dev, dv);
-			else if ((newstate&change) & (1 << MD_DISK_SYNC))
+			else if ((newstate & change) & (1 << MD_DISK_SYNC))
 				alert(EVENT_SPARE_ACTIVE, NULL, 0, dev, dv);
 		}
-		st->devstate[i] = newstate;
-		st->devid[i] = makedev(disc.major, disc.minor);
 	}
+	free(st->members);
+	st->members = members;
+	st->nmembers = n;
+	members = NULL;
+
 	st->active = sra->array.active_disks;
 	st->working = sra->array.working_disks;
 	st->spare = sra->array.spare_disks;
@@ -948,6 +1517,7 @@ static int check_array(struct state *st, struct mdstat_ent *mdstat,
 		retval = 1;
 
  out:
+	free(members);
 	if (sra)
 		sysfs_free(sra);
 	if (fd >= 0)
@@ -1052,24 +1622,26 @@ static dev_t choose_spare(struct state *from, struct state *to,
 	int d;
 	dev_t dev = 0;
 
-	for (d = from->raid; !dev && d < MAX_DISKS; d++) {
-		if (from->devid[d] > 0 && from->devstate[d] == 0) {
+	for (d = 0; !dev && d < from->nmembers; d++) {
+		dev_t devid = from->members[d].devid;
+
+		if (from->members[d].state == 0) {
 			struct dev_policy *pol;
 
 			if (to->metadata->ss->external &&
-			    test_partition_from_id(from->devid[d]))
+			    test_partition_from_id(devid))
 				continue;
 
-			if (devid_matches_criteria(to->metadata, from->devid[d], sc) == false)
+			if (devid_matches_criteria(to->metadata, devid, sc) == false)
 				continue;
 
-			pol = devid_policy(from->devid[d]);
+			pol = devid_policy(devid);
 			if (from->spare_group)
 				pol_add(&pol, pol_domain,
 					from->spare_group, NULL);
 			if (domain_test(domlist, pol,
 					to->metadata->ss->name) == 1)
-			    dev = from->devid[d];
+			    dev = devid;
 			dev_policy_free(pol);
 		}
 	}
@@ -1177,11 +1749,10 @@ static void try_spare_migration(struct state *statelist)
 				if (devid > 0)
 					continue;
 			}
-			for (d = 0; d < MAX_DISKS; d++)
-				if (to->devid[d])
-					domainlist_add_dev(&domlist,
-							   to->devid[d],
-							   to->metadata->ss->name);
+			for (d = 0; d < to->nmembers; d++)
+				domainlist_add_dev(&domlist,
+						   to->members[d].devid,
+						   to->metadata->ss->name);
 			if (to->spare_group)
 				domain_add(&domlist, to->spare_group);
 			/*
@@ -1249,6 +1820,8 @@ static void free_statelist(struct state *statelist)
 	while (statelist) {
 		if (statelist->spare_group)
 			free(statelist->spare_group);
+		free(statelist->members);
+		metrics_free(statelist->metrics);
 
 		tmp = statelist;
 		statelist = statelist->next;
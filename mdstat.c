@@ -73,14 +73,14 @@
  *   pattern of failed drives (so need number of drives)
  *   percent resync complete
  *
- * As continuation is indicated by leading space, we use
- *  conf_line from config.c to read logical lines
+ * As continuation is indicated by leading space, a logical line runs
+ *  up to the next line starting with a non-blank, as for conf_line().
+ *  The file is read into one buffer and parsed in place, see mdstat_scan().
  *
  */
 
 #include	"mdadm.h"
 #include	"mdstat.h"
-#include	"dlink.h"
 #include	"xmalloc.h"
 
 #include	<sys/select.h>
@@ -97,12 +97,12 @@ static void free_member_devnames(struct dev_member *m)
 	}
 }
 
-static int add_member_devname(struct dev_member **m, char *name)
+static int add_member_devname(struct dev_member **m, char *name, int len)
 {
 	struct dev_member *new;
 	char *t;
 
-	if ((t = strchr(name, '[')) == NULL)
+	if ((t = memchr(name, '[', len)) == NULL)
 		/* not a device */
 		return 0;
 
@@ -192,154 +192,404 @@ int is_subarray_active(char *subarray, char *container)
 	return ent != NULL;
 }
 
+/* is the word at @w, @len characters long, exactly @s */
+static bool word_is(const char *w, int len, const char *s)
+{
+	return (int)strlen(s) == len && memcmp(w, s, len) == 0;
+}
+
+static bool word_starts(const char *w, int len, const char *s)
+{
+	int l = strlen(s);
+
+	return len >= l && memcmp(w, s, l) == 0;
+}
+
+static bool word_ends(const char *w, int len, const char *s)
+{
+	int l = strlen(s);
+
+	return len > l && memcmp(w + len - l, s, l) == 0;
+}
+
+/*
+ * Find the next word of the logical line starting at @p.  A logical line
+ * continues over lines that start with a blank, as in conf_line().
+ * Returns the start of the word and sets *@len, or NULL at the end of the
+ * logical line with @p left at the start of the next one.
+ */
+static char *next_word(char **p, int *len, bool first)
+{
+	char *c = *p, *w;
+
+	while (*c) {
+		if (*c == '\n') {
+			c++;
+			if (*c == ' ' || *c == '\t' || *c == '\n')
+				continue;
+			if (!first)
+				break;
+			continue;
+		}
+		if (*c == ' ' || *c == '\t') {
+			c++;
+			continue;
+		}
+		w = c;
+		while (*c && *c != ' ' && *c != '\t' && *c != '\n') {
+			c++;
+			/* Hack for broken kernels (2.6.14-.24) that put
+			 *        "active(auto-read-only)"
+			 * in /proc/mdstat instead of
+			 *        "active (auto-read-only)"
+			 */
+			if (*c == '(' && c - w == 6 && memcmp(w, "active", 6) == 0)
+				break;
+		}
+		*len = c - w;
+		*p = c;
+		return w;
+	}
+	*p = c;
+	return NULL;
+}
+
+/*
+ * Fold a word of an mdstat entry into its signature.  The progress bar
+ * and the bitmap line change all the time while nothing interesting
+ * happens, so stop at either; resync progress is tracked in 'percent'.
+ */
+static bool mdstat_sig_add(unsigned int *sig, const char *w, int l)
+{
+	if (l >= 2 && w[0] == '[' && (w[1] == '=' || w[1] == '>'))
+		return false;
+	if (word_is(w, l, "bitmap:"))
+		return false;
+
+	for (; l; w++, l--)
+		*sig = (*sig ^ (unsigned char)*w) * 16777619;
+	*sig = (*sig ^ ' ') * 16777619;
+	return true;
+}
+
+/* parse the words of one md line following the device name */
+static void mdstat_parse_ent(struct mdstat_view *v, char **p)
+{
+	char *w;
+	int l;
+	int in_devs = 0;
+	bool in_sig = true;
+
+	while ((w = next_word(p, &l, false)) != NULL) {
+		char *eq;
+
+		if (in_sig)
+			in_sig = mdstat_sig_add(&v->sig, w, l);
+		if (word_is(w, l, "active"))
+			v->active = 1;
+		else if (word_is(w, l, "inactive")) {
+			v->active = 0;
+			in_devs = 1;
+		} else if (word_is(w, l, "bitmap:")) {
+			/* We need to stop parsing here;
+			 * otherwise, raid_disks will be
+			 * overwritten by the wrong value.
+			 */
+			w = next_word(p, &l, false);
+			if (!w)
+				return;
+			sscanf(w, "%d/%d", &v->bitmap_pages, &v->bitmap_total);
+			while (next_word(p, &l, false))
+				;
+			break;
+		} else if (v->active > 0 &&
+			   v->level.s == NULL &&
+			   w[0] != '(' /*readonly*/) {
+			v->level.s = w;
+			v->level.len = l;
+			in_devs = 1;
+		} else if (in_devs && word_is(w, l, "blocks"))
+			in_devs = 0;
+		else if (in_devs) {
+			if (!v->devs.s)
+				v->devs.s = w;
+			v->devs.len = w + l - v->devs.s;
+			if (memchr(w, '[', l))
+				v->devcnt++;
+		} else if (word_is(w, l, "super")) {
+			w = next_word(p, &l, false);
+			if (!w)
+				return;
+			v->metadata_version.s = w;
+			v->metadata_version.len = l;
+		} else if (w[0] == '[' && isdigit(w[1])) {
+			v->raid_disks = atoi(w+1);
+		} else if (!v->pattern.s &&
+			   w[0] == '[' &&
+			   (w[1] == 'U' || w[1] == '_')) {
+			v->pattern.s = w + 1;
+			v->pattern.len = l - 1;
+			if (w[l-1] == ']')
+				v->pattern.len--;
+		} else if (v->percent == RESYNC_NONE &&
+			   word_starts(w, l, "re") &&
+			   w[l-1] == '%' &&
+			   (eq = memchr(w, '=', l)) != NULL) {
+			v->percent = atoi(eq+1);
+			if (word_starts(w, l, "resync"))
+				v->resync = 1;
+			else if (word_starts(w, l, "reshape"))
+				v->resync = 2;
+			else
+				v->resync = 0;
+		} else if (v->percent == RESYNC_NONE &&
+			   (w[0] == 'r' || w[0] == 'c')) {
+			if (word_starts(w, l, "resync"))
+				v->resync = 1;
+			if (word_starts(w, l, "reshape"))
+				v->resync = 2;
+			if (word_starts(w, l, "recovery"))
+				v->resync = 0;
+			if (word_starts(w, l, "check"))
+				v->resync = 3;
+
+			if (word_ends(w, l, "=DELAYED"))
+				v->percent = RESYNC_DELAYED;
+			if (word_ends(w, l, "=PENDING"))
+				v->percent = RESYNC_PENDING;
+			if (word_ends(w, l, "=REMOTE"))
+				v->percent = RESYNC_REMOTE;
+		} else if (v->percent == RESYNC_NONE &&
+			   w[0] >= '0' &&
+			   w[0] <= '9' &&
+			   w[l-1] == '%') {
+			v->percent = atoi(w);
+		}
+	}
+}
+
 static int mdstat_fd = -1;
-struct mdstat_ent *mdstat_read(int hold, int start)
+
+/* read the whole of /proc/mdstat into sc->buf */
+static int mdstat_load(struct mdstat_scan *sc, int hold)
 {
-	FILE *f;
-	struct mdstat_ent *all, *rv, **end, **insert_here;
-	char *line;
+	int len = 0;
+	ssize_t n;
 	int fd;
 
-	if (hold && mdstat_fd != -1) {
-		off_t offset = lseek(mdstat_fd, 0L, 0);
-		if (offset == (off_t)-1) {
-			return NULL;
+	if (hold && mdstat_fd != -1)
+		fd = mdstat_fd;
+	else
+		fd = open("/proc/mdstat", O_RDONLY | O_CLOEXEC);
+	if (!is_fd_valid(fd))
+		return -1;
+
+	if (!sc->buf) {
+		sc->size = 4096;
+		sc->buf = xmalloc(sc->size);
+	}
+	while ((n = pread(fd, sc->buf + len, sc->size - len - 1, len)) > 0) {
+		len += n;
+		if (len == sc->size - 1) {
+			sc->size *= 2;
+			sc->buf = xrealloc(sc->buf, sc->size);
 		}
-		fd = dup(mdstat_fd);
-		if (fd >= 0)
-			f = fdopen(fd, "r");
-		else
-			return NULL;
-	} else
-		f = fopen("/proc/mdstat", "r");
-	if (f == NULL)
-		return NULL;
+	}
+	sc->buf[len] = '\0';
 
-	if (fcntl(fileno(f), F_SETFD, FD_CLOEXEC) < 0) {
-		fclose(f);
-		return NULL;
+	if (n < 0) {
+		if (fd != mdstat_fd)
+			close(fd);
+		return -1;
 	}
+	if (hold && mdstat_fd == -1)
+		mdstat_fd = fd;
+	else if (fd != mdstat_fd)
+		close(fd);
+	return 0;
+}
 
-	all = NULL;
-	end = &all;
-	for (; (line = conf_line(f)) ; free_line(line)) {
-		struct mdstat_ent *ent;
-		char *w;
-		char devnm[32];
-		int in_devs = 0;
+static struct mdstat_view *view_find(struct mdstat_view *views, int cnt,
+				     char *devnm)
+{
+	int i;
+
+	for (i = 0; i < cnt; i++)
+		if (strcmp(views[i].devnm, devnm) == 0)
+			return &views[i];
+	return NULL;
+}
+
+/* anything mdstat_scan_ents() copies that the signature doesn't cover */
+static bool view_changed(struct mdstat_view *old, struct mdstat_view *v)
+{
+	return old->sig != v->sig || old->percent != v->percent ||
+	       old->resync != v->resync ||
+	       old->bitmap_pages != v->bitmap_pages ||
+	       old->bitmap_total != v->bitmap_total;
+}
+
+/**
+ * mdstat_scan() - read /proc/mdstat into a reusable snapshot.
+ * @sc: snapshot, zeroed before first use and kept between calls.
+ * @hold: keep /proc/mdstat open for mdstat_wait(), as for mdstat_read().
+ *
+ * The file is read into one buffer and each md line is parsed into a
+ * &mdstat_view whose strings point into that buffer.  Once the buffer
+ * and view array are large enough nothing is allocated.  Views stay valid
+ * until the next call on @sc.
+ *
+ * Return: number of arrays that changed, appeared or disappeared since
+ * the previous call, or -1 if /proc/mdstat cannot be read.  When it is 0,
+ * mdstat_scan_ents() would build the same list as after the previous call.
+ */
+int mdstat_scan(struct mdstat_scan *sc, int hold)
+{
+	struct mdstat_view *tmp;
+	int changes = 0;
+	char *p, *w;
+	int l, i;
+
+	/* the previous views keep their names and signatures */
+	tmp = sc->prev;
+	sc->prev = sc->views;
+	sc->views = tmp;
+	sc->prev_cnt = sc->cnt;
+	sc->cnt = 0;
+
+	if (mdstat_load(sc, hold) != 0)
+		return -1;
+
+	p = sc->buf;
+	while ((w = next_word(&p, &l, true)) != NULL) {
+		struct mdstat_view *v, *old;
 
-		if (strcmp(line, "Personalities") == 0)
-			continue;
-		if (strcmp(line, "read_ahead") == 0)
-			continue;
-		if (strcmp(line, "unused") == 0)
-			continue;
-		insert_here = NULL;
 		/* Better be an md line.. */
-		if (strncmp(line, "md", 2)!= 0 || strlen(line) >= 32 ||
-		    (line[2] != '_' && !isdigit(line[2])))
+		if (l < 3 || l >= 32 || !word_starts(w, l, "md") ||
+		    (w[2] != '_' && !isdigit(w[2]))) {
+			while (next_word(&p, &l, false))
+				;
 			continue;
-		strcpy(devnm, line);
+		}
+
+		if (sc->cnt == sc->alloc) {
+			sc->alloc = sc->alloc ? sc->alloc * 2 : 16;
+			sc->views = xrealloc(sc->views,
+					     sc->alloc * sizeof(*sc->views));
+			sc->prev = xrealloc(sc->prev,
+					    sc->alloc * sizeof(*sc->prev));
+		}
+		v = &sc->views[sc->cnt++];
+		memset(v, 0, sizeof(*v));
+		memcpy(v->devnm, w, l);
+		v->percent = RESYNC_NONE;
+		v->active = -1;
+		v->sig = 2166136261;
+
+		mdstat_parse_ent(v, &p);
+
+		old = view_find(sc->prev, sc->prev_cnt, v->devnm);
+		if (!old || view_changed(old, v))
+			changes++;
+	}
+
+	for (i = 0; i < sc->prev_cnt; i++)
+		if (!view_find(sc->views, sc->cnt, sc->prev[i].devnm))
+			changes++;
+	return changes;
+}
+
+/**
+ * mdstat_scan_find() - look up an array in a snapshot.
+ * @sc: snapshot filled by mdstat_scan().
+ * @devnm: kernel name of the array.
+ *
+ * Return: the view of @devnm, or NULL if it is not listed.
+ */
+struct mdstat_view *mdstat_scan_find(struct mdstat_scan *sc, char *devnm)
+{
+	return view_find(sc->views, sc->cnt, devnm);
+}
+
+void mdstat_scan_free(struct mdstat_scan *sc)
+{
+	free(sc->buf);
+	free(sc->views);
+	free(sc->prev);
+	memset(sc, 0, sizeof(*sc));
+}
+
+static char *view_strdup(struct mdstat_str *str)
+{
+	char *s;
+
+	if (!str->s)
+		return NULL;
+	s = xmalloc(str->len + 1);
+	memcpy(s, str->s, str->len);
+	s[str->len] = '\0';
+	return s;
+}
+
+/**
+ * mdstat_scan_ents() - build the &mdstat_ent list from a snapshot.
+ * @sc: snapshot filled by mdstat_scan().
+ * @start: components before composites, see mdstat_read().
+ *
+ * Return: list to be released with free_mdstat().
+ */
+struct mdstat_ent *mdstat_scan_ents(struct mdstat_scan *sc, int start)
+{
+	struct mdstat_ent *all, *rv, **end, **insert_here;
+	int i;
+
+	all = NULL;
+	end = &all;
+	for (i = 0; i < sc->cnt; i++) {
+		struct mdstat_view *v = &sc->views[i];
+		struct mdstat_ent *ent;
+		char *p, *w, *devs_end;
+		int l;
 
 		ent = xmalloc(sizeof(*ent));
-		ent->level = ent->pattern= NULL;
-		ent->next = NULL;
-		ent->percent = RESYNC_NONE;
-		ent->active = -1;
-		ent->resync = 0;
-		ent->metadata_version = NULL;
-		ent->raid_disks = 0;
+		strcpy(ent->devnm, v->devnm);
+		ent->metadata_version = view_strdup(&v->metadata_version);
+		ent->raid_disks = v->raid_disks;
+		ent->pattern = view_strdup(&v->pattern);
+		ent->level = view_strdup(&v->level);
+		ent->percent = v->percent;
+		ent->active = v->active;
+		ent->resync = v->resync;
 		ent->devcnt = 0;
+		ent->sig = v->sig;
+		ent->bitmap_pages = v->bitmap_pages;
+		ent->bitmap_total = v->bitmap_total;
 		ent->members = NULL;
+		ent->next = NULL;
 
-		strcpy(ent->devnm, devnm);
-
-		for (w=dl_next(line); w!= line ; w=dl_next(w)) {
-			int l = strlen(w);
-			char *eq;
-			if (strcmp(w, "active") == 0)
-				ent->active = 1;
-			else if (strcmp(w, "inactive") == 0) {
-				ent->active = 0;
-				in_devs = 1;
-			} else if (strcmp(w, "bitmap:") == 0) {
-				/* We need to stop parsing here;
-				 * otherwise, ent->raid_disks will be
-				 * overwritten by the wrong value.
+		insert_here = NULL;
+		p = (char *)v->devs.s;
+		devs_end = p + v->devs.len;
+		while (p && p < devs_end &&
+		       (w = next_word(&p, &l, false)) != NULL) {
+			char *ep = memchr(w, '[', l);
+
+			ent->devcnt += add_member_devname(&ent->members, w, l);
+			if (ep && word_starts(w, l, "md")) {
+				/* This has an md device as a component.
+				 * If that device is already in the
+				 * list, make sure we insert before
+				 * there.
 				 */
-				break;
-			} else if (ent->active > 0 &&
-				 ent->level == NULL &&
-				 w[0] != '(' /*readonly*/) {
-				ent->level = xstrdup(w);
-				in_devs = 1;
-			} else if (in_devs && strcmp(w, "blocks") == 0)
-				in_devs = 0;
-			else if (in_devs) {
-				char *ep = strchr(w, '[');
-				ent->devcnt +=
-					add_member_devname(&ent->members, w);
-				if (ep && strncmp(w, "md", 2) == 0) {
-					/* This has an md device as a component.
-					 * If that device is already in the
-					 * list, make sure we insert before
-					 * there.
-					 */
-					struct mdstat_ent **ih;
-					ih = &all;
-					while (ih != insert_here && *ih &&
-					       ((int)strlen((*ih)->devnm) !=
-						ep-w ||
-						strncmp((*ih)->devnm, w,
-							ep-w) != 0))
-						ih = & (*ih)->next;
-					insert_here = ih;
-				}
-			} else if (strcmp(w, "super") == 0 &&
-				   dl_next(w) != line) {
-				w = dl_next(w);
-				ent->metadata_version = xstrdup(w);
-			} else if (w[0] == '[' && isdigit(w[1])) {
-				ent->raid_disks = atoi(w+1);
-			} else if (!ent->pattern &&
-				   w[0] == '[' &&
-				   (w[1] == 'U' || w[1] == '_')) {
-				ent->pattern = xstrdup(w+1);
-				if (ent->pattern[l-2] == ']')
-					ent->pattern[l-2] = '\0';
-			} else if (ent->percent == RESYNC_NONE &&
-				   strncmp(w, "re", 2) == 0 &&
-				   w[l-1] == '%' &&
-				   (eq = strchr(w, '=')) != NULL ) {
-				ent->percent = atoi(eq+1);
-				if (strncmp(w,"resync", 6) == 0)
-					ent->resync = 1;
-				else if (strncmp(w, "reshape", 7) == 0)
-					ent->resync = 2;
-				else
-					ent->resync = 0;
-			} else if (ent->percent == RESYNC_NONE &&
-				   (w[0] == 'r' || w[0] == 'c')) {
-				if (strncmp(w, "resync", 6) == 0)
-					ent->resync = 1;
-				if (strncmp(w, "reshape", 7) == 0)
-					ent->resync = 2;
-				if (strncmp(w, "recovery", 8) == 0)
-					ent->resync = 0;
-				if (strncmp(w, "check", 5) == 0)
-					ent->resync = 3;
-
-				if (l > 8 && strcmp(w+l-8, "=DELAYED") == 0)
-					ent->percent = RESYNC_DELAYED;
-				if (l > 8 && strcmp(w+l-8, "=PENDING") == 0)
-					ent->percent = RESYNC_PENDING;
-				if (l > 7 && strcmp(w+l-7, "=REMOTE") == 0)
-					ent->percent = RESYNC_REMOTE;
-			} else if (ent->percent == RESYNC_NONE &&
-				   w[0] >= '0' &&
-				   w[0] <= '9' &&
-				   w[l-1] == '%') {
-				ent->percent = atoi(w);
+				struct mdstat_ent **ih;
+				ih = &all;
+				while (ih != insert_here && *ih &&
+				       ((int)strlen((*ih)->devnm) !=
+					ep-w ||
+					strncmp((*ih)->devnm, w,
+						ep-w) != 0))
+					ih = & (*ih)->next;
+				insert_here = ih;
 			}
 		}
 		if (insert_here && (*insert_here)) {
@@ -350,14 +600,6 @@ struct mdstat_ent *mdstat_read(int hold, int start)
 			end = &ent->next;
 		}
 	}
-	if (hold && mdstat_fd == -1) {
-		mdstat_fd = dup(fileno(f));
-		if (fcntl(mdstat_fd, F_SETFD, FD_CLOEXEC) < 0) {
-			fclose(f);
-			return NULL;
-		}
-	}
-	fclose(f);
 
 	/* If we might want to start array,
 	 * reverse the order, so that components comes before composites
@@ -375,6 +617,17 @@ struct mdstat_ent *mdstat_read(int hold, int start)
 	return rv;
 }
 
+struct mdstat_ent *mdstat_read(int hold, int start)
+{
+	struct mdstat_scan sc = {0};
+	struct mdstat_ent *rv = NULL;
+
+	if (mdstat_scan(&sc, hold) >= 0)
+		rv = mdstat_scan_ents(&sc, start);
+	mdstat_scan_free(&sc);
+	return rv;
+}
+
 void mdstat_close(void)
 {
 	if (mdstat_fd >= 0)
@@ -446,14 +699,12 @@ void mdstat_wait_fd(int fd, const sigset_t *sigmask)
 
 int mddev_busy(char *devnm)
 {
-	struct mdstat_ent *mdstat = mdstat_read(0, 0);
-	struct mdstat_ent *me;
+	/* callers probe many names in a row, keep the buffer around */
+	static struct mdstat_scan sc;
 
-	for (me = mdstat ; me ; me = me->next)
-		if (strcmp(me->devnm, devnm) == 0)
-			break;
-	free_mdstat(mdstat);
-	return me != NULL;
+	if (mdstat_scan(&sc, 0) < 0)
+		return 0;
+	return mdstat_scan_find(&sc, devnm) != NULL;
 }
 
 /**
@@ -20,6 +20,9 @@ struct mdstat_ent {
 	int active;
 	int resync;		/* 3 if check, 2 if reshape, 1 if resync, 0 if recovery */
 	int devcnt;
+	unsigned int sig;	/* hash of the entry, without resync progress */
+	int bitmap_pages;	/* bitmap pages in use, from the bitmap: line */
+	int bitmap_total;
 
 	struct dev_member {
 		char *name;
@@ -28,6 +31,45 @@ struct mdstat_ent {
 	struct mdstat_ent *next;
 };
 
+/* a string inside the buffer of a &mdstat_scan, not NUL terminated */
+struct mdstat_str {
+	const char *s;
+	int len;
+};
+
+/* one array of a &mdstat_scan, fields as in &mdstat_ent */
+struct mdstat_view {
+	char devnm[32];
+
+	struct mdstat_str metadata_version;
+	int raid_disks;
+	struct mdstat_str pattern;
+	struct mdstat_str level;
+	int percent;
+	int active;
+	int resync;
+	int devcnt;
+	unsigned int sig;
+	int bitmap_pages;
+	int bitmap_total;
+	struct mdstat_str devs;	/* member list as printed, "sdb[1] sda[0]" */
+};
+
+struct mdstat_scan {
+	char *buf;
+	int size;
+	struct mdstat_view *views;
+	int cnt;
+	struct mdstat_view *prev;	/* views of the previous scan */
+	int prev_cnt;
+	int alloc;
+};
+
+int mdstat_scan(struct mdstat_scan *sc, int hold);
+struct mdstat_view *mdstat_scan_find(struct mdstat_scan *sc, char *devnm);
+struct mdstat_ent *mdstat_scan_ents(struct mdstat_scan *sc, int start);
+void mdstat_scan_free(struct mdstat_scan *sc);
+
 struct mdstat_ent *mdstat_find_by_member_name(struct mdstat_ent *mdstat, char *member_devnm);
 struct mdstat_ent *mdstat_by_subdev(char *subdev, char *container);
 struct mdstat_ent *mdstat_by_component(char *name);
@@ -0,0 +1,421 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * Array metrics for "mdadm --monitor".
+ *
+ * While checking an array, Monitor keeps a copy of what it read from
+ * sysfs and mdstat in a struct metrics_array.  After every pass the
+ * arrays are rendered in the Prometheus text format and written to a
+ * snapshot file, which is replaced atomically.  The snapshot is either
+ * the textfile named with "METRICS textfile=...", or a private file that
+ * a small child process hands to anyone connecting to the metrics
+ * socket.  Scraping therefore never causes any sysfs reads.
+ */
+
+#include "mdadm.h"
+#include "metrics.h"
+#include "xmalloc.h"
+
+#include <ctype.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#define METRICS_SNAPSHOT MAP_DIR "/metrics.prom"
+
+static char *snapshot;
+static char *last_text;
+static size_t last_len;
+static pid_t server_pid;
+static bool initialized;
+
+/**
+ * metrics_enabled() - check whether metrics are to be exported.
+ *
+ * Return: true if a METRICS line asks for a socket or a textfile.
+ */
+bool metrics_enabled(void)
+{
+	return conf_get_metrics_socket() || conf_get_metrics_textfile();
+}
+
+/**
+ * metrics_extra_sysfs() - sysfs_read() options needed for metrics.
+ *
+ * Return: options to add to the sysfs_read() done when checking an array.
+ */
+int metrics_extra_sysfs(void)
+{
+	return metrics_enabled() ? GET_ERROR | GET_ARRAY_STATE : 0;
+}
+
+/*
+ * Attributes sysfs_read() has no option for are read through its cache
+ * too, which Monitor keeps open between rounds.
+ */
+static void metrics_read_str(struct mdinfo *sra, char *name, char *buf, int len)
+{
+	if (sysfs_get_str_cached(sra, NULL, name, buf, len) != 0)
+		buf[0] = '\0';
+}
+
+static unsigned int metrics_bad_blocks(struct mdinfo *sra, struct mdinfo *sd)
+{
+	char buf[4097];
+	unsigned int cnt;
+	char *c;
+
+	if (sysfs_get_str_cached(sra, sd, "bad_blocks", buf, sizeof(buf)) != 0 ||
+	    !buf[0])
+		return 0;
+	/* the last newline has been stripped */
+	for (cnt = 1, c = buf; *c; c++)
+		if (*c == '\n')
+			cnt++;
+	return cnt;
+}
+
+/**
+ * metrics_collect() - remember the state of an array for export.
+ * @mp: metrics of the array, allocated on first use
+ * @sra: array as read by check_array(), with GET_DEVS, GET_STATE and
+ *	metrics_extra_sysfs()
+ * @mse: mdstat entry of the array
+ */
+void metrics_collect(struct metrics_array **mp, struct mdinfo *sra,
+		     struct mdstat_ent *mse)
+{
+	struct metrics_array *m = *mp;
+	struct mdinfo *sd;
+	char buf[32];
+	int n;
+
+	if (!m)
+		m = *mp = xcalloc(1, sizeof(*m));
+
+	snprintf(m->devnm, sizeof(m->devnm), "%s", sra->sys_name);
+	snprintf(m->level, sizeof(m->level), "%s",
+		 mse->level ? mse->level : "container");
+	m->raid_disks = sra->array.raid_disks;
+	m->active = sra->array.active_disks;
+	m->working = sra->array.working_disks;
+	m->failed = sra->array.failed_disks;
+	m->spare = sra->array.spare_disks;
+	m->bitmap_pages = mse->bitmap_pages;
+	m->bitmap_total = mse->bitmap_total;
+
+	m->mismatch_cnt = -1;
+	m->sync_action[0] = '\0';
+	m->sync_done = m->sync_total = 0;
+	m->sync_speed = 0;
+	snprintf(m->array_state, sizeof(m->array_state), "%s",
+		 map_num(sysfs_array_states, sra->array_state) ?: "");
+	if (mse->level) {
+		metrics_read_str(sra, "sync_action", m->sync_action,
+				 sizeof(m->sync_action));
+		metrics_read_str(sra, "sync_completed", buf, sizeof(buf));
+		if (isdigit(buf[0]))
+			sscanf(buf, "%llu / %llu", &m->sync_done,
+			       &m->sync_total);
+		metrics_read_str(sra, "sync_speed", buf, sizeof(buf));
+		if (isdigit(buf[0]))
+			m->sync_speed = strtoull(buf, NULL, 10);
+		if (m->sync_action[0])
+			m->mismatch_cnt = sra->mismatch_cnt;
+	}
+
+	n = 0;
+	for (sd = sra->devs; sd; sd = sd->next)
+		n++;
+	free(m->members);
+	m->members = n ? xcalloc(n, sizeof(*m->members)) : NULL;
+	for (n = 0, sd = sra->devs; sd; sd = sd->next, n++) {
+		struct metrics_member *mm = &m->members[n];
+
+		snprintf(mm->name, sizeof(mm->name), "%s",
+			 strncmp(sd->sys_name, "dev-", 4) == 0 ?
+			 sd->sys_name + 4 : sd->sys_name);
+		mm->slot = sd->disk.raid_disk;
+		mm->state = sd->disk.state;
+		mm->errors = sd->errors;
+		mm->bad_blocks = metrics_bad_blocks(sra, sd);
+	}
+	m->nmembers = n;
+}
+
+void metrics_free(struct metrics_array *m)
+{
+	if (!m)
+		return;
+	free(m->members);
+	free(m);
+}
+
+static const char *member_state(struct metrics_member *mm)
+{
+	if (mm->state & (1 << MD_DISK_FAULTY))
+		return "faulty";
+	if (mm->state & (1 << MD_DISK_SYNC))
+		return "in_sync";
+	if (mm->slot >= 0)
+		return "recovering";
+	return "spare";
+}
+
+static void render_header(FILE *f, char *name, char *help)
+{
+	fprintf(f, "# HELP mdadm_%s %s\n", name, help);
+	fprintf(f, "# TYPE mdadm_%s gauge\n", name);
+}
+
+/* one value per array, for values that are always known */
+#define RENDER_ARRAY(f, arrays, cnt, metric, help, fmt, field)		\
+	do {								\
+		int _i;							\
+		render_header(f, metric, help);				\
+		for (_i = 0; _i < cnt; _i++)				\
+			fprintf(f, "mdadm_%s{array=\"%s\"} " fmt "\n",	\
+				metric, arrays[_i]->devnm, arrays[_i]->field); \
+	} while (0)
+
+/* one value per member */
+#define RENDER_MEMBER(f, arrays, cnt, metric, help, field)		\
+	do {								\
+		int _i, _j;						\
+		render_header(f, metric, help);				\
+		for (_i = 0; _i < cnt; _i++)				\
+			for (_j = 0; _j < arrays[_i]->nmembers; _j++)	\
+				fprintf(f, "mdadm_%s{array=\"%s\",member=\"%s\"} %u\n", \
+					metric, arrays[_i]->devnm,	\
+					arrays[_i]->members[_j].name,	\
+					arrays[_i]->members[_j].field);	\
+	} while (0)
+
+static void metrics_render(FILE *f, struct metrics_array **arrays, int cnt)
+{
+	int i, j;
+
+	render_header(f, "array_info", "Array level and state.");
+	for (i = 0; i < cnt; i++)
+		fprintf(f, "mdadm_array_info{array=\"%s\",level=\"%s\",state=\"%s\"} 1\n",
+			arrays[i]->devnm, arrays[i]->level,
+			arrays[i]->array_state);
+
+	RENDER_ARRAY(f, arrays, cnt, "array_raid_disks",
+		     "Number of devices the array is made of.", "%d", raid_disks);
+	RENDER_ARRAY(f, arrays, cnt, "array_active_disks",
+		     "Number of in-sync devices.", "%d", active);
+	RENDER_ARRAY(f, arrays, cnt, "array_working_disks",
+		     "Number of devices that are not faulty.", "%d", working);
+	RENDER_ARRAY(f, arrays, cnt, "array_failed_disks",
+		     "Number of missing or faulty devices.", "%d", failed);
+	RENDER_ARRAY(f, arrays, cnt, "array_spare_disks",
+		     "Number of spare devices.", "%d", spare);
+
+	render_header(f, "array_degraded_disks",
+		      "Number of devices the array is short of.");
+	for (i = 0; i < cnt; i++) {
+		int degraded = arrays[i]->raid_disks - arrays[i]->active;
+
+		if (strcmp(arrays[i]->level, "container") != 0)
+			fprintf(f, "mdadm_array_degraded_disks{array=\"%s\"} %d\n",
+				arrays[i]->devnm, degraded > 0 ? degraded : 0);
+	}
+
+	render_header(f, "array_sync_action", "Current sync action.");
+	for (i = 0; i < cnt; i++)
+		if (arrays[i]->sync_action[0])
+			fprintf(f, "mdadm_array_sync_action{array=\"%s\",action=\"%s\"} 1\n",
+				arrays[i]->devnm, arrays[i]->sync_action);
+
+	RENDER_ARRAY(f, arrays, cnt, "array_sync_completed_sectors",
+		     "Sectors done by the current sync action.", "%llu", sync_done);
+	RENDER_ARRAY(f, arrays, cnt, "array_sync_total_sectors",
+		     "Sectors to do in the current sync action.", "%llu", sync_total);
+	RENDER_ARRAY(f, arrays, cnt, "array_sync_speed_kibibytes",
+		     "Current sync speed in KiB/s.", "%llu", sync_speed);
+
+	render_header(f, "array_mismatch_count",
+		      "Mismatches found by the last check or repair.");
+	for (i = 0; i < cnt; i++)
+		if (arrays[i]->mismatch_cnt >= 0)
+			fprintf(f, "mdadm_array_mismatch_count{array=\"%s\"} %d\n",
+				arrays[i]->devnm, arrays[i]->mismatch_cnt);
+
+	render_header(f, "array_bitmap_pages",
+		      "Write-intent bitmap pages in use.");
+	for (i = 0; i < cnt; i++)
+		if (arrays[i]->bitmap_total)
+			fprintf(f, "mdadm_array_bitmap_pages{array=\"%s\"} %d\n",
+				arrays[i]->devnm, arrays[i]->bitmap_pages);
+	render_header(f, "array_bitmap_pages_total",
+		      "Write-intent bitmap pages.");
+	for (i = 0; i < cnt; i++)
+		if (arrays[i]->bitmap_total)
+			fprintf(f, "mdadm_array_bitmap_pages_total{array=\"%s\"} %d\n",
+				arrays[i]->devnm, arrays[i]->bitmap_total);
+
+	render_header(f, "member_info", "Member slot and state.");
+	for (i = 0; i < cnt; i++)
+		for (j = 0; j < arrays[i]->nmembers; j++) {
+			struct metrics_member *mm = &arrays[i]->members[j];
+
+			fprintf(f, "mdadm_member_info{array=\"%s\",member=\"%s\",slot=\"%d\",state=\"%s\"} 1\n",
+				arrays[i]->devnm, mm->name, mm->slot,
+				member_state(mm));
+		}
+
+	RENDER_MEMBER(f, arrays, cnt, "member_errors",
+		      "Read errors corrected on the member.", errors);
+	RENDER_MEMBER(f, arrays, cnt, "member_bad_blocks",
+		      "Bad block ranges recorded for the member.", bad_blocks);
+}
+
+static void metrics_serve(int sfd)
+{
+	while (1) {
+		char buf[4096];
+		int cfd, fd, n;
+
+		cfd = accept(sfd, NULL, NULL);
+		if (!is_fd_valid(cfd))
+			continue;
+		fd = open(snapshot, O_RDONLY);
+		if (is_fd_valid(fd)) {
+			while ((n = read(fd, buf, sizeof(buf))) > 0)
+				if (write(cfd, buf, n) != n)
+					break;
+			close(fd);
+		}
+		close(cfd);
+	}
+}
+
+static void metrics_start_server(char *path)
+{
+	struct sockaddr_un addr = {.sun_family = AF_UNIX};
+	struct timeval tv = {.tv_sec = 5};
+	int sfd;
+
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		pr_err("metrics socket path too long: %s\n", path);
+		return;
+	}
+	sfd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (!is_fd_valid(sfd))
+		return;
+	strcpy(addr.sun_path, path);
+	unlink(path);
+	if (bind(sfd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+	    listen(sfd, 16) < 0) {
+		pr_err("Cannot listen on %s: %s\n", path, strerror(errno));
+		close(sfd);
+		return;
+	}
+	/* the same information is in /proc/mdstat for everyone to see */
+	chmod(path, 0666);
+
+	server_pid = fork();
+	if (server_pid == 0) {
+		prctl(PR_SET_PDEATHSIG, SIGTERM);
+		if (getppid() == 1)
+			_exit(0);
+		signal_s(SIGPIPE, SIG_IGN);
+		setsockopt(sfd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+		metrics_serve(sfd);
+		_exit(0);
+	}
+	if (server_pid < 0) {
+		pr_err("Cannot fork metrics server: %s\n", strerror(errno));
+		server_pid = 0;
+		unlink(path);
+	}
+	close(sfd);
+}
+
+static void metrics_init(void)
+{
+	char *sock = conf_get_metrics_socket();
+
+	initialized = true;
+	snapshot = conf_get_metrics_textfile();
+	if (!snapshot)
+		snapshot = METRICS_SNAPSHOT;
+	if (sock)
+		metrics_start_server(sock);
+}
+
+/**
+ * metrics_publish() - export the current state of all arrays.
+ * @arrays: arrays that have been checked successfully
+ * @cnt: number of @arrays
+ *
+ * The snapshot is only rewritten if something changed.
+ */
+void metrics_publish(struct metrics_array **arrays, int cnt)
+{
+	char tmp[PATH_MAX];
+	char *text = NULL;
+	size_t len = 0;
+	FILE *f;
+	int fd;
+
+	if (!metrics_enabled())
+		return;
+	if (!initialized)
+		metrics_init();
+
+	f = open_memstream(&text, &len);
+	if (!f)
+		return;
+	metrics_render(f, arrays, cnt);
+	fclose(f);
+
+	if (last_text && len == last_len && memcmp(text, last_text, len) == 0) {
+		free(text);
+		return;
+	}
+
+	snprintf(tmp, sizeof(tmp), "%s.new", snapshot);
+	fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (!is_fd_valid(fd)) {
+		free(text);
+		return;
+	}
+	if (write(fd, text, len) != (ssize_t)len || rename(tmp, snapshot) != 0) {
+		close(fd);
+		unlink(tmp);
+		free(text);
+		return;
+	}
+	close(fd);
+
+	free(last_text);
+	last_text = text;
+	last_len = len;
+}
+
+/**
+ * metrics_close() - stop exporting metrics.
+ *
+ * Removes the socket and the private snapshot behind it.  A textfile
+ * configured by the user is kept with the values of the last pass, so
+ * that the collector reading it does not see the metrics disappear
+ * whenever Monitor restarts.
+ */
+void metrics_close(void)
+{
+	if (!initialized)
+		return;
+	if (server_pid > 0) {
+		kill(server_pid, SIGTERM);
+		waitpid(server_pid, NULL, 0);
+		unlink(conf_get_metrics_socket());
+		server_pid = 0;
+	}
+	if (!conf_get_metrics_textfile())
+		unlink(snapshot);
+	free(last_text);
+	last_text = NULL;
+	initialized = false;
+}
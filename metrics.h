@@ -0,0 +1,49 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+
+#ifndef MONITOR_METRICS_H
+#define MONITOR_METRICS_H
+
+#include "mdstat.h"
+
+struct metrics_member {
+	char name[32];
+	int slot;
+	int state;
+	unsigned int errors;
+	unsigned int bad_blocks;
+};
+
+/**
+ * struct metrics_array - what Monitor last saw of an array.
+ * @devnm: kernel name of the array
+ * @level: personality, "container" for containers
+ * @raid_disks, @active, @working, @failed, @spare: member counts from sysfs
+ * @sync_done, @sync_total: sectors from sync_completed, both 0 if idle
+ * @sync_speed: current sync speed in KiB/s
+ * @mismatch_cnt: last mismatch count, -1 if the level has none
+ * @bitmap_pages, @bitmap_total: in-use and total bitmap pages, total is 0
+ *				 without a bitmap
+ */
+struct metrics_array {
+	char devnm[32];
+	char level[16];
+	char array_state[20];
+	char sync_action[16];
+	int raid_disks, active, working, failed, spare;
+	unsigned long long sync_done, sync_total;
+	unsigned long long sync_speed;
+	int mismatch_cnt;
+	int bitmap_pages, bitmap_total;
+	struct metrics_member *members;
+	int nmembers;
+};
+
+bool metrics_enabled(void);
+int metrics_extra_sysfs(void);
+void metrics_collect(struct metrics_array **mp, struct mdinfo *sra,
+		     struct mdstat_ent *mse);
+void metrics_free(struct metrics_array *m);
+void metrics_publish(struct metrics_array **arrays, int cnt);
+void metrics_close(void);
+
+#endif
@@ -21,7 +21,13 @@
 #include "mdadm.h"
 #include "mdmon.h"
 #include <sys/syscall.h>
-#include <sys/select.h>
+#include <sys/epoll.h>
+
+/* more ready descriptors than this in one wake means "check everything" */
+#define MONITOR_MAX_EVENTS 64
+
+/* how often to look for more changes before writing the metadata */
+#define COALESCE_ROUNDS 4
 
 static char *array_states[] = {
 	"clear", "inactive", "suspended", "readonly", "read-auto",
@@ -35,22 +41,224 @@ enum bb_action {
 	COMPARE_BB,
 };
 
-static void add_fd(fd_set *fds, int *maxfd, int fd)
+static int monitor_epfd = -1;
+
+/**
+ * monitor_init_events() - create the descriptor set the monitor waits on.
+ *
+ * Must be called before the monitor thread starts, the manager registers
+ * descriptors from then on.
+ *
+ * Return: 0 on success, -1 on error.
+ */
+int monitor_init_events(void)
 {
-	struct stat st;
-	if (fd < 0)
-		return;
-	if (fstat(fd, &st) == -1) {
-		dprintf("Invalid fd %d\n", fd);
+	monitor_epfd = epoll_create1(EPOLL_CLOEXEC);
+	return is_fd_valid(monitor_epfd) ? 0 : -1;
+}
+
+/**
+ * monitor_watch_fd() - wake the monitor when a sysfs attribute changes.
+ * @fd: open sysfs attribute.
+ *
+ * sysfs_notify() shows up as EPOLLPRI.  The registration is edge
+ * triggered so attributes the monitor does not read straight away (for
+ * arrays still being set up or torn down) cannot keep it spinning.
+ * Closing @fd drops the registration.
+ */
+void monitor_watch_fd(int fd)
+{
+	struct epoll_event ev = {
+		.events = EPOLLPRI | EPOLLET,
+		.data.fd = fd,
+	};
+
+	if (!is_fd_valid(fd) || !is_fd_valid(monitor_epfd))
 		return;
+	if (epoll_ctl(monitor_epfd, EPOLL_CTL_ADD, fd, &ev) != 0 &&
+	    errno != EEXIST)
+		dprintf("cannot watch fd %d: %s\n", fd, strerror(errno));
+}
+
+static bool fd_is_ready(int fd, int *ready, int nready)
+{
+	int i;
+
+	if (fd < 0)
+		return false;
+	for (i = 0; i < nready; i++)
+		if (ready[i] == fd)
+			return true;
+	return false;
+}
+
+/* Did any descriptor the monitor reads for this array fire? */
+static bool array_is_ready(struct active_array *a, int *ready, int nready)
+{
+	struct mdinfo *mdi;
+
+	if (fd_is_ready(a->info.state_fd, ready, nready) ||
+	    fd_is_ready(a->action_fd, ready, nready) ||
+	    fd_is_ready(a->sync_completed_fd, ready, nready))
+		return true;
+
+	for (mdi = a->info.devs; mdi; mdi = mdi->next) {
+		if (mdi->mon_descriptors_not_used)
+			continue;
+		if (fd_is_ready(mdi->state_fd, ready, nready) ||
+		    fd_is_ready(mdi->bb_fd, ready, nready) ||
+		    fd_is_ready(mdi->ubb_fd, ready, nready))
+			return true;
+	}
+	return false;
+}
+
+/* write_pending handling slower than this goes to wp_slow_log */
+#define WP_SLOW_USEC 100000
+#define WP_SLOW_LOG 16
+
+struct wp_slow_event {
+	struct timespec when;
+	char devnm[MD_NAME_MAX];
+	unsigned long long usec[WP_PHASES];
+};
+
+static struct wp_slow_event wp_slow_log[WP_SLOW_LOG];
+static unsigned int wp_slow_cnt;
+
+static const char * const wp_phases[] = {
+	"dispatch", "metadata", "ack", "total"
+};
+
+/* when the current monitor pass started */
+static struct timespec monitor_wake;
+
+static unsigned long long usec_between(struct timespec *from,
+				       struct timespec *to)
+{
+	long long usec = (to->tv_sec - from->tv_sec) * 1000000LL +
+			 (to->tv_nsec - from->tv_nsec) / 1000;
+
+	return usec > 0 ? usec : 0;
+}
+
+static void wp_record(struct active_array *a, struct timespec *seen,
+		      struct timespec *written, struct timespec *acked)
+{
+	struct wp_latency *lat = &a->wp_latency;
+	unsigned long long usec[WP_PHASES];
+	struct wp_slow_event *ev;
+	int i, b;
+
+	usec[WP_DISPATCH] = usec_between(&monitor_wake, seen);
+	usec[WP_METADATA] = usec_between(seen, written);
+	usec[WP_ACK] = usec_between(written, acked);
+	usec[WP_TOTAL] = usec_between(&monitor_wake, acked);
+
+	lat->events++;
+	for (i = 0; i < WP_PHASES; i++) {
+		lat->sum[i] += usec[i];
+		if (usec[i] > lat->max[i])
+			lat->max[i] = usec[i];
 	}
-	if (st.st_nlink == 0) {
-		dprintf("fd %d was deleted\n", fd);
+	for (b = 0; b < WP_HIST_BUCKETS - 1; b++)
+		if (usec[WP_TOTAL] < 16ULL << b)
+			break;
+	lat->hist[b]++;
+
+	if (usec[WP_TOTAL] < WP_SLOW_USEC)
 		return;
+
+	lat->slow++;
+	ev = &wp_slow_log[wp_slow_cnt % WP_SLOW_LOG];
+	clock_gettime(CLOCK_REALTIME, &ev->when);
+	snprintf(ev->devnm, sizeof(ev->devnm), "%s", a->info.sys_name);
+	memcpy(ev->usec, usec, sizeof(usec));
+	wp_slow_cnt++;
+	dprintf("%s: write_pending took %lluus (dispatch %llu metadata %llu ack %llu)\n",
+		a->info.sys_name, usec[WP_TOTAL], usec[WP_DISPATCH],
+		usec[WP_METADATA], usec[WP_ACK]);
+}
+
+/* upper bound of the histogram bucket holding the pct percentile */
+static unsigned long long wp_percentile(struct wp_latency *lat, int pct)
+{
+	unsigned long long rank = (lat->events * pct + 99) / 100;
+	unsigned long long seen = 0;
+	int b;
+
+	for (b = 0; b < WP_HIST_BUCKETS - 1; b++) {
+		seen += lat->hist[b];
+		if (seen >= rank)
+			return 16ULL << b;
 	}
-	if (fd > *maxfd)
-		*maxfd = fd;
-	FD_SET(fd, fds);
+	return lat->max[WP_TOTAL];
+}
+
+/**
+ * monitor_latency_report() - describe write_pending handling times.
+ * @container: container whose arrays to report.
+ * @len: set to the length of the report, including the terminating nul.
+ *
+ * Called by the manager.  The counters are updated by the monitor without
+ * locking, so a report taken while an event is being recorded may be
+ * off by that one event.
+ *
+ * Return: the report, to be freed by the caller, or NULL on error.
+ */
+char *monitor_latency_report(struct supertype *container, int *len)
+{
+	struct active_array *a;
+	unsigned int i, first;
+	char *buf = NULL;
+	size_t size = 0;
+	FILE *f;
+	int p, b;
+
+	f = open_memstream(&buf, &size);
+	if (!f)
+		return NULL;
+
+	for (a = container->arrays; a; a = a->next) {
+		struct wp_latency *lat = &a->wp_latency;
+		const char *name = a->info.sys_name;
+
+		fprintf(f, "%s events=%llu slow=%llu\n",
+			name, lat->events, lat->slow);
+		fprintf(f, "%s safe_mode_delay_ms=%lu changes=%llu\n",
+			name, a->info.safe_mode_delay, a->safe_mode_changes);
+		for (p = 0; p < WP_PHASES; p++)
+			fprintf(f, "%s %s avg_us=%llu max_us=%llu\n",
+				name, wp_phases[p],
+				lat->events ? lat->sum[p] / lat->events : 0,
+				lat->max[p]);
+		if (lat->events)
+			fprintf(f, "%s percentile p50_us=%llu p99_us=%llu\n", name,
+				wp_percentile(lat, 50), wp_percentile(lat, 99));
+		fprintf(f, "%s histogram_us", name);
+		for (b = 0; b < WP_HIST_BUCKETS - 1; b++)
+			fprintf(f, " <%llu:%llu", 16ULL << b, lat->hist[b]);
+		fprintf(f, " >=%llu:%llu\n", 16ULL << (WP_HIST_BUCKETS - 2),
+			lat->hist[WP_HIST_BUCKETS - 1]);
+	}
+
+	first = wp_slow_cnt > WP_SLOW_LOG ? wp_slow_cnt - WP_SLOW_LOG : 0;
+	for (i = first; i < wp_slow_cnt; i++) {
+		struct wp_slow_event *ev = &wp_slow_log[i % WP_SLOW_LOG];
+
+		fprintf(f, "slow %lld.%06ld %.*s", (long long)ev->when.tv_sec,
+			ev->when.tv_nsec / 1000, MD_NAME_MAX - 1, ev->devnm);
+		for (p = 0; p < WP_PHASES; p++)
+			fprintf(f, " %s_us=%llu", wp_phases[p], ev->usec[p]);
+		fprintf(f, "\n");
+	}
+
+	if (fclose(f) != 0) {
+		free(buf);
+		return NULL;
+	}
+	*len = size + 1;
+	return buf;
 }
 
 static int read_attr(char *buf, int len, int fd)
@@ -382,12 +590,13 @@ static void signal_manager(void)
  *
  * We wait for a change (poll/select) on array_state, sync_action, and
  * each rd-X/state file.
- * When we get any change, we check everything.  So read each state file,
- * then decide what to do.
+ * When we get any change, we check the arrays it concerns.  So read each
+ * state file, then decide what to do.
  *
- * The core action is to write new metadata to all devices in the array.
- * This is done at most once on any wakeup.
- * After that we might:
+ * The core action is to write new metadata to all devices in the
+ * container.  This is done at most once on any wakeup, covering every
+ * array looked at during it, see wait_and_act().
+ * After that carry_out() might:
  *   - update the array_state
  *   - set the role of some devices.
  *   - request a sync_action
@@ -396,10 +605,10 @@ static void signal_manager(void)
 
 #define ARRAY_DIRTY 1
 #define ARRAY_BUSY 2
-static int read_and_act(struct active_array *a)
+static int read_and_decide(struct active_array *a)
 {
+	struct array_decision *d = &a->decision;
 	unsigned long long sync_completed;
-	bool disks_to_remove = false;
 	bool check_degraded = false;
 	bool check_reshape = false;
 	int deactivate = 0;
@@ -408,6 +617,7 @@ static int read_and_act(struct active_array *a)
 	int count = 0;
 	bool write_checkpoint = false;
 
+	memset(d, 0, sizeof(*d));
 	a->next_state = bad_word;
 	a->next_action = bad_action;
 
@@ -469,6 +679,8 @@ static int read_and_act(struct active_array *a)
 		deactivate = 1;
 	}
 	if (a->curr_state == write_pending) {
+		clock_gettime(CLOCK_MONOTONIC, &d->write_pending_seen);
+		d->write_pending = true;
 		a->container->ss->set_array_state(a, 0);
 		a->next_state = active;
 		ret |= ARRAY_DIRTY;
@@ -603,7 +815,57 @@ static int read_and_act(struct active_array *a)
 	if (sync_completed >= a->info.component_size)
 		a->last_checkpoint = 0;
 
-	a->container->ss->sync_metadata(a->container);
+	d->pending = true;
+	d->dirty = ret & ARRAY_DIRTY;
+	d->deactivate = deactivate;
+	d->check_degraded = check_degraded;
+	d->check_reshape = check_reshape;
+
+	return ret;
+}
+
+/*
+ * Every clean to write_pending round trip costs two metadata writes and
+ * blocks a write.  If the array was clean for less than safe_mode_delay,
+ * waiting longer would have avoided that, so double the delay.  After a
+ * long idle spell halve it again, so idle arrays get marked clean soon.
+ */
+static void adapt_safe_mode(struct active_array *a, struct timespec *now)
+{
+	unsigned long delay = a->info.safe_mode_delay;
+	unsigned long long idle_ms;
+	char buf[30];
+
+	if (!a->safe_mode_max || sigterm || !a->clean_since.tv_sec ||
+	    !is_fd_valid(a->safe_mode_delay_fd))
+		return;
+
+	idle_ms = usec_between(&a->clean_since, now) / 1000;
+	a->clean_since.tv_sec = 0;
+	if (idle_ms < delay)
+		delay = min(delay * 2, a->safe_mode_max);
+	else if (idle_ms > 8ULL * delay)
+		delay = max(delay / 2, a->safe_mode_min);
+	if (delay == a->info.safe_mode_delay)
+		return;
+
+	snprintf(buf, sizeof(buf), "%lu.%03lu", delay / 1000, delay % 1000);
+	if (write_attr(buf, a->safe_mode_delay_fd) != MDADM_STATUS_SUCCESS)
+		return;
+	dprintf("%s: safe_mode_delay %lums -> %lums after %llums clean\n",
+		a->info.sys_name, a->info.safe_mode_delay, delay, idle_ms);
+	a->info.safe_mode_delay = delay;
+	a->safe_mode_changes++;
+}
+
+/* Apply what read_and_decide() chose, the metadata is already written */
+static void carry_out(struct active_array *a, struct timespec *written)
+{
+	struct array_decision *d = &a->decision;
+	bool disks_to_remove = false;
+	struct mdinfo *mdi;
+
+	d->pending = false;
 	dprintf("(%d): state:%s action:%s next(", a->info.container_member,
 		array_states[a->curr_state], sync_actions[a->curr_action]);
 
@@ -612,6 +874,15 @@ static int read_and_act(struct active_array *a)
 		dprintf_cont(" state:%s", array_states[a->next_state]);
 		write_attr(array_states[a->next_state], a->info.state_fd);
 	}
+	if (a->next_state == clean)
+		clock_gettime(CLOCK_MONOTONIC, &a->clean_since);
+	if (d->write_pending) {
+		struct timespec acked;
+
+		clock_gettime(CLOCK_MONOTONIC, &acked);
+		wp_record(a, &d->write_pending_seen, written, &acked);
+		adapt_safe_mode(a, &acked);
+	}
 	if (a->next_action != bad_action) {
 		write_attr(sync_actions[a->next_action], a->action_fd);
 		dprintf_cont(" action:%s", sync_actions[a->next_action]);
@@ -643,18 +914,16 @@ static int read_and_act(struct active_array *a)
 	for (mdi = a->info.devs; mdi ; mdi = mdi->next)
 		mdi->prev_state = mdi->curr_state;
 
-	if (check_degraded || check_reshape || disks_to_remove) {
+	if (d->check_degraded || d->check_reshape || disks_to_remove) {
 
 		a->check_member_remove |= disks_to_remove;
-		a->check_degraded |= check_degraded;
-		a->check_reshape |= check_reshape;
+		a->check_degraded |= d->check_degraded;
+		a->check_reshape |= d->check_reshape;
 		signal_manager();
 	}
 
-	if (deactivate)
+	if (d->deactivate)
 		a->container = NULL;
-
-	return ret;
 }
 
 static struct mdinfo *
@@ -687,30 +956,27 @@ static void reconcile_failed(struct active_array *aa, struct mdinfo *failed)
 }
 
 #ifdef DEBUG
-static void dprint_wake_reasons(fd_set *fds)
+static void dprint_wake_reasons(int *ready, int nready)
 {
-	int i;
+	int i, fd;
 	char proc_path[256];
 	char link[256];
 	char *basename;
 	int rv;
 
 	fprintf(stderr, "monitor: wake ( ");
-	for (i = 0; i < FD_SETSIZE; i++) {
-		if (FD_ISSET(i, fds)) {
-			sprintf(proc_path, "/proc/%d/fd/%d",
-				(int) getpid(), i);
-
-			rv = readlink(proc_path, link, sizeof(link) - 1);
-			if (rv < 0) {
-				fprintf(stderr, "%d:unknown ", i);
-				continue;
-			}
-			link[rv] = '\0';
-			basename = strrchr(link, '/');
-			fprintf(stderr, "%d:%s ",
-				i, basename ? ++basename : link);
+	for (i = 0; i < nready; i++) {
+		fd = ready[i];
+		sprintf(proc_path, "/proc/%d/fd/%d", (int) getpid(), fd);
+
+		rv = readlink(proc_path, link, sizeof(link) - 1);
+		if (rv < 0) {
+			fprintf(stderr, "%d:unknown ", fd);
+			continue;
 		}
+		link[rv] = '\0';
+		basename = strrchr(link, '/');
+		fprintf(stderr, "%d:%s ", fd, basename ? ++basename : link);
 	}
 	fprintf(stderr, ")\n");
 }
@@ -718,15 +984,74 @@ static void dprint_wake_reasons(fd_set *fds)
 
 int monitor_loop_cnt;
 
+/* changes seen while coalescing, for arrays that were already decided */
+static int carried[MONITOR_MAX_EVENTS];
+static int ncarried;
+static bool carry_lost;
+
+static void decide(struct supertype *container, struct active_array *a,
+		   unsigned int *dirty_arrays)
+{
+	int ret = read_and_decide(a);
+
+	*dirty_arrays += !!(ret & ARRAY_DIRTY);
+	if (ret & ARRAY_BUSY)
+		container->retry_soon = 1;
+}
+
+/*
+ * Pick up attribute changes that arrived while the woken arrays were
+ * read, so that their metadata changes share one write.  This adds no
+ * delay: it only takes what is already pending.  A change for an array
+ * already decided in this pass is kept for the next pass.
+ */
+static void coalesce(struct supertype *container, unsigned int *dirty_arrays)
+{
+	struct epoll_event events[MONITOR_MAX_EVENTS];
+	int more[MONITOR_MAX_EVENTS];
+	struct active_array *a;
+	int round, n, i;
+
+	for (round = 0; round < COALESCE_ROUNDS; round++) {
+		bool carry = false;
+
+		n = epoll_wait(monitor_epfd, events, MONITOR_MAX_EVENTS, 0);
+		if (n <= 0)
+			break;
+		for (i = 0; i < n; i++)
+			more[i] = events[i].data.fd;
+
+		for (a = container->arrays; a; a = a->next) {
+			if (!a->container || a->to_remove ||
+			    !array_is_ready(a, more, n))
+				continue;
+			if (a->decision.pending)
+				carry = true;
+			else
+				decide(container, a, dirty_arrays);
+		}
+
+		if (!carry)
+			continue;
+		if (ncarried + n > MONITOR_MAX_EVENTS) {
+			carry_lost = true;
+			continue;
+		}
+		memcpy(carried + ncarried, more, n * sizeof(int));
+		ncarried += n;
+	}
+}
+
 static int wait_and_act(struct supertype *container, int nowait)
 {
 	struct active_array *a, **ap, **aap = &container->arrays;
 	static unsigned int dirty_arrays = ~0; /* start at some non-zero value */
+	struct epoll_event events[MONITOR_MAX_EVENTS];
+	int ready[2 * MONITOR_MAX_EVENTS];
+	int nready = 0;
+	bool check_all = true;
 	struct mdinfo *mdi;
-	int rv, maxfd = 0;
-	fd_set rfds;
-
-	FD_ZERO(&rfds);
+	int rv, i;
 
 	for (ap = aap ; *ap ;) {
 		a = *ap;
@@ -745,10 +1070,6 @@ static int wait_and_act(struct supertype *container, int nowait)
 			continue;
 		}
 
-		add_fd(&rfds, &maxfd, a->info.state_fd);
-		add_fd(&rfds, &maxfd, a->action_fd);
-		add_fd(&rfds, &maxfd, a->sync_completed_fd);
-
 		for (mdi = a->info.devs ; mdi ; mdi = mdi->next) {
 			if (mdi->man_disk_to_remove) {
 				mdi->mon_descriptors_not_used = true;
@@ -757,12 +1078,7 @@ static int wait_and_act(struct supertype *container, int nowait)
 				 * Monitor must respond if any badblock is recorded in this time.
 				 */
 				container->retry_soon = 1;
-				continue;
 			}
-
-			add_fd(&rfds, &maxfd, mdi->state_fd);
-			add_fd(&rfds, &maxfd, mdi->bb_fd);
-			add_fd(&rfds, &maxfd, mdi->ubb_fd);
 		}
 
 		ap = &(*ap)->next;
@@ -798,40 +1114,61 @@ static int wait_and_act(struct supertype *container, int nowait)
 		}
 	}
 
-	if (!nowait) {
+	if (nowait) {
+		clock_gettime(CLOCK_MONOTONIC, &monitor_wake);
+	} else {
 		sigset_t set;
-		struct timespec ts;
-		ts.tv_sec = 24*3600;
-		ts.tv_nsec = 0;
-		if (*aap == NULL || container->retry_soon) {
+		int timeout = 24*3600*1000;
+		bool retry = container->retry_soon || carry_lost;
+		int was_carried = ncarried;
+
+		if (*aap == NULL || retry)
 			/* just waiting to get O_EXCL access */
-			ts.tv_sec = 0;
-			ts.tv_nsec = 20000000ULL;
+			timeout = 20;
+		if (ncarried) {
+			/* left over from the last pass, don't sleep */
+			memcpy(ready, carried, ncarried * sizeof(int));
+			nready = ncarried;
+			ncarried = 0;
+			timeout = 0;
 		}
+		carry_lost = false;
 		sigprocmask(SIG_UNBLOCK, NULL, &set);
 		sigdelset(&set, SIGUSR1);
 		monitor_loop_cnt |= 1;
-		rv = pselect(maxfd+1, NULL, NULL, &rfds, &ts, &set);
+		rv = epoll_pwait(monitor_epfd, events, MONITOR_MAX_EVENTS,
+				 timeout, &set);
 		monitor_loop_cnt += 1;
+		clock_gettime(CLOCK_MONOTONIC, &monitor_wake);
 		if (rv == -1) {
-			if (errno == EINTR) {
-				rv = 0;
-				FD_ZERO(&rfds);
+			if (errno == EINTR)
 				dprintf("monitor: caught signal\n");
-			} else
-				dprintf("monitor: error %d in pselect\n",
+			else
+				dprintf("monitor: error %d in epoll_pwait\n",
 					errno);
+		} else {
+			for (i = 0; i < rv; i++)
+				ready[nready++] = events[i].data.fd;
+			#ifdef DEBUG
+			dprint_wake_reasons(ready, nready);
+			#endif
 		}
-		#ifdef DEBUG
-		else
-			dprint_wake_reasons(&rfds);
-		#endif
 		container->retry_soon = 0;
+
+		/* Only attribute changes woke us: look at just those
+		 * arrays.  Signals (new arrays, replacements, requests
+		 * from the manager), timeouts and retries still look at
+		 * everything.
+		 */
+		check_all = rv < 0 || (rv == 0 && !was_carried) ||
+			    rv == MONITOR_MAX_EVENTS || retry || sigterm;
 	}
 
 	if (update_queue) {
 		struct metadata_update *this;
 
+		check_all = true;
+
 		for (this = update_queue; this ; this = this->next)
 			container->ss->process_update(container, this);
 
@@ -842,7 +1179,11 @@ static int wait_and_act(struct supertype *container, int nowait)
 	}
 
 	rv = 0;
-	dirty_arrays = 0;
+	/* a partial pass can only add to the count, the next full pass
+	 * (every pass once sigterm is set) makes it exact again
+	 */
+	if (check_all)
+		dirty_arrays = 0;
 	for (a = *aap; a ; a = a->next) {
 
 		if (a->replaces && !discard_this) {
@@ -857,19 +1198,33 @@ static int wait_and_act(struct supertype *container, int nowait)
 			/* FIXME check if device->state_fd need to be cleared?*/
 			signal_manager();
 		}
-		if (a->container && !a->to_remove) {
-			int ret = read_and_act(a);
+		if (a->container && !a->to_remove &&
+		    (check_all || array_is_ready(a, ready, nready))) {
+			decide(container, a, &dirty_arrays);
+			rv = 1;
+		}
+	}
+	if (rv && !check_all)
+		coalesce(container, &dirty_arrays);
+
+	/* One metadata write covers every array decided above.  Only then
+	 * may their new array_state be acknowledged.
+	 */
+	if (rv) {
+		struct timespec written;
 
-			rv |= 1;
-			dirty_arrays += !!(ret & ARRAY_DIRTY);
+		container->ss->sync_metadata(container);
+		clock_gettime(CLOCK_MONOTONIC, &written);
+		for (a = *aap; a ; a = a->next) {
+			if (!a->decision.pending)
+				continue;
+			carry_out(a, &written);
 			/* when terminating stop manipulating the array after it
-			 * is clean, but make sure read_and_act() is given a
+			 * is clean, but make sure read_and_decide() is given a
 			 * chance to handle 'active_idle'
 			 */
-			if (sigterm && !(ret & ARRAY_DIRTY))
+			if (sigterm && !a->decision.dirty)
 				a->container = NULL; /* stop touching this array */
-			if (ret & ARRAY_BUSY)
-				container->retry_soon = 1;
 		}
 	}
 
@@ -224,6 +224,22 @@ int ping_monitor(char *devname)
 	return err;
 }
 
+/* what the mdmon last pinged can do, see mdmon_has_capability() */
+static char caps_devname[64];
+static char caps[256];
+static bool caps_known;
+
+static void remember_caps(char *devname, char *reply, int len)
+{
+	char *c = memchr(reply, '\0', len);
+
+	snprintf(caps_devname, sizeof(caps_devname), "%s", devname);
+	caps[0] = '\0';
+	if (c && reply[len - 1] == '\0')
+		snprintf(caps, sizeof(caps), "%s", c + 1);
+	caps_known = true;
+}
+
 static char *ping_monitor_version(char *devname)
 {
 	int sfd = connect_monitor(devname);
@@ -243,6 +259,123 @@ static char *ping_monitor_version(char *devname)
 
 	if (err || !msg.len || !msg.buf)
 		return NULL;
+	remember_caps(devname, msg.buf, msg.len);
+	return msg.buf;
+}
+
+/**
+ * mdmon_has_capability() - check whether the running mdmon knows a request.
+ * @container: container the mdmon instance manages.
+ * @cap: capability name, see MDMON_CAPS.
+ *
+ * mdmon answers a ping with its version string.  Newer instances follow
+ * the terminating nul with a space separated list of capabilities, which
+ * older clients never look at.  The answer is remembered, so after
+ * check_mdmon_version() this costs nothing.
+ *
+ * Return: true if mdmon is running and lists @cap.
+ */
+bool mdmon_has_capability(char *container, const char *cap)
+{
+	int caplen = strlen(cap);
+	char *c;
+
+	if (!caps_known || strcmp(caps_devname, container) != 0) {
+		char *version = ping_monitor_version(container);
+
+		if (!version)
+			return false;
+		free(version);
+	}
+
+	for (c = caps; *c; c += strcspn(c, " ")) {
+		c += strspn(c, " ");
+		if (strncmp(c, cap, caplen) == 0 &&
+		    (c[caplen] == ' ' || c[caplen] == '\0'))
+			return true;
+	}
+	return false;
+}
+
+/**
+ * send_update_batch() - send several metadata updates in one message.
+ * @fd: connection to mdmon.
+ * @updates: list of updates to send.
+ * @tmo: timeout in seconds.
+ *
+ * The message holds MSG_BATCH_MAGIC, the number of updates, then each
+ * update as its length followed by its bytes, all words in host order.
+ * mdmon queues all of them for a single pass of the monitor and replies
+ * once that pass has written the metadata.  Only send this to an mdmon
+ * that lists "batch" in its capabilities.
+ *
+ * Return: 0 on success, -1 on error or if the batch is too large.
+ */
+int send_update_batch(int fd, struct metadata_update *updates, int tmo)
+{
+	__u32 hdr[2] = { MSG_BATCH_MAGIC, 0 };
+	struct metadata_update msg;
+	struct metadata_update *mu;
+	long long len = sizeof(hdr);
+	char *p;
+	int rv;
+
+	for (mu = updates; mu; mu = mu->next) {
+		len += sizeof(__u32) + mu->len;
+		hdr[1]++;
+	}
+	if (len > MSG_MAX_LEN)
+		return -1;
+
+	msg.len = len;
+	msg.buf = xmalloc(len);
+	memcpy(msg.buf, hdr, sizeof(hdr));
+	p = msg.buf + sizeof(hdr);
+	for (mu = updates; mu; mu = mu->next) {
+		__u32 ulen = mu->len;
+
+		memcpy(p, &ulen, sizeof(ulen));
+		p += sizeof(ulen);
+		memcpy(p, mu->buf, mu->len);
+		p += mu->len;
+	}
+
+	rv = send_message(fd, &msg, tmo);
+	free(msg.buf);
+	return rv;
+}
+
+/**
+ * mdmon_latency_report() - fetch write_pending timings from mdmon.
+ * @container: container the mdmon instance manages.
+ *
+ * Return: the text report, to be freed by the caller, or NULL if mdmon
+ * is not running, too old, or did not answer.
+ */
+char *mdmon_latency_report(char *container)
+{
+	struct metadata_update msg = { .len = MSG_LATENCY_REPORT };
+	int sfd;
+
+	if (!mdmon_has_capability(container, "latency"))
+		return NULL;
+
+	sfd = connect_monitor(container);
+	if (sfd < 0)
+		return NULL;
+
+	msg.buf = NULL;
+	if (send_message(sfd, &msg, 20) != 0 ||
+	    receive_message(sfd, &msg, 20) != 0) {
+		close(sfd);
+		return NULL;
+	}
+	close(sfd);
+
+	if (msg.len <= 0 || !msg.buf || msg.buf[msg.len - 1] != '\0') {
+		free(msg.buf);
+		return NULL;
+	}
 	return msg.buf;
 }
 
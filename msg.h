@@ -33,5 +33,20 @@ extern void unblock_monitor(char *container, const int unfreeze);
 extern int fping_monitor(int sock);
 extern int ping_manager(char *devname);
 extern void flush_mdmon(char *container);
+extern bool mdmon_has_capability(char *container, const char *cap);
+extern int send_update_batch(int fd, struct metadata_update *updates, int tmo);
+extern char *mdmon_latency_report(char *container);
 
 #define MSG_MAX_LEN (4*1024*1024)
+
+/* message length asking mdmon for its write_pending latency report */
+#define MSG_LATENCY_REPORT (-2)
+
+/* First word of a message carrying several metadata updates.  Single
+ * updates start with an IMSM update type, a small number, or a DDF
+ * section magic, neither of which can look like this.
+ */
+#define MSG_BATCH_MAGIC 0x4d444254
+
+/* what mdmon lists after its version in a ping reply */
+#define MDMON_CAPS "latency batch"
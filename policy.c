@@ -191,38 +191,145 @@ struct dev_policy *pol_find(struct dev_policy *pol, char *name)
 	return pol;
 }
 
-static char **disk_paths(struct mdinfo *disk)
+/*
+ * Reverse index of /dev/disk/by-path.
+ * Looking up the paths of a single device used to require a readdir()
+ * and a stat() of every link, which made policy evaluation of many
+ * devices quadratic.  Instead the directory is scanned once and the
+ * links are kept sorted by the device they point to.
+ * The index stays valid until policy_paths_invalidate() is called, which
+ * long-running callers (Monitor) do when udev reports a change.  A device
+ * missing from the index makes it rescan, but only if the directory
+ * changed since, so a new disk is found without a rescan per lookup.
+ */
+struct path_ent {
+	dev_t devid;
+	char *name;
+};
+
+static struct path_ent *path_index;
+static int path_index_cnt;
+static int path_index_valid;
+static struct timespec path_index_mtime;
+
+static int path_ent_cmp(const void *a, const void *b)
 {
+	const struct path_ent *pa = a, *pb = b;
+
+	if (pa->devid != pb->devid)
+		return pa->devid < pb->devid ? -1 : 1;
+	return strcmp(pa->name, pb->name);
+}
+
+static void path_index_load(void)
+{
+	char symlink[PATH_MAX] = "/dev/disk/by-path/";
+	struct dirent *ent;
 	struct stat stb;
 	int prefix_len;
+	int alloc = 0;
 	DIR *by_path;
-	char symlink[PATH_MAX] = "/dev/disk/by-path/";
-	char **paths;
-	int cnt = 0;
-	struct dirent *ent;
 
-	paths = xmalloc(sizeof(*paths) * (cnt+1));
+	path_index_valid = 1;
+	if (stat(symlink, &stb) == 0)
+		path_index_mtime = stb.st_mtim;
 
 	by_path = opendir(symlink);
-	if (by_path) {
-		prefix_len = strlen(symlink);
-		while ((ent = readdir(by_path)) != NULL) {
-			if (ent->d_type != DT_LNK)
-				continue;
-			strncpy(symlink + prefix_len,
-					ent->d_name,
-					sizeof(symlink) - prefix_len);
-			if (stat(symlink, &stb) < 0)
-				continue;
-			if ((stb.st_mode & S_IFMT) != S_IFBLK)
-				continue;
-			if (stb.st_rdev != makedev(disk->disk.major, disk->disk.minor))
-				continue;
-			paths[cnt++] = xstrdup(ent->d_name);
-			paths = xrealloc(paths, sizeof(*paths) * (cnt+1));
+	if (!by_path)
+		return;
+
+	prefix_len = strlen(symlink);
+	while ((ent = readdir(by_path)) != NULL) {
+		if (ent->d_type != DT_LNK)
+			continue;
+		strncpy(symlink + prefix_len, ent->d_name,
+			sizeof(symlink) - prefix_len);
+		if (stat(symlink, &stb) < 0)
+			continue;
+		if ((stb.st_mode & S_IFMT) != S_IFBLK)
+			continue;
+		if (path_index_cnt == alloc) {
+			alloc = alloc ? alloc * 2 : 64;
+			path_index = xrealloc(path_index,
+					      sizeof(*path_index) * alloc);
 		}
-		closedir(by_path);
+		path_index[path_index_cnt].devid = stb.st_rdev;
+		path_index[path_index_cnt].name = xstrdup(ent->d_name);
+		path_index_cnt++;
+	}
+	closedir(by_path);
+
+	if (path_index_cnt)
+		qsort(path_index, path_index_cnt, sizeof(*path_index),
+		      path_ent_cmp);
+}
+
+static void path_index_free(void)
+{
+	int i;
+
+	for (i = 0; i < path_index_cnt; i++)
+		free(path_index[i].name);
+	free(path_index);
+	path_index = NULL;
+	path_index_cnt = 0;
+	path_index_valid = 0;
+}
+
+/* has a link been added or removed since the index was loaded? */
+static bool path_index_stale(void)
+{
+	struct stat stb;
+
+	if (stat("/dev/disk/by-path/", &stb) != 0)
+		return path_index_cnt != 0;
+	return stb.st_mtim.tv_sec != path_index_mtime.tv_sec ||
+	       stb.st_mtim.tv_nsec != path_index_mtime.tv_nsec;
+}
+
+/* index of the first entry for @devid, or of where it would be */
+static int path_index_find(dev_t devid)
+{
+	int lo = 0, hi = path_index_cnt;
+
+	while (lo < hi) {
+		int mid = lo + (hi - lo) / 2;
+
+		if (path_index[mid].devid < devid)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+static char **disk_paths(struct mdinfo *disk)
+{
+	dev_t devid = makedev(disk->disk.major, disk->disk.minor);
+	bool loaded = false;
+	char **paths;
+	int cnt = 0;
+	int lo, hi;
+
+	if (!path_index_valid) {
+		path_index_load();
+		loaded = true;
+	}
+
+	lo = path_index_find(devid);
+	if (!loaded && (lo == path_index_cnt || path_index[lo].devid != devid) &&
+	    path_index_stale()) {
+		/* possibly a disk that appeared after the scan */
+		path_index_free();
+		path_index_load();
+		lo = path_index_find(devid);
 	}
+	for (hi = lo; hi < path_index_cnt && path_index[hi].devid == devid; hi++)
+		;
+
+	paths = xmalloc(sizeof(*paths) * (hi - lo + 1));
+	for (; lo < hi; lo++)
+		paths[cnt++] = xstrdup(path_index[lo].name);
 	paths[cnt] = NULL;
 	return paths;
 }
@@ -500,23 +607,91 @@ static void free_paths(char **paths)
 	free(paths);
 }
 
+/*
+ * Results of path_policy() are remembered per device, so that repeated
+ * domain and spare decisions about the same device don't have to match
+ * every rule again.  Entries reference strings owned by the config rules,
+ * so the cache is dropped whenever the rules change, and together with
+ * the by-path index when the device topology may have changed.
+ */
+#define POL_CACHE_SIZE 256
+
+struct pol_cache_ent {
+	struct pol_cache_ent *next;
+	dev_t devid;
+	struct dev_policy *pol;
+};
+
+static struct pol_cache_ent *pol_cache[POL_CACHE_SIZE];
+
+static struct dev_policy *pol_dup(struct dev_policy *pol)
+{
+	struct dev_policy *head = NULL, **tail = &head;
+
+	for (; pol; pol = pol->next) {
+		struct dev_policy *n = xmalloc(sizeof(*n));
+
+		*n = *pol;
+		n->next = NULL;
+		*tail = n;
+		tail = &n->next;
+	}
+	return head;
+}
+
+static void pol_cache_free(void)
+{
+	int i;
+
+	for (i = 0; i < POL_CACHE_SIZE; i++)
+		while (pol_cache[i]) {
+			struct pol_cache_ent *e = pol_cache[i];
+
+			pol_cache[i] = e->next;
+			dev_policy_free(e->pol);
+			free(e);
+		}
+}
+
+/**
+ * policy_paths_invalidate() - forget cached device paths and policies.
+ *
+ * Must be called when devices may have been added or removed, so that
+ * /dev/disk/by-path is scanned again on the next policy lookup.
+ */
+void policy_paths_invalidate(void)
+{
+	path_index_free();
+	pol_cache_free();
+}
+
 /*
  * disk_policy() gathers policy information for the
  * disk described in the given mdinfo (disk.{major,minor}).
+ * The caller owns the returned list.
  */
 struct dev_policy *disk_policy(struct mdinfo *disk)
 {
+	dev_t devid = makedev(disk->disk.major, disk->disk.minor);
+	unsigned int hash = (major(devid) * 31 + minor(devid)) % POL_CACHE_SIZE;
+	struct pol_cache_ent *e;
 	char **paths = NULL;
-	char *type = disk_type(disk);
-	struct dev_policy *pol = NULL;
+
+	for (e = pol_cache[hash]; e; e = e->next)
+		if (e->devid == devid)
+			return pol_dup(e->pol);
 
 	if (config_rules_has_path)
 		paths = disk_paths(disk);
 
-	pol = path_policy(paths, type);
+	e = xmalloc(sizeof(*e));
+	e->devid = devid;
+	e->pol = path_policy(paths, disk_type(disk));
+	e->next = pol_cache[hash];
+	pol_cache[hash] = e;
 
 	free_paths(paths);
-	return pol;
+	return pol_dup(e->pol);
 }
 
 struct dev_policy *devid_policy(int dev)
@@ -582,6 +757,7 @@ void policyline(char *line, char *type)
 	}
 	pr->next = config_rules;
 	config_rules = pr;
+	pol_cache_free();
 }
 
 void policy_add(char *type, ...)
@@ -609,10 +785,12 @@ void policy_add(char *type, ...)
 	pr->next = config_rules;
 	config_rules = pr;
 	va_end(ap);
+	pol_cache_free();
 }
 
 void policy_free(void)
 {
+	pol_cache_free();
 	while (config_rules) {
 		struct pol_rule *pr = config_rules;
 		struct rule *r;
@@ -0,0 +1,424 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * Superblock probe hints.
+ *
+ * guess_super_type() loads every metadata handler on every device, which
+ * for version 1 alone means three superblock reads.  When enabled with
+ * "PROBING hints" in mdadm.conf, the outcome of each full probe is
+ * remembered in a small text file: which handler matched a device, and
+ * the array it belonged to.  The next probe of the same device loads
+ * just that handler.  The handler validates magic and checksum as usual,
+ * and the hint is only trusted if the superblock still belongs to the
+ * same array (UUID and creation time) and is not older than when it was
+ * recorded.  Anything else falls back to the full probe, which refreshes
+ * the hint.  Devices on which the full probe finds more than one kind of
+ * superblock get no hint, as only the full probe picks the right one.
+ * Only commands that assemble or change arrays record hints.
+ *
+ * Each line of the file describes one device:
+ *   major:minor size id metadata minor_version uuid role events ctime
+ * where 'id' is the WWN of the disk (or "-").  Lines are appended, a later
+ * line for a device overrides earlier ones and "major:minor -" drops it.
+ */
+
+#include "mdadm.h"
+#include "xmalloc.h"
+
+#include <ctype.h>
+#include <sys/file.h>
+
+#define HINT_ID_LEN 64
+
+struct probe_hint {
+	dev_t devid;
+	unsigned long long size;
+	char id[HINT_ID_LEN];
+	char metadata[20];
+	int minor_version;
+	int uuid[4];
+	int role;
+	unsigned long long events;
+	unsigned long long ctime;
+};
+
+static struct probe_hint *hints;
+static int hints_cnt;
+static int hints_lines;
+static bool hints_loaded;
+static bool hints_save;
+
+/* Read a WWN for the device or the disk holding the partition */
+static void hint_dev_id(dev_t devid, char *id)
+{
+	static const char * const files[] = {
+		"device/wwid", "wwid", "../device/wwid", "../wwid", NULL
+	};
+	char path[PATH_MAX];
+	int i;
+
+	strcpy(id, "-");
+	for (i = 0; files[i]; i++) {
+		char *c;
+		int fd, n;
+
+		snprintf(path, sizeof(path), "/sys/dev/block/%d:%d/%s",
+			 major(devid), minor(devid), files[i]);
+		fd = open(path, O_RDONLY);
+		if (!is_fd_valid(fd))
+			continue;
+		n = read(fd, id, HINT_ID_LEN - 1);
+		close(fd);
+		if (n <= 0) {
+			strcpy(id, "-");
+			continue;
+		}
+		id[n] = '\0';
+		/* keep the file format word based */
+		for (c = id; *c; c++)
+			if (isspace(*c))
+				*c = '_';
+		while (c > id && c[-1] == '_')
+			*--c = '\0';
+		if (id[0])
+			return;
+		strcpy(id, "-");
+	}
+}
+
+static int hint_identify(int fd, dev_t *devid, unsigned long long *size,
+			 char *id)
+{
+	struct stat stb;
+
+	if (fstat(fd, &stb) != 0 || !S_ISBLK(stb.st_mode))
+		return 0;
+	if (!get_dev_size(fd, NULL, size))
+		return 0;
+	*devid = stb.st_rdev;
+	hint_dev_id(*devid, id);
+	return 1;
+}
+
+static struct probe_hint *hint_find(dev_t devid)
+{
+	int i;
+
+	for (i = 0; i < hints_cnt; i++)
+		if (hints[i].devid == devid)
+			return &hints[i];
+	return NULL;
+}
+
+static void hint_drop(dev_t devid)
+{
+	struct probe_hint *h = hint_find(devid);
+
+	if (h)
+		*h = hints[--hints_cnt];
+}
+
+static void hint_set(struct probe_hint *new)
+{
+	struct probe_hint *h = hint_find(new->devid);
+
+	if (!h) {
+		hints = xrealloc(hints, sizeof(*hints) * (hints_cnt + 1));
+		h = &hints[hints_cnt++];
+	}
+	*h = *new;
+}
+
+static void hints_load(char *file)
+{
+	char buf[1024];
+	FILE *f;
+
+	hints_loaded = true;
+	f = fopen(file, "r");
+	if (!f)
+		return;
+
+	while (fgets(buf, sizeof(buf), f)) {
+		struct probe_hint h;
+		unsigned int maj, min;
+		char metadata[20];
+		int n;
+
+		memset(&h, 0, sizeof(h));
+		if (!strchr(buf, '\n'))
+			break;
+		hints_lines++;
+		n = sscanf(buf, "%u:%u %llu %63s %19s %d %x:%x:%x:%x %d %llu %llu",
+			   &maj, &min, &h.size, h.id, metadata,
+			   &h.minor_version, &h.uuid[0], &h.uuid[1],
+			   &h.uuid[2], &h.uuid[3], &h.role, &h.events,
+			   &h.ctime);
+		if (n < 2)
+			continue;
+		h.devid = makedev(maj, min);
+		if (n != 13) {
+			hint_drop(h.devid);
+			continue;
+		}
+		snprintf(h.metadata, sizeof(h.metadata), "%s", metadata);
+		hint_set(&h);
+	}
+	fclose(f);
+}
+
+static void hint_format(char *buf, int len, struct probe_hint *h)
+{
+	snprintf(buf, len,
+		 "%u:%u %llu %s %s %d %08x:%08x:%08x:%08x %d %llu %llu\n",
+		 major(h->devid), minor(h->devid), h->size, h->id,
+		 h->metadata, h->minor_version, h->uuid[0], h->uuid[1],
+		 h->uuid[2], h->uuid[3], h->role, h->events, h->ctime);
+}
+
+/*
+ * Rewrite the file once stale lines dominate.  Appends hold a shared lock
+ * on the file, compacting holds an exclusive one and starts by reading
+ * the file again, so nothing appended by others is lost.
+ */
+static void hints_compact(char *file)
+{
+	char tmp[PATH_MAX];
+	FILE *f;
+	int fd, lfd;
+	int i;
+
+	lfd = open(file, O_RDONLY | O_CLOEXEC);
+	if (!is_fd_valid(lfd))
+		return;
+	/* somebody else is on it already */
+	if (flock(lfd, LOCK_EX | LOCK_NB) != 0) {
+		close(lfd);
+		return;
+	}
+
+	free(hints);
+	hints = NULL;
+	hints_cnt = 0;
+	hints_lines = 0;
+	hints_load(file);
+
+	snprintf(tmp, sizeof(tmp), "%s.XXXXXX", file);
+	fd = mkstemp(tmp);
+	if (!is_fd_valid(fd)) {
+		close(lfd);
+		return;
+	}
+	f = fdopen(fd, "w");
+	if (!f) {
+		close(fd);
+		unlink(tmp);
+		close(lfd);
+		return;
+	}
+	for (i = 0; i < hints_cnt; i++) {
+		char line[256];
+
+		hint_format(line, sizeof(line), &hints[i]);
+		fputs(line, f);
+	}
+	if (fflush(f) != 0 || ferror(f)) {
+		fclose(f);
+		unlink(tmp);
+		close(lfd);
+		return;
+	}
+	fclose(f);
+	if (rename(tmp, file) == 0)
+		hints_lines = hints_cnt;
+	else
+		unlink(tmp);
+	close(lfd);
+}
+
+/* the default file lives in a state directory that may not exist yet */
+static bool hints_mkdir(char *file)
+{
+	char dir[PATH_MAX];
+	char *slash;
+
+	snprintf(dir, sizeof(dir), "%s", file);
+	slash = strrchr(dir, '/');
+	if (!slash || slash == dir)
+		return false;
+	*slash = '\0';
+	return mkdir(dir, 0755) == 0;
+}
+
+static void hints_append(char *file, char *line)
+{
+	int len = strlen(line);
+	bool made_dir = false;
+	struct stat stb;
+	int fd;
+
+	while (1) {
+		fd = open(file, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC,
+			  0600);
+		if (!is_fd_valid(fd) && errno == ENOENT && !made_dir) {
+			made_dir = hints_mkdir(file);
+			if (made_dir)
+				continue;
+		}
+		if (!is_fd_valid(fd))
+			return;
+		if (flock(fd, LOCK_SH) != 0) {
+			close(fd);
+			return;
+		}
+		/* compacted while we waited, the lines go to the new file */
+		if (fstat(fd, &stb) == 0 && stb.st_nlink == 0) {
+			close(fd);
+			continue;
+		}
+		break;
+	}
+	if (write(fd, line, len) == len)
+		hints_lines++;
+	close(fd);
+
+	if (hints_lines > 2 * hints_cnt + 64)
+		hints_compact(file);
+}
+
+static char *hints_file(void)
+{
+	char *file = conf_get_probing_hints();
+
+	if (file && !hints_loaded)
+		hints_load(file);
+	return file;
+}
+
+/**
+ * probe_hint_load() - load a superblock guided by a hint.
+ * @fd: device to probe.
+ * @guess_type: which kind of metadata the caller wants.
+ *
+ * Return: a supertype as returned by guess_super_type() if the hinted
+ * metadata loads, still describes the same array and is at least as
+ * recent as when the hint was recorded, otherwise NULL.
+ */
+struct supertype *probe_hint_load(int fd, enum guess_types guess_type)
+{
+	char id[HINT_ID_LEN];
+	struct superswitch *ss;
+	struct supertype *st;
+	struct probe_hint *h;
+	struct mdinfo info;
+	unsigned long long size;
+	dev_t devid;
+
+	if (!hints_file())
+		return NULL;
+	if (!hint_identify(fd, &devid, &size, id))
+		return NULL;
+	h = hint_find(devid);
+	if (!h || h->size != size || strcmp(h->id, id) != 0)
+		return NULL;
+
+	ss = version_to_superswitch(h->metadata);
+	if (!ss)
+		return NULL;
+	if (guess_type == guess_array && ss->add_to_super == NULL)
+		return NULL;
+	if (guess_type == guess_partitions && ss->add_to_super != NULL)
+		return NULL;
+
+	st = xcalloc(1, sizeof(*st));
+	st->ignore_hw_compat = 1;
+	if (ss == &super1) {
+		/* go straight to the recorded superblock location */
+		st->ss = ss;
+		st->minor_version = h->minor_version;
+	}
+	if (ss->load_super(st, fd, NULL) != 0) {
+		free(st);
+		return NULL;
+	}
+	st->ss->getinfo_super(st, &info, NULL);
+	st->ss->free_super(st);
+	if (memcmp(info.uuid, h->uuid, sizeof(h->uuid)) != 0 ||
+	    info.array.ctime != h->ctime || info.events < h->events) {
+		free(st);
+		return NULL;
+	}
+	return st;
+}
+
+/**
+ * probe_hint_allow_save() - let probe_hint_save() record hints.
+ *
+ * Called by commands that assemble or change arrays.  Everything else
+ * only reads the hints, so that e.g. --examine does not rewrite the file.
+ */
+void probe_hint_allow_save(void)
+{
+	hints_save = true;
+}
+
+/**
+ * probe_hint_save() - remember the result of a full probe.
+ * @fd: device that was probed.
+ * @st: winning metadata, with the superblock loaded.
+ */
+void probe_hint_save(int fd, struct supertype *st)
+{
+	struct probe_hint h, *old;
+	struct mdinfo info;
+	char line[256];
+	char *file;
+
+	if (!hints_save)
+		return;
+	file = hints_file();
+	if (!file)
+		return;
+	memset(&h, 0, sizeof(h));
+	if (!hint_identify(fd, &h.devid, &h.size, h.id))
+		return;
+
+	st->ss->getinfo_super(st, &info, NULL);
+	snprintf(h.metadata, sizeof(h.metadata), "%s", st->ss->name);
+	h.minor_version = st->minor_version;
+	memcpy(h.uuid, info.uuid, sizeof(h.uuid));
+	h.role = info.disk.raid_disk;
+	h.events = info.events;
+	h.ctime = info.array.ctime;
+
+	old = hint_find(h.devid);
+	if (old && memcmp(old, &h, sizeof(h)) == 0)
+		return;
+
+	hint_set(&h);
+	hint_format(line, sizeof(line), &h);
+	hints_append(file, line);
+}
+
+/**
+ * probe_hint_forget() - drop the hint for a device.
+ * @fd: device whose metadata is about to be rewritten.
+ */
+void probe_hint_forget(int fd)
+{
+	char line[64];
+	struct stat stb;
+	char *file;
+
+	file = hints_file();
+	if (!file)
+		return;
+	if (fstat(fd, &stb) != 0 || !S_ISBLK(stb.st_mode))
+		return;
+	if (!hint_find(stb.st_rdev))
+		return;
+
+	hint_drop(stb.st_rdev);
+	snprintf(line, sizeof(line), "%u:%u -\n",
+		 major(stb.st_rdev), minor(stb.st_rdev));
+	hints_append(file, line);
+}
@@ -46,10 +46,6 @@ static char T10[] = "Linux-MD";
  * 10 years with 2 leap years.
  */
 #define DECADE (3600*24*(365*10+2))
-unsigned long crc32(
-	unsigned long crc,
-	const unsigned char *buf,
-	unsigned len);
 
 #define DDF_NOTFOUND (~0U)
 #define DDF_CONTAINER (DDF_NOTFOUND-1)
@@ -580,7 +576,7 @@ static be32 calc_crc(void *buf, int len)
 	__u32 newcrc;
 	ddf->crc = cpu_to_be32(0xffffffff);
 
-	newcrc = crc32(0, buf, len);
+	newcrc = csum_crc32(0, buf, len);
 	ddf->crc = oldcrc;
 	/* The crc is stored (like everything) bigendian, so convert
 	 * here for simplicity
@@ -886,6 +882,85 @@ static void *load_section(int fd, struct ddf_super *super, void *buf,
 }
 
 
+/*
+ * Outcome of search_for_ddf_headers() per device, so one invocation
+ * probing the same disk several times scans it only once.  A device is
+ * only known by dev_t and size, which a replacement disk may share, so
+ * this is off unless enabled by ddf_search_cache() for a short-lived
+ * command.
+ */
+struct ddf_search_result {
+	dev_t devid;
+	unsigned long long dsize;
+	unsigned long long pos;		/* 0 if no header was found */
+};
+
+static struct ddf_search_result *ddf_searches;
+static int ddf_searches_cnt;
+static bool ddf_searches_on;
+
+/**
+ * ddf_search_cache() - drop cached DDF header searches, and set whether
+ * to cache them from now on.
+ * @on: true for one command, or one request of a long running one.
+ */
+void ddf_search_cache(bool on)
+{
+	free(ddf_searches);
+	ddf_searches = NULL;
+	ddf_searches_cnt = 0;
+	ddf_searches_on = on;
+}
+
+static struct ddf_search_result *ddf_search_find(int fd,
+						 unsigned long long dsize)
+{
+	struct stat stb;
+	int i;
+
+	if (!ddf_searches_on)
+		return NULL;
+	if (fstat(fd, &stb) != 0 || !S_ISBLK(stb.st_mode))
+		return NULL;
+	for (i = 0; i < ddf_searches_cnt; i++)
+		if (ddf_searches[i].devid == stb.st_rdev &&
+		    ddf_searches[i].dsize == dsize)
+			return &ddf_searches[i];
+	return NULL;
+}
+
+static void ddf_search_save(int fd, unsigned long long dsize,
+			    unsigned long long pos)
+{
+	struct ddf_search_result *r = ddf_search_find(fd, dsize);
+	struct stat stb;
+
+	if (!r) {
+		if (!ddf_searches_on)
+			return;
+		if (fstat(fd, &stb) != 0 || !S_ISBLK(stb.st_mode))
+			return;
+		ddf_searches = xrealloc(ddf_searches, sizeof(*ddf_searches) *
+					(ddf_searches_cnt + 1));
+		r = &ddf_searches[ddf_searches_cnt++];
+		r->devid = stb.st_rdev;
+		r->dsize = dsize;
+	}
+	r->pos = pos;
+}
+
+static void ddf_search_forget(int fd)
+{
+	struct stat stb;
+	int i;
+
+	if (fstat(fd, &stb) != 0 || !S_ISBLK(stb.st_mode))
+		return;
+	for (i = 0; i < ddf_searches_cnt; i++)
+		if (ddf_searches[i].devid == stb.st_rdev)
+			ddf_searches[i--] = ddf_searches[--ddf_searches_cnt];
+}
+
 /*
  * Search for DDF_HEADER_MAGIC in the last 32MB of the device
  *
@@ -893,10 +968,19 @@ static void *load_section(int fd, struct ddf_super *super, void *buf,
  * the end of the disk. However,some widely used RAID hardware, such as
  * LSI and PERC, do not position it within the last 512 bytes of the disk.
  *
+ * Headers start on a sector boundary, so only the first word of each
+ * sector is compared, and a candidate is accepted only if its CRC holds.
+ * Nothing bounds the search before an anchor is found, as the anchor is
+ * what records where the rest of the DDF lives, so the first valid header
+ * ends it.
+ *
+ * Return: 0 and the byte offset in @out if a header was found, -ENOENT
+ * if there is none, other negative errors if the device cannot be read.
  */
 static int search_for_ddf_headers(int fd, char *devname,
 				  unsigned long long *out)
 {
+	struct ddf_search_result *cached;
 	unsigned long long dsize;
 	unsigned long long search_start;
 	size_t map_len;		  /* real search（<= 32MB） */
@@ -910,7 +994,7 @@ static int search_for_ddf_headers(int fd, char *devname,
 
 	void *map = MAP_FAILED;
 	unsigned char *p;
-	int result = 0;
+	int result = -ENOENT;
 
 	pagesz_l = sysconf(_SC_PAGESIZE);
 	pagesz = (pagesz_l > 0) ? (size_t)pagesz_l : 4096;
@@ -922,7 +1006,15 @@ static int search_for_ddf_headers(int fd, char *devname,
 		return -ENODEV; /* empty device / unknown size */
 	}
 	if (dsize <= SEARCH_REGION_SIZE)
-		return 0; /* Size is inappropriate, though not erroneous. */
+		return -ENOENT; /* Size is inappropriate, though not erroneous. */
+
+	cached = ddf_search_find(fd, dsize);
+	if (cached) {
+		if (!cached->pos)
+			return -ENOENT;
+		*out = cached->pos;
+		return 0;
+	}
 
 	map_len =  (size_t)SEARCH_REGION_SIZE;
 
@@ -941,23 +1033,31 @@ static int search_for_ddf_headers(int fd, char *devname,
 		   fd2devnm(fd), errno, strerror(errno));
 		return -ENOMEM;
 	}
+	/* the region is read once front to back, let readahead run ahead */
+	madvise(map, map_len_adj, MADV_SEQUENTIAL);
 
 	p = (unsigned char *)map + delta;
 
-	for (size_t i = 0; i + sizeof(be32) <= map_len; i += sizeof(be32)) {
+	for (size_t i = 0; i + 512 <= map_len; i += 512) {
+		struct ddf_header hdr;
 		be32 v;
 
 		memcpy(&v, p + i, sizeof(v));   /* avoid unaligned access. */
-		if (be32_eq(v, DDF_HEADER_MAGIC)) {
-			*out = search_start + (unsigned long long)i;
-			result = 0;
-			goto cleanup;
-		}
+		if (!be32_eq(v, DDF_HEADER_MAGIC))
+			continue;
+
+		/* calc_crc() writes to the buffer, the mapping is read-only */
+		memcpy(&hdr, p + i, sizeof(hdr));
+		if (!be32_eq(calc_crc(&hdr, 512), hdr.crc))
+			continue;
+
+		*out = search_start + (unsigned long long)i;
+		result = 0;
+		break;
 	}
 
-	result = 0; /* Not found, returning normally.*/
-cleanup:
 	munmap(map, map_len_adj);
+	ddf_search_save(fd, dsize, result == 0 ? *out : 0);
 	return result;
 }
 
@@ -1031,6 +1131,7 @@ static int load_ddf_headers(int fd, struct ddf_super *super, char *devname)
 
 		/* Verify the magic value again */
 		if (!be32_eq(super->anchor.magic, DDF_HEADER_MAGIC)) {
+			ddf_search_forget(fd);
 			if (devname) {
 				pr_err("Invalid DDF header magic value on %s\n",
 				       devname);
@@ -2714,8 +2815,7 @@ static int init_super_ddf_bvd(struct supertype *st,
 	make_header_guid(ve->guid);
 	ve->unit = cpu_to_be16(info->md_minor);
 	ve->pad0 = 0xFFFF;
-	ve->guid_crc._v16 = crc32(0, (unsigned char *)ddf->anchor.guid,
-				  DDF_GUID_LEN);
+	ve->guid_crc._v16 = csum_crc32(0, ddf->anchor.guid, DDF_GUID_LEN);
 	ve->type = cpu_to_be16(0);
 	ve->state = DDF_state_degraded; /* Will be modified as devices are added */
 	if (info->state & 1) /* clean */
@@ -3277,6 +3377,40 @@ static int __write_init_super_ddf(struct supertype *st)
 	return attempts != successes;
 }
 
+/* Like __write_init_super_ddf(), with the disks written concurrently.
+ * The last disk is written here, so that the headers in @ddf end up
+ * as the serial loop would leave them.
+ */
+static int write_init_members_ddf(struct supertype *st)
+{
+	struct ddf_super *ddf = st->sb;
+	struct child_pool writers;
+	struct dl *d;
+	int attempts = 0;
+	int successes = 0;
+	pid_t pid;
+
+	pr_state(ddf, __func__);
+
+	child_pool_init(&writers, CHILD_POOL_MAX, member_write_done);
+	for (d = ddf->dlist; d; d = d->next) {
+		attempts++;
+		if (d->next && is_fd_valid(d->fd)) {
+			pid = child_pool_fork(&writers, d->devname);
+			if (pid == 0)
+				_exit(_write_super_to_disk(ddf, d) ? 0 : 1);
+			if (pid > 0) {
+				successes++;
+				continue;
+			}
+		}
+		successes += _write_super_to_disk(ddf, d);
+	}
+	successes -= child_pool_wait(&writers);
+
+	return attempts != successes;
+}
+
 static int write_init_super_ddf(struct supertype *st)
 {
 	struct ddf_super *ddf = st->sb;
@@ -3335,7 +3469,7 @@ static int write_init_super_ddf(struct supertype *st)
 		/* Note: we don't close the fd's now, but a subsequent
 		 * ->free_super() will
 		 */
-		return __write_init_super_ddf(st);
+		return write_init_members_ddf(st);
 	}
 }
 
@@ -4042,6 +4176,7 @@ static int store_super_ddf(struct supertype *st, int fd)
 	// at the end of the disk is not enough.
 	// clears SEARCH_REGION_SIZE bytes at the end of the disk.
 
+	ddf_search_forget(fd);
 	buf = xmemalign(SEARCH_BLOCK_SIZE, SEARCH_REGION_SIZE);
 	memset(buf, 0, SEARCH_REGION_SIZE);
 	if (lseek(fd, dsize - SEARCH_REGION_SIZE, 0) == -1L) {
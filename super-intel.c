@@ -889,14 +889,7 @@ static struct imsm_disk *get_imsm_disk(struct intel_super *super, __u8 index)
  */
 static __u32 __gen_imsm_checksum(struct imsm_super *mpb)
 {
-	__u32 end = mpb->mpb_size / sizeof(end);
-	__u32 *p = (__u32 *) mpb;
-	__u32 sum = 0;
-
-	while (end--) {
-		sum += __le32_to_cpu(*p);
-		p++;
-	}
+	__u32 sum = csum_sum32_le(mpb, mpb->mpb_size);
 
 	return sum - __le32_to_cpu(mpb->check_sum);
 }
@@ -6238,6 +6231,8 @@ static int remove_from_super_imsm(struct supertype *st, mdu_disk_info_t *dk)
 }
 
 static int store_imsm_mpb(int fd, struct imsm_super *mpb);
+static int imsm_mpb_writes(int fd, struct imsm_super *mpb,
+			   struct write_req *ext, struct write_req *anchor);
 
 static union {
 	char buf[MAX_SECTOR_SIZE];
@@ -6303,6 +6298,98 @@ static int write_super_imsm_spares(struct intel_super *super, int doclose)
 	return 0;
 }
 
+/*
+ * Write the mpb to all disks that compose raid devices, all disks at
+ * once.  On each disk the migration record and extended mpb go first,
+ * the anchor only after its extended mpb made it out.
+ */
+static void write_mpb_all(struct intel_super *super, struct imsm_super *mpb,
+			  int clear_migration_record)
+{
+	unsigned int sector_size = super->sector_size;
+	struct write_req *first, *anchors;
+	struct dl **owner, **anchor_owner;
+	int nfirst = 0, nanchors = 0;
+	int ndisks = 0;
+	struct dl *d;
+	int i, j;
+
+	for (d = super->disks; d ; d = d->next)
+		ndisks++;
+	first = xcalloc(2 * ndisks + 1, sizeof(*first));
+	owner = xcalloc(2 * ndisks + 1, sizeof(*owner));
+	anchors = xcalloc(ndisks + 1, sizeof(*anchors));
+	anchor_owner = xcalloc(ndisks + 1, sizeof(*anchor_owner));
+
+	for (d = super->disks; d ; d = d->next) {
+		struct write_req ext;
+
+		if (d->index < 0 || is_failed(&d->disk))
+			continue;
+
+		if (clear_migration_record) {
+			unsigned long long dsize;
+
+			get_dev_size(d->fd, NULL, &dsize);
+			first[nfirst].fd = d->fd;
+			first[nfirst].buf = super->migr_rec_buf;
+			first[nfirst].len = MIGR_REC_BUF_SECTORS*sector_size;
+			first[nfirst].offset = dsize - sector_size;
+			owner[nfirst++] = NULL;
+		}
+
+		if (imsm_mpb_writes(d->fd, mpb, &ext,
+				    &anchors[nanchors])) {
+			fprintf(stderr,
+				"failed for device %d:%d (fd: %d)%s\n",
+				d->major, d->minor,
+				d->fd, strerror(errno));
+			continue;
+		}
+		anchor_owner[nanchors++] = d;
+		if (ext.len) {
+			first[nfirst] = ext;
+			owner[nfirst++] = d;
+		}
+	}
+
+	write_batch(first, nfirst);
+	for (i = 0; i < nfirst; i++) {
+		if (!first[i].err)
+			continue;
+		if (!owner[i]) {
+			errno = first[i].err;
+			perror("Write migr_rec failed");
+			continue;
+		}
+		/* no anchor pointing at a missing extended mpb */
+		d = owner[i];
+		fprintf(stderr, "failed for device %d:%d (fd: %d)%s\n",
+			d->major, d->minor, d->fd, strerror(first[i].err));
+		for (j = 0; j < nanchors; j++)
+			if (anchor_owner[j] == d) {
+				nanchors--;
+				anchors[j] = anchors[nanchors];
+				anchor_owner[j] = anchor_owner[nanchors];
+				break;
+			}
+	}
+
+	write_batch(anchors, nanchors);
+	for (i = 0; i < nanchors; i++) {
+		if (!anchors[i].err)
+			continue;
+		d = anchor_owner[i];
+		fprintf(stderr, "failed for device %d:%d (fd: %d)%s\n",
+			d->major, d->minor, d->fd, strerror(anchors[i].err));
+	}
+
+	free(first);
+	free(owner);
+	free(anchors);
+	free(anchor_owner);
+}
+
 static int write_super_imsm(struct supertype *st, int doclose)
 {
 	struct intel_super *super = st->sb;
@@ -6387,33 +6474,11 @@ static int write_super_imsm(struct supertype *st, int doclose)
 		convert_to_4k(super);
 
 	/* write the mpb for disks that compose raid devices */
-	for (d = super->disks; d ; d = d->next) {
-		if (d->index < 0 || is_failed(&d->disk))
-			continue;
-
-		if (clear_migration_record) {
-			unsigned long long dsize;
-
-			get_dev_size(d->fd, NULL, &dsize);
-			if (lseek(d->fd, dsize - sector_size,
-			    SEEK_SET) >= 0) {
-				if ((unsigned int)write(d->fd,
-				    super->migr_rec_buf,
-				    MIGR_REC_BUF_SECTORS*sector_size) !=
-				    MIGR_REC_BUF_SECTORS*sector_size)
-					perror("Write migr_rec failed");
-			}
-		}
+	write_mpb_all(super, mpb, clear_migration_record);
 
-		if (store_imsm_mpb(d->fd, mpb))
-			fprintf(stderr,
-				"failed for device %d:%d (fd: %d)%s\n",
-				d->major, d->minor,
-				d->fd, strerror(errno));
-
-		if (doclose)
+	for (d = super->disks; doclose && d ; d = d->next)
+		if (d->index >= 0 && !is_failed(&d->disk))
 			close_fd(&d->fd);
-	}
 
 	if (spares)
 		return write_super_imsm_spares(super, doclose);
@@ -6469,14 +6534,12 @@ static int mgmt_disk(struct supertype *st)
 	return 0;
 }
 
-__u32 crc32c_le(__u32 crc, unsigned char const *p, size_t len);
-
 static int write_ppl_header(unsigned long long ppl_sector, int fd, void *buf)
 {
 	struct ppl_header *ppl_hdr = buf;
 	int ret;
 
-	ppl_hdr->checksum = __cpu_to_le32(~crc32c_le(~0, buf, PPL_HEADER_SIZE));
+	ppl_hdr->checksum = __cpu_to_le32(~csum_crc32c(~0, buf, PPL_HEADER_SIZE));
 
 	if (lseek(fd, ppl_sector * 512, SEEK_SET) < 0) {
 		ret = -errno;
@@ -6495,18 +6558,15 @@ static int write_ppl_header(unsigned long long ppl_sector, int fd, void *buf)
 	return 0;
 }
 
-static int write_init_ppl_imsm(struct supertype *st, struct mdinfo *info, int fd)
+/* write the header of a PPL area that has just been zeroed */
+static int write_init_ppl_header_imsm(struct supertype *st,
+				      struct mdinfo *info, int fd)
 {
 	struct intel_super *super = st->sb;
 	void *buf;
 	struct ppl_header *ppl_hdr;
 	int ret;
 
-	/* first clear entire ppl space */
-	ret = zero_disk_range(fd, info->ppl_sector, info->ppl_size);
-	if (ret)
-		return ret;
-
 	ret = posix_memalign(&buf, MAX_SECTOR_SIZE, PPL_HEADER_SIZE);
 	if (ret) {
 		pr_err("Failed to allocate PPL header buffer\n");
@@ -6533,6 +6593,18 @@ static int write_init_ppl_imsm(struct supertype *st, struct mdinfo *info, int fd
 	return ret;
 }
 
+static int write_init_ppl_imsm(struct supertype *st, struct mdinfo *info, int fd)
+{
+	int ret;
+
+	/* first clear entire ppl space */
+	ret = zero_disk_range(fd, info->ppl_sector, info->ppl_size);
+	if (ret)
+		return ret;
+
+	return write_init_ppl_header_imsm(st, info, fd);
+}
+
 static int is_rebuilding(struct imsm_dev *dev);
 
 static int validate_ppl_imsm(struct supertype *st, struct mdinfo *info,
@@ -6590,7 +6662,7 @@ static int validate_ppl_imsm(struct supertype *st, struct mdinfo *info,
 		crc = __le32_to_cpu(ppl_hdr->checksum);
 		ppl_hdr->checksum = 0;
 
-		if (crc != ~crc32c_le(~0, buf, PPL_HEADER_SIZE)) {
+		if (crc != ~csum_crc32c(~0, buf, PPL_HEADER_SIZE)) {
 			dprintf("Wrong PPL header checksum on %s\n",
 				d->devname);
 			break;
@@ -6693,17 +6765,36 @@ static int write_init_ppl_imsm_all(struct supertype *st, struct mdinfo *info)
 {
 	struct intel_super *super = st->sb;
 	struct dl *d;
+	int *fds;
+	int cnt = 0;
 	int ret = 0;
 
 	if (info->consistency_policy != CONSISTENCY_POLICY_PPL ||
 	    info->array.level != 5)
 		return 0;
 
+	/* clear the ppl space of all members at once, then the headers */
+	for (d = super->disks; d ; d = d->next)
+		cnt++;
+	if (!cnt)
+		return 0;
+	fds = xcalloc(cnt, sizeof(*fds));
+	cnt = 0;
+	for (d = super->disks; d ; d = d->next)
+		if (d->index >= 0 && !is_failed(&d->disk))
+			fds[cnt++] = d->fd;
+	if (cnt)
+		ret = zero_disk_ranges(fds, cnt, info->ppl_sector,
+				       info->ppl_size);
+	free(fds);
+	if (ret)
+		return ret;
+
 	for (d = super->disks; d ; d = d->next) {
 		if (d->index < 0 || is_failed(&d->disk))
 			continue;
 
-		ret = st->ss->write_init_ppl(st, info, d->fd);
+		ret = write_init_ppl_header_imsm(st, info, d->fd);
 		if (ret)
 			break;
 	}
@@ -9081,9 +9172,12 @@ static void imsm_set_disk(struct active_array *a, int n, int state)
 	dprintf_cont("\n");
 }
 
-static int store_imsm_mpb(int fd, struct imsm_super *mpb)
+/* Where store_imsm_mpb() puts the mpb on a disk.  ext->len is 0 when
+ * the mpb fits in the anchor sector.
+ */
+static int imsm_mpb_writes(int fd, struct imsm_super *mpb,
+			   struct write_req *ext, struct write_req *anchor)
 {
-	void *buf = mpb;
 	__u32 mpb_size = __le32_to_cpu(mpb->mpb_size);
 	unsigned long long dsize;
 	unsigned long long sectors;
@@ -9093,26 +9187,43 @@ static int store_imsm_mpb(int fd, struct imsm_super *mpb)
 		return 1;
 	get_dev_size(fd, NULL, &dsize);
 
+	memset(ext, 0, sizeof(*ext));
+	ext->fd = fd;
 	if (mpb_size > sector_size) {
 		/* -1 to account for anchor */
 		sectors = mpb_sectors(mpb, sector_size) - 1;
 
-		/* write the extended mpb to the sectors preceeding the anchor */
-		if (lseek(fd, dsize - (sector_size * (2 + sectors)),
-		   SEEK_SET) < 0)
-			return 1;
-
-		if ((unsigned long long)write(fd, buf + sector_size,
-		   sector_size * sectors) != sector_size * sectors)
-			return 1;
+		/* the extended mpb goes to the sectors preceeding the anchor */
+		ext->buf = (void *)mpb + sector_size;
+		ext->len = sector_size * sectors;
+		ext->offset = dsize - (sector_size * (2 + sectors));
 	}
 
 	/* first block is stored on second to last sector of the disk */
-	if (lseek(fd, dsize - (sector_size * 2), SEEK_SET) < 0)
+	memset(anchor, 0, sizeof(*anchor));
+	anchor->fd = fd;
+	anchor->buf = mpb;
+	anchor->len = sector_size;
+	anchor->offset = dsize - (sector_size * 2);
+
+	return 0;
+}
+
+static int store_imsm_mpb(int fd, struct imsm_super *mpb)
+{
+	struct write_req ext, anchor;
+
+	if (imsm_mpb_writes(fd, mpb, &ext, &anchor))
 		return 1;
 
-	if ((unsigned int)write(fd, buf, sector_size) != sector_size)
+	if (ext.len && write_batch(&ext, 1)) {
+		errno = ext.err;
 		return 1;
+	}
+	if (write_batch(&anchor, 1)) {
+		errno = anchor.err;
+		return 1;
+	}
 
 	return 0;
 }
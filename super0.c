@@ -928,9 +928,23 @@ static int store_super0(struct supertype *st, int fd)
 	return 0;
 }
 
+static int write_member0(struct supertype *st, int fd)
+{
+	mdp_super_t *sb = st->sb;
+	int rv;
+
+	rv = store_super0(st, fd);
+
+	if (rv == 0 && (sb->state & (1<<MD_SB_BITMAP_PRESENT)))
+		rv = st->ss->write_bitmap(st, fd, NoUpdate);
+	return rv;
+}
+
 static int write_init_super0(struct supertype *st)
 {
 	mdp_super_t *sb = st->sb;
+	struct child_pool writers;
+	pid_t pid;
 	int rv = 0;
 	struct devinfo *di;
 
@@ -961,6 +975,7 @@ static int write_init_super0(struct supertype *st)
 		sb->layout = 0;
 	}
 
+	child_pool_init(&writers, CHILD_POOL_MAX, member_write_done);
 	for (di = st->info ; di && ! rv ; di = di->next) {
 
 		if (di->disk.state & (1 << MD_DISK_FAULTY))
@@ -974,15 +989,19 @@ static int write_init_super0(struct supertype *st)
 
 		sb->this_disk = sb->disks[di->disk.number];
 		sb->sb_csum = calc_sb0_csum(sb);
-		rv = store_super0(st, di->fd);
 
-		if (rv == 0 && (sb->state & (1<<MD_SB_BITMAP_PRESENT)))
-			rv = st->ss->write_bitmap(st, di->fd, NoUpdate);
+		pid = child_pool_fork(&writers, di->devname);
+		if (pid == 0)
+			_exit(write_member0(st, di->fd) ? 1 : 0);
+		if (pid < 0)
+			rv = write_member0(st, di->fd);
 
 		if (rv)
 			pr_err("failed to write superblock to %s\n",
 			       di->devname);
 	}
+	if (child_pool_wait(&writers) && rv == 0)
+		rv = 1;
 	return rv;
 }
 
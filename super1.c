@@ -85,11 +85,9 @@ static unsigned int calc_sb_1_csum(struct mdp_superblock_1 * sb)
 
 	disk_csum = sb->sb_csum;
 	sb->sb_csum = 0;
-	newcsum = 0;
-	for (; size >= 4; size -= 4) {
-		newcsum += __le32_to_cpu(*isuper);
-		isuper++;
-	}
+	newcsum = csum_sum32_le(isuper, size);
+	isuper += size / 4;
+	size %= 4;
 
 	if (size == 2)
 		newcsum += __le16_to_cpu(*(unsigned short*) isuper);
@@ -1652,6 +1650,8 @@ static int add_to_super1(struct supertype *st, mdu_disk_info_t *dk,
 }
 
 static int locate_bitmap1(struct supertype *st, int fd, int node_num);
+static int update_bitmap1(struct supertype *st, enum bitmap_update update);
+static int write_bitmap1_data(struct supertype *st, int fd);
 
 static int store_super1(struct supertype *st, int fd)
 {
@@ -1744,8 +1744,6 @@ static unsigned long choose_bm_space(unsigned long devsize)
 
 static void free_super1(struct supertype *st);
 
-__u32 crc32c_le(__u32 crc, unsigned char const *p, size_t len);
-
 static int write_init_ppl1(struct supertype *st, struct mdinfo *info, int fd)
 {
 	struct mdp_superblock_1 *sb = st->sb;
@@ -1767,9 +1765,9 @@ static int write_init_ppl1(struct supertype *st, struct mdinfo *info, int fd)
 	memset(buf, 0, PPL_HEADER_SIZE);
 	ppl_hdr = buf;
 	memset(ppl_hdr->reserved, 0xff, PPL_HDR_RESERVED);
-	ppl_hdr->signature = __cpu_to_le32(~crc32c_le(~0, sb->set_uuid,
+	ppl_hdr->signature = __cpu_to_le32(~csum_crc32c(~0, sb->set_uuid,
 						      sizeof(sb->set_uuid)));
-	ppl_hdr->checksum = __cpu_to_le32(~crc32c_le(~0, buf, PPL_HEADER_SIZE));
+	ppl_hdr->checksum = __cpu_to_le32(~csum_crc32c(~0, buf, PPL_HEADER_SIZE));
 
 	if (lseek(fd, info->ppl_sector * 512, SEEK_SET) < 0) {
 		ret = errno;
@@ -1812,8 +1810,8 @@ static int write_empty_r5l_meta_block(struct supertype *st, int fd)
 	mb->seq = __cpu_to_le64(random32());
 	mb->position = __cpu_to_le64(0);
 
-	crc = crc32c_le(0xffffffff, sb->set_uuid, sizeof(sb->set_uuid));
-	crc = crc32c_le(crc, (void *)mb, META_BLOCK_SIZE);
+	crc = csum_crc32c(0xffffffff, sb->set_uuid, sizeof(sb->set_uuid));
+	crc = csum_crc32c(crc, (void *)mb, META_BLOCK_SIZE);
 	mb->checksum = crc;
 
 	if (lseek(fd, __le64_to_cpu(sb->data_offset) * 512, 0) < 0LL) {
@@ -1843,10 +1841,39 @@ static bool has_raid0_layout(struct mdp_superblock_1 *sb)
 		return false;
 }
 
+/* Write the superblock of one member, then the areas that depend on it */
+static int write_member1(struct supertype *st, struct devinfo *di)
+{
+	struct mdp_superblock_1 *sb = st->sb;
+	int rv;
+
+	rv = store_super1(st, di->fd);
+
+	if (rv == 0 && (di->disk.state & (1 << MD_DISK_JOURNAL))) {
+		rv = write_empty_r5l_meta_block(st, di->fd);
+		if (rv)
+			return rv;
+	}
+
+	if (rv == 0 &&
+	    (__le32_to_cpu(sb->feature_map) & MD_FEATURE_BITMAP_OFFSET)) {
+		rv = write_bitmap1_data(st, di->fd);
+	} else if (rv == 0 &&
+	    md_feature_any_ppl_on(sb->feature_map)) {
+		struct mdinfo info;
+
+		st->ss->getinfo_super(st, &info, NULL);
+		rv = st->ss->write_init_ppl(st, &info, di->fd);
+	}
+	return rv;
+}
+
 static int write_init_super1(struct supertype *st)
 {
 	struct mdp_superblock_1 *sb = st->sb;
 	struct supertype *refst;
+	struct child_pool writers;
+	pid_t pid;
 	int rv = 0;
 	unsigned long long bm_space;
 	struct devinfo *di;
@@ -1856,6 +1883,8 @@ static int write_init_super1(struct supertype *st)
 	long bm_offset;
 	bool raid0_need_layout = false;
 
+	child_pool_init(&writers, CHILD_POOL_MAX, member_write_done);
+
 	/* Clear extra flags */
 	sb->feature_map &= ~__cpu_to_le32(MD_FEATURE_BAD_BLOCKS | MD_FEATURE_REPLACEMENT);
 
@@ -2027,26 +2056,20 @@ static int write_init_super1(struct supertype *st)
 		if (raid0_need_layout)
 			sb->feature_map |= __cpu_to_le32(MD_FEATURE_RAID0_LAYOUT);
 
-		sb->sb_csum = calc_sb_1_csum(sb);
-		rv = store_super1(st, di->fd);
-
-		if (rv == 0 && (di->disk.state & (1 << MD_DISK_JOURNAL))) {
-			rv = write_empty_r5l_meta_block(st, di->fd);
+		/* bitmap header changes must be seen by later members */
+		if (__le32_to_cpu(sb->feature_map) & MD_FEATURE_BITMAP_OFFSET) {
+			rv = update_bitmap1(st, NodeNumUpdate);
 			if (rv)
 				goto error_out;
 		}
 
-		if (rv == 0 &&
-		    (__le32_to_cpu(sb->feature_map) &
-		     MD_FEATURE_BITMAP_OFFSET)) {
-			rv = st->ss->write_bitmap(st, di->fd, NodeNumUpdate);
-		} else if (rv == 0 &&
-		    md_feature_any_ppl_on(sb->feature_map)) {
-			struct mdinfo info;
+		sb->sb_csum = calc_sb_1_csum(sb);
 
-			st->ss->getinfo_super(st, &info, NULL);
-			rv = st->ss->write_init_ppl(st, &info, di->fd);
-		}
+		pid = child_pool_fork(&writers, di->devname);
+		if (pid == 0)
+			_exit(write_member1(st, di) ? 1 : 0);
+		if (pid < 0)
+			rv = write_member1(st, di);
 
 		close(di->fd);
 		di->fd = -1;
@@ -2057,6 +2080,8 @@ error_out:
 	if (rv)
 		pr_err("Failed to write metadata to %s\n", di->devname);
 out:
+	if (child_pool_wait(&writers) && rv == 0)
+		rv = 1;
 	return rv;
 }
 
@@ -2607,16 +2632,13 @@ static int locate_bitmap1(struct supertype *st, int fd, int node_num)
 	return ret;
 }
 
-static int write_bitmap1(struct supertype *st, int fd, enum bitmap_update update)
+/* Apply @update to the bitmap superblock kept with the superblock */
+static int update_bitmap1(struct supertype *st, enum bitmap_update update)
 {
 	struct mdp_superblock_1 *sb = st->sb;
 	bitmap_super_t *bms = (bitmap_super_t *)(((char *)sb) + MAX_SB_SIZE);
-	int rv = 0;
-	void *buf;
-	int towrite, n, len;
-	struct align_fd afd;
-	unsigned int i = 0;
 	unsigned long long total_bm_space, bm_space_per_node;
+	int len;
 
 	switch (update) {
 	case NameUpdate:
@@ -2691,6 +2713,22 @@ static int write_bitmap1(struct supertype *st, int fd, enum bitmap_update update
 	default:
 		break;
 	}
+	return 0;
+}
+
+/* Bitmaps are written in pieces of this size, per node */
+#define BITMAP_WRITE_SIZE (1024 * 1024)
+
+/* Write the bitmap of every node, bitmap superblock included */
+static int write_bitmap1_data(struct supertype *st, int fd)
+{
+	struct mdp_superblock_1 *sb = st->sb;
+	bitmap_super_t *bms = (bitmap_super_t *)(((char *)sb) + MAX_SB_SIZE);
+	int rv = 0;
+	void *buf;
+	int towrite, piece, n;
+	struct align_fd afd;
+	unsigned int i = 0;
 
 	init_afd(&afd, fd);
 
@@ -2699,17 +2737,14 @@ static int write_bitmap1(struct supertype *st, int fd, enum bitmap_update update
 		return -EINVAL;
 	}
 
-	if (posix_memalign(&buf, 4096, 4096))
+	if (posix_memalign(&buf, 4096, BITMAP_WRITE_SIZE))
 		return -ENOMEM;
 
 	do {
 		/* Only the bitmap[0] should resync
 		 * whole device on initial assembly
 		 */
-		if (i)
-			memset(buf, 0x00, 4096);
-		else
-			memset(buf, 0xff, 4096);
+		memset(buf, i ? 0x00 : 0xff, BITMAP_WRITE_SIZE);
 		memcpy(buf, (char *)bms, sizeof(bitmap_super_t));
 
 		/*
@@ -2717,23 +2752,28 @@ static int write_bitmap1(struct supertype *st, int fd, enum bitmap_update update
 		 * with 8 sectors, then it should compatible with
 		 * older mdadm.
 		 */
-		if (__le32_to_cpu(sb->bitmap_offset) & 7)
+		if (__le32_to_cpu(sb->bitmap_offset) & 7) {
 			towrite = calc_bitmap_size(bms, 512);
-		else
+			piece = 4096;
+		} else {
+			/* whole 4K blocks at 4K offsets can skip awrite() */
 			towrite = calc_bitmap_size(bms, 4096);
+			piece = BITMAP_WRITE_SIZE;
+		}
 		while (towrite > 0) {
 			n = towrite;
-			if (n > 4096)
-				n = 4096;
-			n = awrite(&afd, buf, n);
+			if (n > piece)
+				n = piece;
+			if (piece > 4096)
+				n = write(fd, buf, n);
+			else
+				n = awrite(&afd, buf, n);
 			if (n > 0)
 				towrite -= n;
 			else
 				break;
-			if (i)
-				memset(buf, 0x00, 4096);
-			else
-				memset(buf, 0xff, 4096);
+			/* drop the bitmap superblock after the first piece */
+			memset(buf, i ? 0x00 : 0xff, sizeof(bitmap_super_t));
 		}
 		fsync(fd);
 		if (towrite) {
@@ -2746,6 +2786,47 @@ static int write_bitmap1(struct supertype *st, int fd, enum bitmap_update update
 	return rv;
 }
 
+static int write_bitmap1(struct supertype *st, int fd, enum bitmap_update update)
+{
+	int rv = update_bitmap1(st, update);
+
+	if (rv)
+		return rv;
+	return write_bitmap1_data(st, fd);
+}
+
+/* Zero the write-intent bitmap, PPL and bad block log of a loaded
+ * superblock, so nothing of them is left behind once it is gone.
+ */
+static int clear_areas1(struct supertype *st, int fd)
+{
+	struct mdp_superblock_1 *sb = st->sb;
+	struct bitmap_super_s *bsb = (void *)(((char *)sb) + MAX_SB_SIZE);
+	unsigned long long super_offset = __le64_to_cpu(sb->super_offset);
+	int rv = 0;
+
+	if (__le32_to_cpu(sb->feature_map) & MD_FEATURE_BITMAP_OFFSET) {
+		/* validated against the superblock by load_super1() */
+		unsigned long long size = calc_bitmap_size(bsb, 4096) >> 9;
+		int nodes = __le32_to_cpu(bsb->nodes);
+
+		if (nodes > 1)
+			size *= nodes;
+		rv |= zero_disk_range(fd, super_offset +
+				      (int32_t)__le32_to_cpu(sb->bitmap_offset),
+				      size);
+	} else if (md_feature_any_ppl_on(sb->feature_map)) {
+		rv |= zero_disk_range(fd, super_offset +
+				      (int16_t)__le16_to_cpu(sb->ppl.offset),
+				      __le16_to_cpu(sb->ppl.size));
+	}
+	if (sb->bblog_offset && sb->bblog_size)
+		rv |= zero_disk_range(fd, super_offset +
+				      (int32_t)__le32_to_cpu(sb->bblog_offset),
+				      __le16_to_cpu(sb->bblog_size));
+	return rv ? 1 : 0;
+}
+
 static void free_super1(struct supertype *st)
 {
 
@@ -2945,6 +3026,7 @@ struct superswitch super1 = {
 	.locate_bitmap = locate_bitmap1,
 	.get_bitmap_type = get_bitmap_type1,
 	.write_bitmap = write_bitmap1,
+	.clear_areas = clear_areas1,
 	.free_super = free_super1,
 #if __BYTE_ORDER == BIG_ENDIAN
 	.swapuuid = 0,
@@ -30,6 +30,7 @@
 
 #include	<dirent.h>
 #include	<ctype.h>
+#include	<sys/resource.h>
 
 #define MAX_SYSFS_PATH_LEN	120
 
@@ -61,6 +62,150 @@ int load_sys(char *path, char *buf, int len)
 	return 0;
 }
 
+/*
+ * Attribute cache for sysfs_read().
+ *
+ * Long running callers (Monitor, mdmon) read the same attributes of the
+ * same arrays over and over.  With the cache enabled the attribute files
+ * stay open and are re-read with pread() from offset 0, which makes sysfs
+ * regenerate the value, so each attribute costs one syscall instead of
+ * open, read and close.  Files not read for SYSFS_CACHE_IDLE calls of
+ * sysfs_read() are closed, as are files that fail to read, e.g. because
+ * the member they belong to was removed.  At most a quarter of the open
+ * file limit is used, so the caller keeps room for its own files.  When
+ * the cache is full, or files cannot be opened, attributes are read the
+ * uncached way.
+ *
+ * The cache is not locked, only one thread may use sysfs_read() while it
+ * is enabled.
+ */
+#define SYSFS_CACHE_BUCKETS	256
+#define SYSFS_CACHE_MIN		16
+#define SYSFS_CACHE_UNLIMITED	4096
+#define SYSFS_CACHE_IDLE	64
+
+struct sysfs_cached_attr {
+	struct sysfs_cached_attr *next;
+	unsigned long used;
+	int fd;
+	char path[];
+};
+
+static struct sysfs_cached_attr *attr_cache[SYSFS_CACHE_BUCKETS];
+static bool attr_cache_enabled;
+static unsigned long attr_cache_epoch;
+static int attr_cache_cnt;
+static int attr_cache_max;
+
+static unsigned int attr_cache_hash(const char *path)
+{
+	unsigned int h = 5381;
+
+	while (*path)
+		h = h * 33 + (unsigned char)*path++;
+	return h % SYSFS_CACHE_BUCKETS;
+}
+
+static void attr_cache_sweep(bool all)
+{
+	int i;
+
+	for (i = 0; i < SYSFS_CACHE_BUCKETS; i++) {
+		struct sysfs_cached_attr **ap = &attr_cache[i];
+
+		while (*ap) {
+			struct sysfs_cached_attr *a = *ap;
+
+			if (!all && attr_cache_epoch - a->used < SYSFS_CACHE_IDLE) {
+				ap = &a->next;
+				continue;
+			}
+			*ap = a->next;
+			close(a->fd);
+			free(a);
+			attr_cache_cnt--;
+		}
+	}
+}
+
+/**
+ * sysfs_attr_cache() - keep sysfs_read() attribute files open.
+ * @enable: true to start caching, false to stop and close all files.
+ */
+void sysfs_attr_cache(bool enable)
+{
+	struct rlimit rlim;
+
+	if (!enable)
+		attr_cache_sweep(true);
+	attr_cache_enabled = enable;
+	if (!enable)
+		return;
+
+	attr_cache_max = SYSFS_CACHE_MIN;
+	if (getrlimit(RLIMIT_NOFILE, &rlim) != 0)
+		return;
+	if (rlim.rlim_cur == RLIM_INFINITY)
+		attr_cache_max = SYSFS_CACHE_UNLIMITED;
+	else if (rlim.rlim_cur / 4 > SYSFS_CACHE_MIN)
+		attr_cache_max = min(rlim.rlim_cur / 4,
+				     (rlim_t)SYSFS_CACHE_UNLIMITED);
+}
+
+static int load_sys_cached(char *path, char *buf, int len)
+{
+	unsigned int h = attr_cache_hash(path);
+	struct sysfs_cached_attr *a, **ap;
+	bool fresh = false;
+	int n;
+
+	if (!attr_cache_enabled)
+		return load_sys(path, buf, len);
+
+	for (ap = &attr_cache[h]; *ap; ap = &(*ap)->next)
+		if (strcmp((*ap)->path, path) == 0)
+			break;
+	a = *ap;
+	if (!a) {
+		int fd;
+
+		if (attr_cache_cnt >= attr_cache_max)
+			return load_sys(path, buf, len);
+		fd = open(path, O_RDONLY | O_CLOEXEC);
+		if (fd < 0) {
+			/* out of descriptors, give them all back */
+			if (errno == EMFILE || errno == ENFILE)
+				attr_cache_sweep(true);
+			return load_sys(path, buf, len);
+		}
+		a = xmalloc(sizeof(*a) + strlen(path) + 1);
+		strcpy(a->path, path);
+		a->fd = fd;
+		a->next = attr_cache[h];
+		attr_cache[h] = a;
+		attr_cache_cnt++;
+		ap = &attr_cache[h];
+		fresh = true;
+	}
+	a->used = attr_cache_epoch;
+
+	n = pread(a->fd, buf, len, 0);
+	if (n < 0 || n >= len) {
+		*ap = a->next;
+		close(a->fd);
+		free(a);
+		attr_cache_cnt--;
+		/* the file may belong to an array or member that has since
+		 * been replaced by another one of the same name
+		 */
+		return fresh ? -1 : load_sys_cached(path, buf, len);
+	}
+	buf[n] = 0;
+	if (n && buf[n-1] == '\n')
+		buf[n-1] = 0;
+	return 0;
+}
+
 void sysfs_free(struct mdinfo *sra)
 {
 	while (sra) {
@@ -265,6 +410,65 @@ out:
 }
 
 /* If fd >= 0, get the array it is open on, else use devnm. */
+/**
+ * sysfs_read_member() - read attributes of one member of an array.
+ * @sra: array, as returned by sysfs_read().
+ * @dev: member of @sra, with sys_name set.
+ * @options: which of GET_OFFSET, GET_SIZE, GET_STATE and GET_ERROR to
+ *	     read.
+ *
+ * Lets callers that listed the members with GET_DEVS alone read the
+ * details of only the members they care about.
+ *
+ * Return: 0 on success, -1 if an attribute could not be read.
+ */
+int sysfs_read_member(struct mdinfo *sra, struct mdinfo *dev,
+		      unsigned long options)
+{
+	char fname[PATH_MAX];
+	char buf[PATH_MAX];
+	char *dbase;
+
+	snprintf(fname, sizeof(fname), "/sys/block/%s/md/%s/",
+		 sra->sys_name, dev->sys_name);
+	dbase = fname + strlen(fname);
+
+	if (options & GET_OFFSET) {
+		strcpy(dbase, "offset");
+		if (load_sys_cached(fname, buf, sizeof(buf)))
+			return -1;
+		dev->data_offset = strtoull(buf, NULL, 0);
+		strcpy(dbase, "new_offset");
+		if (load_sys_cached(fname, buf, sizeof(buf)) == 0)
+			dev->new_data_offset = strtoull(buf, NULL, 0);
+		else
+			dev->new_data_offset = dev->data_offset;
+	}
+	if (options & GET_SIZE) {
+		strcpy(dbase, "size");
+		if (load_sys_cached(fname, buf, sizeof(buf)))
+			return -1;
+		dev->component_size = strtoull(buf, NULL, 0) * 2;
+	}
+	if (options & GET_STATE) {
+		dev->disk.state = 0;
+		strcpy(dbase, "state");
+		if (load_sys_cached(fname, buf, sizeof(buf)))
+			return -1;
+		if (strstr(buf, "faulty"))
+			dev->disk.state |= (1<<MD_DISK_FAULTY);
+		else if (strstr(buf, "in_sync"))
+			dev->disk.state |= (1<<MD_DISK_SYNC);
+	}
+	if (options & GET_ERROR) {
+		strcpy(dbase, "errors");
+		if (load_sys_cached(fname, buf, sizeof(buf)))
+			return -1;
+		dev->errors = strtoul(buf, NULL, 0);
+	}
+	return 0;
+}
+
 struct mdinfo *sysfs_read(int fd, char *devnm, unsigned long options)
 {
 	char fname[PATH_MAX];
@@ -276,6 +480,9 @@ struct mdinfo *sysfs_read(int fd, char *devnm, unsigned long options)
 	DIR *dir = NULL;
 	struct dirent *de;
 
+	if (attr_cache_enabled && ++attr_cache_epoch % SYSFS_CACHE_IDLE == 0)
+		attr_cache_sweep(false);
+
 	sra = xcalloc(1, sizeof(*sra));
 	if (sysfs_init(sra, fd, devnm)) {
 		free(sra);
@@ -288,7 +495,7 @@ struct mdinfo *sysfs_read(int fd, char *devnm, unsigned long options)
 	sra->devs = NULL;
 	if (options & GET_VERSION) {
 		strcpy(base, "metadata_version");
-		if (load_sys(fname, buf, sizeof(buf)))
+		if (load_sys_cached(fname, buf, sizeof(buf)))
 			goto abort;
 		if (str_is_none(buf) == true) {
 			sra->array.major_version =
@@ -308,25 +515,25 @@ struct mdinfo *sysfs_read(int fd, char *devnm, unsigned long options)
 	}
 	if (options & GET_LEVEL) {
 		strcpy(base, "level");
-		if (load_sys(fname, buf, sizeof(buf)))
+		if (load_sys_cached(fname, buf, sizeof(buf)))
 			goto abort;
 		sra->array.level = map_name(pers, buf);
 	}
 	if (options & GET_LAYOUT) {
 		strcpy(base, "layout");
-		if (load_sys(fname, buf, sizeof(buf)))
+		if (load_sys_cached(fname, buf, sizeof(buf)))
 			goto abort;
 		sra->array.layout = strtoul(buf, NULL, 0);
 	}
 	if (options & (GET_DISKS|GET_STATE)) {
 		strcpy(base, "raid_disks");
-		if (load_sys(fname, buf, sizeof(buf)))
+		if (load_sys_cached(fname, buf, sizeof(buf)))
 			goto abort;
 		sra->array.raid_disks = strtoul(buf, NULL, 0);
 	}
 	if (options & GET_COMPONENT) {
 		strcpy(base, "component_size");
-		if (load_sys(fname, buf, sizeof(buf)))
+		if (load_sys_cached(fname, buf, sizeof(buf)))
 			goto abort;
 		sra->component_size = strtoull(buf, NULL, 0);
 		/* sysfs reports "K", but we want sectors */
@@ -334,13 +541,13 @@ struct mdinfo *sysfs_read(int fd, char *devnm, unsigned long options)
 	}
 	if (options & GET_CHUNK) {
 		strcpy(base, "chunk_size");
-		if (load_sys(fname, buf, sizeof(buf)))
+		if (load_sys_cached(fname, buf, sizeof(buf)))
 			goto abort;
 		sra->array.chunk_size = strtoul(buf, NULL, 0);
 	}
 	if (options & GET_CACHE) {
 		strcpy(base, "stripe_cache_size");
-		if (load_sys(fname, buf, sizeof(buf)))
+		if (load_sys_cached(fname, buf, sizeof(buf)))
 			/* Probably level doesn't support it */
 			sra->cache_size = 0;
 		else
@@ -348,7 +555,7 @@ struct mdinfo *sysfs_read(int fd, char *devnm, unsigned long options)
 	}
 	if (options & GET_MISMATCH) {
 		strcpy(base, "mismatch_cnt");
-		if (load_sys(fname, buf, sizeof(buf)))
+		if (load_sys_cached(fname, buf, sizeof(buf)))
 			goto abort;
 		sra->mismatch_cnt = strtoul(buf, NULL, 0);
 	}
@@ -360,7 +567,7 @@ struct mdinfo *sysfs_read(int fd, char *devnm, unsigned long options)
 		size_t len;
 
 		strcpy(base, "safe_mode_delay");
-		if (load_sys(fname, buf, sizeof(buf)))
+		if (load_sys_cached(fname, buf, sizeof(buf)))
 			goto abort;
 
 		/* remove a period, and count digits after it */
@@ -383,7 +590,7 @@ struct mdinfo *sysfs_read(int fd, char *devnm, unsigned long options)
 	}
 	if (options & GET_BITMAP_LOCATION) {
 		strcpy(base, "bitmap/location");
-		if (load_sys(fname, buf, sizeof(buf)))
+		if (load_sys_cached(fname, buf, sizeof(buf)))
 			goto abort;
 		if (strncmp(buf, "file", 4) == 0)
 			sra->bitmap_offset = 1;
@@ -397,14 +604,14 @@ struct mdinfo *sysfs_read(int fd, char *devnm, unsigned long options)
 
 	if (options & GET_ARRAY_STATE) {
 		strcpy(base, "array_state");
-		if (load_sys(fname, buf, sizeof(buf)))
+		if (load_sys_cached(fname, buf, sizeof(buf)))
 			goto abort;
 		sra->array_state = map_name(sysfs_array_states, buf);
 	}
 
 	if (options & GET_CONSISTENCY_POLICY) {
 		strcpy(base, "consistency_policy");
-		if (load_sys(fname, buf, sizeof(buf)))
+		if (load_sys_cached(fname, buf, sizeof(buf)))
 			sra->consistency_policy = CONSISTENCY_POLICY_UNKNOWN;
 		else
 			sra->consistency_policy = map_name(consistency_policies,
@@ -439,7 +646,7 @@ struct mdinfo *sysfs_read(int fd, char *devnm, unsigned long options)
 
 		/* Always get slot, major, minor */
 		strcpy(dbase, "slot");
-		if (load_sys(fname, buf, sizeof(buf))) {
+		if (load_sys_cached(fname, buf, sizeof(buf))) {
 			/* hmm... unable to read 'slot' maybe the device
 			 * is going away?
 			 */
@@ -466,7 +673,7 @@ struct mdinfo *sysfs_read(int fd, char *devnm, unsigned long options)
 
 		sra->array.nr_disks++;
 		strcpy(dbase, "block/dev");
-		if (load_sys(fname, buf, sizeof(buf))) {
+		if (load_sys_cached(fname, buf, sizeof(buf))) {
 			/* assume this is a stale reference to a hot
 			 * removed device
 			 */
@@ -481,7 +688,7 @@ struct mdinfo *sysfs_read(int fd, char *devnm, unsigned long options)
 		if (!(options & GET_DEVS_ALL)) {
 			/* special case check for block devices that can go 'offline' */
 			strcpy(dbase, "block/device/state");
-			if (load_sys(fname, buf, sizeof(buf)) == 0 &&
+			if (load_sys_cached(fname, buf, sizeof(buf)) == 0 &&
 			    strncmp(buf, "offline", 7) == 0) {
 				free(dev);
 				continue;
@@ -493,45 +700,15 @@ struct mdinfo *sysfs_read(int fd, char *devnm, unsigned long options)
 		devp = & dev->next;
 		dev->next = NULL;
 
-		if (options & GET_OFFSET) {
-			strcpy(dbase, "offset");
-			if (load_sys(fname, buf, sizeof(buf)))
-				goto abort;
-			dev->data_offset = strtoull(buf, NULL, 0);
-			strcpy(dbase, "new_offset");
-			if (load_sys(fname, buf, sizeof(buf)) == 0)
-				dev->new_data_offset = strtoull(buf, NULL, 0);
-			else
-				dev->new_data_offset = dev->data_offset;
-		}
-		if (options & GET_SIZE) {
-			strcpy(dbase, "size");
-			if (load_sys(fname, buf, sizeof(buf)))
-				goto abort;
-			dev->component_size = strtoull(buf, NULL, 0) * 2;
-		}
-		if (options & GET_STATE) {
-			dev->disk.state = 0;
-			strcpy(dbase, "state");
-			if (load_sys(fname, buf, sizeof(buf)))
-				goto abort;
-			if (strstr(buf, "faulty"))
-				dev->disk.state |= (1<<MD_DISK_FAULTY);
-			else {
-				sra->array.working_disks++;
-				if (strstr(buf, "in_sync")) {
-					dev->disk.state |= (1<<MD_DISK_SYNC);
-					sra->array.active_disks++;
-				}
-				if (dev->disk.state == 0)
-					sra->array.spare_disks++;
-			}
-		}
-		if (options & GET_ERROR) {
-			strcpy(buf, "errors");
-			if (load_sys(fname, buf, sizeof(buf)))
-				goto abort;
-			dev->errors = strtoul(buf, NULL, 0);
+		if (sysfs_read_member(sra, dev, options))
+			goto abort;
+		if ((options & GET_STATE) &&
+		    !(dev->disk.state & (1<<MD_DISK_FAULTY))) {
+			sra->array.working_disks++;
+			if (dev->disk.state & (1<<MD_DISK_SYNC))
+				sra->array.active_disks++;
+			if (dev->disk.state == 0)
+				sra->array.spare_disks++;
 		}
 	}
 
@@ -601,6 +778,149 @@ unsigned long long get_component_size(int fd)
 	return strtoull(fname, NULL, 10) * 2;
 }
 
+/*
+ * Attribute writer.
+ *
+ * Bringing up an array writes a handful of attributes of the array and
+ * of every member.  Opening "/sys/block/mdX/md/dev-sdX/attr" for each
+ * means resolving the whole path every time, so a transaction keeps the
+ * array's md directory and the directory of the member last written to
+ * open, and opens attributes relative to them.
+ */
+static int sysfs_txn_verbose;
+
+/**
+ * sysfs_set_verbose() - set how much sysfs transactions report.
+ * @verbose: with more than 1 the time taken by every write is printed.
+ */
+void sysfs_set_verbose(int verbose)
+{
+	sysfs_txn_verbose = verbose;
+}
+
+static int sysfs_txn_dir(struct sysfs_txn *txn, struct mdinfo *dev)
+{
+	if (!is_fd_valid(txn->md_fd)) {
+		char path[MAX_SYSFS_PATH_LEN];
+
+		snprintf(path, sizeof(path), "/sys/block/%s/md",
+			 txn->sra->sys_name);
+		txn->md_fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+		if (!is_fd_valid(txn->md_fd))
+			return -1;
+	}
+	if (!dev)
+		return txn->md_fd;
+	if (is_fd_valid(txn->dev_fd) &&
+	    strcmp(txn->dev_name, dev->sys_name) == 0)
+		return txn->dev_fd;
+
+	close_fd(&txn->dev_fd);
+	txn->dev_fd = openat(txn->md_fd, dev->sys_name,
+			     O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	snprintf(txn->dev_name, sizeof(txn->dev_name), "%s", dev->sys_name);
+	return txn->dev_fd;
+}
+
+/**
+ * sysfs_txn_begin() - start writing attributes of an array.
+ * @txn: transaction to set up.
+ * @sra: the array, sys_name must be set.
+ *
+ * Directories are opened as needed and kept until sysfs_txn_end().
+ */
+void sysfs_txn_begin(struct sysfs_txn *txn, struct mdinfo *sra)
+{
+	memset(txn, 0, sizeof(*txn));
+	txn->sra = sra;
+	txn->md_fd = -1;
+	txn->dev_fd = -1;
+	if (sysfs_txn_verbose > 1)
+		clock_gettime(CLOCK_MONOTONIC, &txn->start);
+}
+
+/**
+ * sysfs_txn_set_str() - write an attribute as part of a transaction.
+ * @txn: transaction.
+ * @dev: member to write to, NULL for the array itself.
+ * @name: attribute name, relative to the md or member directory.
+ * @val: value to write.
+ *
+ * Behaves as sysfs_set_str(), including the errno left behind.
+ *
+ * Return: 0 on success, -1 on failure.
+ */
+int sysfs_txn_set_str(struct sysfs_txn *txn, struct mdinfo *dev,
+		      char *name, char *val)
+{
+	struct timespec start, end;
+	int dir, fd, err;
+
+	if (sysfs_txn_verbose > 1)
+		clock_gettime(CLOCK_MONOTONIC, &start);
+
+	dir = sysfs_txn_dir(txn, dev);
+	if (!is_fd_valid(dir))
+		return -1;
+	fd = openat(dir, name, O_WRONLY | O_CLOEXEC);
+	if (fd < 0)
+		return -1;
+
+	err = write_attr(val, fd);
+	if (err)
+		pr_err("failed to write '%s' to '/sys/block/%s/md/%s%s%s' (%s)\n",
+		       val, txn->sra->sys_name, dev ? dev->sys_name : "",
+		       dev ? "/" : "", name, strerror(errno));
+	close(fd);
+
+	txn->writes++;
+	if (sysfs_txn_verbose > 1) {
+		int saved_errno = errno;
+
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		pr_err("%s/%s%s%s: %ldus\n", txn->sra->sys_name,
+		       dev ? dev->sys_name : "", dev ? "/" : "", name,
+		       (end.tv_sec - start.tv_sec) * 1000000 +
+		       (end.tv_nsec - start.tv_nsec) / 1000);
+		errno = saved_errno;
+	}
+	return err ? -1 : 0;
+}
+
+int sysfs_txn_set_num(struct sysfs_txn *txn, struct mdinfo *dev,
+		      char *name, unsigned long long val)
+{
+	char valstr[50];
+
+	sprintf(valstr, "%llu", val);
+	return sysfs_txn_set_str(txn, dev, name, valstr);
+}
+
+/**
+ * sysfs_txn_end() - finish a transaction.
+ * @txn: transaction to finish.
+ *
+ * Closes the directories, errno is left alone.  In verbose mode the
+ * total time is reported.
+ */
+void sysfs_txn_end(struct sysfs_txn *txn)
+{
+	int saved_errno = errno;
+
+	close_fd(&txn->dev_fd);
+	close_fd(&txn->md_fd);
+	if (sysfs_txn_verbose > 1 && txn->writes > 1) {
+		struct timespec end;
+
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		pr_err("%s: %d attributes written in %ldus\n",
+		       txn->sra->sys_name, txn->writes,
+		       (end.tv_sec - txn->start.tv_sec) * 1000000 +
+		       (end.tv_nsec - txn->start.tv_nsec) / 1000);
+	}
+	errno = saved_errno;
+}
+
 int sysfs_set_str(struct mdinfo *sra, struct mdinfo *dev,
 		  char *name, char *val)
 {
@@ -785,6 +1105,33 @@ int sysfs_get_str(struct mdinfo *sra, struct mdinfo *dev,
 	return n;
 }
 
+/**
+ * sysfs_get_str_cached() - read an attribute like sysfs_read() does.
+ * @sra: array.
+ * @dev: member of @sra, or NULL for an attribute of the array.
+ * @name: attribute.
+ * @val: buffer, the value is stored without the trailing newline.
+ * @size: size of @val.
+ *
+ * Goes through the descriptors kept by sysfs_attr_cache(), so callers
+ * reading the same attributes every round avoid the open() and close().
+ *
+ * Return: 0 on success, -1 on error.
+ */
+int sysfs_get_str_cached(struct mdinfo *sra, struct mdinfo *dev,
+			 char *name, char *val, int size)
+{
+	char fname[MAX_SYSFS_PATH_LEN];
+
+	if (dev)
+		snprintf(fname, sizeof(fname), "/sys/block/%s/md/%s/%s",
+			 sra->sys_name, dev->sys_name, name);
+	else
+		snprintf(fname, sizeof(fname), "/sys/block/%s/md/%s",
+			 sra->sys_name, name);
+	return load_sys_cached(fname, val, size);
+}
+
 int sysfs_set_safemode(struct mdinfo *sra, unsigned long ms)
 {
 	unsigned long sec;
@@ -801,10 +1148,12 @@ int sysfs_set_safemode(struct mdinfo *sra, unsigned long ms)
 
 int sysfs_set_array(struct mdinfo *info)
 {
+	struct sysfs_txn txn;
 	int rv = 0;
 	char ver[100];
 	int raid_disks = info->array.raid_disks;
 
+	sysfs_txn_begin(&txn, info);
 	ver[0] = 0;
 	if (info->array.major_version == -1 &&
 	    info->array.minor_version == -2) {
@@ -824,25 +1173,28 @@ int sysfs_set_array(struct mdinfo *info)
 			    buf[MD_VER_BLOCKED_IDX] == '-')
 				ver[MD_VER_BLOCKED_IDX] = '-';
 
-		if (sysfs_set_str(info, NULL, "metadata_version", ver) < 0) {
+		if (sysfs_txn_set_str(&txn, NULL, "metadata_version", ver) < 0) {
 			pr_err("This kernel does not support external metadata.\n");
+			sysfs_txn_end(&txn);
 			return 1;
 		}
 	}
-	if (info->array.level < 0)
+	if (info->array.level < 0) {
+		sysfs_txn_end(&txn);
 		return 0; /* FIXME */
-	rv |= sysfs_set_str(info, NULL, "level",
+	}
+	rv |= sysfs_txn_set_str(&txn, NULL, "level",
 			    map_num_s(pers, info->array.level));
 	if (info->reshape_active && info->delta_disks != UnSet)
 		raid_disks -= info->delta_disks;
-	rv |= sysfs_set_num(info, NULL, "raid_disks", raid_disks);
-	rv |= sysfs_set_num(info, NULL, "chunk_size", info->array.chunk_size);
-	rv |= sysfs_set_num(info, NULL, "layout", info->array.layout);
-	rv |= sysfs_set_num(info, NULL, "component_size", info->component_size/2);
+	rv |= sysfs_txn_set_num(&txn, NULL, "raid_disks", raid_disks);
+	rv |= sysfs_txn_set_num(&txn, NULL, "chunk_size", info->array.chunk_size);
+	rv |= sysfs_txn_set_num(&txn, NULL, "layout", info->array.layout);
+	rv |= sysfs_txn_set_num(&txn, NULL, "component_size", info->component_size/2);
 	if (info->custom_array_size) {
 		int rc;
 
-		rc = sysfs_set_num(info, NULL, "array_size",
+		rc = sysfs_txn_set_num(&txn, NULL, "array_size",
 				   info->custom_array_size/2);
 		if (rc && errno == ENOENT) {
 			pr_err("This kernel does not have the md/array_size attribute, the array may be larger than expected\n");
@@ -852,14 +1204,14 @@ int sysfs_set_array(struct mdinfo *info)
 	}
 
 	if (info->array.level > 0)
-		rv |= sysfs_set_num(info, NULL, "resync_start", info->resync_start);
+		rv |= sysfs_txn_set_num(&txn, NULL, "resync_start", info->resync_start);
 
 	if (info->reshape_active) {
-		rv |= sysfs_set_num(info, NULL, "reshape_position",
+		rv |= sysfs_txn_set_num(&txn, NULL, "reshape_position",
 				    info->reshape_progress);
-		rv |= sysfs_set_num(info, NULL, "chunk_size", info->new_chunk);
-		rv |= sysfs_set_num(info, NULL, "layout", info->new_layout);
-		rv |= sysfs_set_num(info, NULL, "raid_disks",
+		rv |= sysfs_txn_set_num(&txn, NULL, "chunk_size", info->new_chunk);
+		rv |= sysfs_txn_set_num(&txn, NULL, "layout", info->new_layout);
+		rv |= sysfs_txn_set_num(&txn, NULL, "raid_disks",
 				    info->array.raid_disks);
 		/* We don't set 'new_level' here.  That can only happen
 		 * once the reshape completes.
@@ -870,17 +1222,30 @@ int sysfs_set_array(struct mdinfo *info)
 		char *policy = map_num_s(consistency_policies,
 					    info->consistency_policy);
 
-		if (sysfs_set_str(info, NULL, "consistency_policy", policy)) {
+		if (sysfs_txn_set_str(&txn, NULL, "consistency_policy", policy)) {
 			pr_err("This kernel does not support PPL. Falling back to consistency-policy=resync.\n");
 			info->consistency_policy = CONSISTENCY_POLICY_RESYNC;
 		}
 	}
 
+	sysfs_txn_end(&txn);
 	return rv;
 }
 
-int sysfs_add_disk(struct mdinfo *sra, struct mdinfo *sd, int resume)
+/**
+ * sysfs_add_disk_txn() - add a member to an array within a transaction.
+ * @txn: transaction on the array.
+ * @sd: member to add.
+ * @resume: as for sysfs_add_disk().
+ *
+ * Callers adding many members use one transaction for all of them, so
+ * the array's md directory is opened once.
+ *
+ * Return: as sysfs_add_disk().
+ */
+int sysfs_add_disk_txn(struct sysfs_txn *txn, struct mdinfo *sd, int resume)
 {
+	struct mdinfo *sra = txn->sra;
 	char dv[PATH_MAX];
 	char nm[PATH_MAX];
 	char *dname;
@@ -888,7 +1253,7 @@ int sysfs_add_disk(struct mdinfo *sra, struct mdinfo *sd, int resume)
 	int i;
 
 	sprintf(dv, "%d:%d", sd->disk.major, sd->disk.minor);
-	rv = sysfs_set_str(sra, NULL, "new_dev", dv);
+	rv = sysfs_txn_set_str(txn, NULL, "new_dev", dv);
 	if (rv)
 		return rv;
 
@@ -899,30 +1264,30 @@ int sysfs_add_disk(struct mdinfo *sra, struct mdinfo *sd, int resume)
 
 	/* test write to see if 'recovery_start' is available */
 	if (resume && sd->recovery_start < MaxSector &&
-	    sysfs_set_num(sra, sd, "recovery_start", 0)) {
-		sysfs_set_str(sra, sd, "state", "remove");
+	    sysfs_txn_set_num(txn, sd, "recovery_start", 0)) {
+		sysfs_txn_set_str(txn, sd, "state", "remove");
 		return -1;
 	}
 
-	rv = sysfs_set_num(sra, sd, "offset", sd->data_offset);
-	rv |= sysfs_set_num(sra, sd, "size", (sd->component_size+1) / 2);
+	rv = sysfs_txn_set_num(txn, sd, "offset", sd->data_offset);
+	rv |= sysfs_txn_set_num(txn, sd, "size", (sd->component_size+1) / 2);
 	if (!is_container(sra->array.level)) {
 		if (sra->consistency_policy == CONSISTENCY_POLICY_PPL) {
-			rv |= sysfs_set_num(sra, sd, "ppl_sector", sd->ppl_sector);
-			rv |= sysfs_set_num(sra, sd, "ppl_size", sd->ppl_size);
+			rv |= sysfs_txn_set_num(txn, sd, "ppl_sector", sd->ppl_sector);
+			rv |= sysfs_txn_set_num(txn, sd, "ppl_size", sd->ppl_size);
 		}
 		if (sd->recovery_start == MaxSector)
 			/* This can correctly fail if array isn't started,
 			 * yet, so just ignore status for now.
 			 */
-			sysfs_set_str(sra, sd, "state", "insync");
+			sysfs_txn_set_str(txn, sd, "state", "insync");
 		if (sd->disk.raid_disk >= 0)
-			rv |= sysfs_set_num(sra, sd, "slot", sd->disk.raid_disk);
+			rv |= sysfs_txn_set_num(txn, sd, "slot", sd->disk.raid_disk);
 		if (resume)
-			sysfs_set_num(sra, sd, "recovery_start", sd->recovery_start);
+			sysfs_txn_set_num(txn, sd, "recovery_start", sd->recovery_start);
 	}
 	if (sd->bb.supported) {
-		if (sysfs_set_str(sra, sd, "state", "external_bbl")) {
+		if (sysfs_txn_set_str(txn, sd, "state", "external_bbl")) {
 			/*
 			 * backward compatibility - if kernel doesn't support
 			 * bad blocks for external metadata, let it continue
@@ -940,12 +1305,23 @@ int sysfs_add_disk(struct mdinfo *sra, struct mdinfo *sd, int resume)
 
 			snprintf(s, sizeof(s) - 1, "%llu %d\n", entry->sector,
 				 entry->length);
-			rv |= sysfs_set_str(sra, sd, "bad_blocks", s);
+			rv |= sysfs_txn_set_str(txn, sd, "bad_blocks", s);
 		}
 	}
 	return rv;
 }
 
+int sysfs_add_disk(struct mdinfo *sra, struct mdinfo *sd, int resume)
+{
+	struct sysfs_txn txn;
+	int rv;
+
+	sysfs_txn_begin(&txn, sra);
+	rv = sysfs_add_disk_txn(&txn, sd, resume);
+	sysfs_txn_end(&txn);
+	return rv;
+}
+
 int sysfs_disk_to_scsi_id(int fd, __u32 *id)
 {
 	/* from an open block device, try to retrieve it scsi_id */
@@ -115,6 +115,8 @@ static enum udev_status udev_initialize(void)
 /*
  * udev_wait_for_events() - Waits for events from udev.
  * @seconds: Timeout in seconds.
+ * @devid: set to the device number of the event device, 0 if unknown.
+ * @devnm: buffer of %MD_NAME_MAX bytes, set to the kernel name of the device.
  *
  * Function waits udev events, wakes up on event or timeout.
  *
@@ -123,7 +125,7 @@ static enum udev_status udev_initialize(void)
  * UDEV_STATUS_TIMEOUT on timeout
  * UDEV_STATUS_ERROR on error
  */
-enum udev_status udev_wait_for_events(int seconds)
+enum udev_status udev_wait_for_events(int seconds, dev_t *devid, char *devnm)
 {
 	int fd;
 	fd_set readfds;
@@ -151,6 +153,10 @@ enum udev_status udev_wait_for_events(int seconds)
 		struct udev_device *dev = udev_monitor_receive_device(udev_monitor);
 
 		if (dev) {
+			const char *name = udev_device_get_sysname(dev);
+
+			*devid = udev_device_get_devnum(dev);
+			snprintf(devnm, MD_NAME_MAX, "%s", name ? name : "");
 			udev_device_unref(dev);
 			return UDEV_STATUS_SUCCESS; /* event detected */
 		} else {
@@ -31,7 +31,7 @@ enum udev_status {
 bool udev_is_available(void);
 
 #ifndef NO_LIBUDEV
-enum udev_status udev_wait_for_events(int seconds);
+enum udev_status udev_wait_for_events(int seconds, dev_t *devid, char *devnm);
 #endif
 
 enum udev_status udev_block(char *devnm);
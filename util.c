@@ -765,13 +765,9 @@ bad_option:
 
 unsigned long calc_csum(void *super, int bytes)
 {
-	unsigned long long newcsum = 0;
-	int i;
+	unsigned long long newcsum = csum_sum32(super, bytes);
 	unsigned int csum;
-	unsigned int *superc = (unsigned int*) super;
 
-	for(i = 0; i < bytes/4; i++)
-		newcsum += superc[i];
 	csum = (newcsum& 0xffffffff) + (newcsum>>32);
 #ifdef __alpha__
 /* The in-kernel checksum calculation is always 16bit on
@@ -1266,8 +1262,13 @@ struct supertype *guess_super_type(int fd, enum guess_types guess_type)
 	struct supertype *st;
 	unsigned int besttime = 0;
 	int bestsuper = -1;
+	int found = 0;
 	int i;
 
+	st = probe_hint_load(fd, guess_type);
+	if (st)
+		return st;
+
 	st = xcalloc(1, sizeof(*st));
 	st->container_devnm[0] = 0;
 
@@ -1283,6 +1284,7 @@ struct supertype *guess_super_type(int fd, enum guess_types guess_type)
 		rv = ss->load_super(st, fd, NULL);
 		if (rv == 0) {
 			struct mdinfo info;
+			found++;
 			st->ss->getinfo_super(st, &info, NULL);
 			if (bestsuper == -1 ||
 			    besttime < info.array.ctime) {
@@ -1298,6 +1300,9 @@ struct supertype *guess_super_type(int fd, enum guess_types guess_type)
 		st->ignore_hw_compat = 1;
 		rv = superlist[bestsuper]->load_super(st, fd, NULL);
 		if (rv == 0) {
+			/* a hint would bypass the ctime comparison above */
+			if (found == 1)
+				probe_hint_save(fd, st);
 			superlist[bestsuper]->free_super(st);
 			return st;
 		}
@@ -2049,6 +2054,35 @@ int flush_metadata_updates(struct supertype *st)
 		return -1;
 	}
 
+	/* several updates go in one message if mdmon knows how, its
+	 * reply means they are all written
+	 */
+	if (st->updates->next &&
+	    mdmon_has_capability(st->container_devnm, "batch")) {
+		sfd = connect_monitor(st->container_devnm);
+		if (sfd < 0)
+			return -1;
+		if (send_update_batch(sfd, st->updates, 0) == 0) {
+			/* no reply means mdmon rejected or dropped the
+			 * batch, or died with it.  It may have applied some
+			 * of it, so sending it again one by one is not safe.
+			 */
+			int rv = wait_reply(sfd, 0) == 0 ? 0 : -1;
+
+			close(sfd);
+			while (st->updates) {
+				struct metadata_update *mu = st->updates;
+
+				st->updates = mu->next;
+				free(mu->buf);
+				free(mu);
+			}
+			st->update_tail = NULL;
+			return rv;
+		}
+		close(sfd);
+	}
+
 	sfd = connect_monitor(st->container_devnm);
 	if (sfd < 0)
 		return -1;
@@ -2429,54 +2463,307 @@ void set_hooks(void)
 	set_cmap_hooks();
 }
 
-int zero_disk_range(int fd, unsigned long long sector, size_t count)
+/* largest write when zeroing without BLKZEROOUT */
+#define ZERO_WRITE_SIZE (1 << 20)
+
+static int zero_disk_range_write(int fd, unsigned long long offset,
+				 unsigned long long len)
 {
+	int flags = fcntl(fd, F_GETFL);
+	bool direct = false;
+	size_t bufsize;
+	void *buf;
 	int ret = 0;
-	int fd_zero;
-	void *addr = NULL;
-	size_t written = 0;
-	size_t len = count * 512;
-	ssize_t n;
-
-	fd_zero = open("/dev/zero", O_RDONLY);
-	if (fd_zero < 0) {
-		pr_err("Cannot open /dev/zero\n");
-		return -1;
-	}
 
-	if (lseek(fd, sector * 512, SEEK_SET) < 0) {
-		ret = -errno;
-		pr_err("Failed to seek offset for zeroing\n");
-		goto out;
-	}
-
-	addr = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd_zero, 0);
+	/* Keep the zeroes out of the page cache where the device allows */
+	if (flags >= 0 && !(flags & O_DIRECT) &&
+	    fcntl(fd, F_SETFL, flags | O_DIRECT) == 0)
+		direct = true;
 
-	if (addr == MAP_FAILED) {
-		ret = -errno;
-		pr_err("Mapping /dev/zero failed\n");
+	bufsize = min(len, (unsigned long long)ZERO_WRITE_SIZE);
+	if (posix_memalign(&buf, 4096, bufsize)) {
+		ret = -ENOMEM;
 		goto out;
 	}
+	memset(buf, 0, bufsize);
+
+	while (len) {
+		size_t sz = min(len, (unsigned long long)bufsize);
+		ssize_t n = pwrite(fd, buf, sz, offset);
 
-	do {
-		n = write(fd, addr + written, len - written);
 		if (n < 0) {
 			if (errno == EINTR)
 				continue;
+			if (errno == EINVAL && direct) {
+				/* range not aligned for direct I/O */
+				fcntl(fd, F_SETFL, flags);
+				direct = false;
+				continue;
+			}
 			ret = -errno;
-			pr_err("Zeroing disk range failed\n");
 			break;
 		}
-		written += n;
-	} while (written != len);
+		offset += n;
+		len -= n;
+	}
+	free(buf);
+out:
+	if (direct)
+		fcntl(fd, F_SETFL, flags);
+	return ret;
+}
 
-	munmap(addr, len);
+/**
+ * zero_disk_range() - write zeroes over a range of a device.
+ * @fd: device.
+ * @sector: start of the range, in 512 byte sectors.
+ * @count: length of the range, in 512 byte sectors.
+ *
+ * BLKZEROOUT is tried first, the kernel offloads it to the device where
+ * it can (write-zeroes or unmap) and drops the range from the page cache.
+ * Otherwise zeroes are written with direct I/O if possible.
+ * The file position is left at the end of the range.
+ *
+ * Return: 0 on success, negative errno otherwise.
+ */
+int zero_disk_range(int fd, unsigned long long sector, size_t count)
+{
+	unsigned long long range[2] = { sector * 512, (__u64)count * 512 };
+	int ret = 0;
 
-out:
-	close(fd_zero);
+	if (ioctl(fd, BLKZEROOUT, range) != 0)
+		ret = zero_disk_range_write(fd, range[0], range[1]);
+	if (ret) {
+		pr_err("Zeroing disk range failed: %s\n", strerror(-ret));
+		return ret;
+	}
+	if (lseek(fd, range[0] + range[1], SEEK_SET) < 0)
+		return -errno;
+	return 0;
+}
+
+/**
+ * zero_disk_ranges() - zero the same range on several devices at once.
+ * @fds: devices.
+ * @cnt: number of entries in @fds.
+ * @sector: start of the range, in 512 byte sectors.
+ * @count: length of the range, in 512 byte sectors.
+ *
+ * Each device is zeroed by zero_disk_range() in a child of its own, as
+ * write_zeroes_fork() does for data on --create, so that slow members do
+ * not add up.  At most CHILD_POOL_MAX devices are zeroed at once.
+ *
+ * Return: 0 if all ranges were zeroed, otherwise the error of a failed one.
+ */
+int zero_disk_ranges(int *fds, int cnt, unsigned long long sector,
+		     size_t count)
+{
+	struct child_pool cp;
+	int *status;
+	int ret = 0;
+	int i;
+
+	if (cnt == 1)
+		return zero_disk_range(fds[0], sector, count);
+
+	status = xcalloc(cnt, sizeof(*status));
+	child_pool_init(&cp, CHILD_POOL_MAX, child_store_status);
+	for (i = 0; i < cnt; i++) {
+		pid_t pid = child_pool_fork(&cp, &status[i]);
+
+		if (pid == 0)
+			_exit(zero_disk_range(fds[i], sector, count) ? 1 : 0);
+		if (pid < 0) {
+			/* do this one here */
+			int err = zero_disk_range(fds[i], sector, count);
+
+			if (err && !ret)
+				ret = err;
+		}
+	}
+	child_pool_wait(&cp);
+	for (i = 0; i < cnt; i++) {
+		if (status[i]) {
+			if (!ret)
+				ret = -EIO;
+			continue;
+		}
+		/* the child's writes moved the shared file position there */
+		lseek(fds[i], (sector + count) * 512, SEEK_SET);
+	}
+	free(status);
 	return ret;
 }
 
+/*
+ * Child pools.
+ *
+ * Work that is independent per device (probing, wiping, writing metadata)
+ * is spread over child processes, at most @max of them at a time.  The
+ * caller forks through child_pool_fork() and, in the child, does the work
+ * and ends with _exit().  Once a child is reaped its exit status is handed
+ * to the pool's callback together with the data given at fork time.  Only
+ * the pool's own children are waited for, so it can be used next to other
+ * children of the process.
+ */
+
+/**
+ * child_pool_init() - set up an empty pool.
+ * @cp: pool.
+ * @max: children at most running at once, up to CHILD_POOL_MAX.
+ * @done: called for every reaped child, may be NULL.
+ */
+void child_pool_init(struct child_pool *cp, int max, child_done_fn done)
+{
+	memset(cp, 0, sizeof(*cp));
+	cp->max = max < 1 ? 1 : min(max, CHILD_POOL_MAX);
+	cp->done = done;
+}
+
+static int child_pool_slot(struct child_pool *cp, pid_t pid)
+{
+	int i;
+
+	for (i = 0; i < CHILD_POOL_MAX; i++)
+		if (cp->slots[i].pid == pid)
+			return i;
+	return -1;
+}
+
+/* @wstatus is only valid if @waited */
+static void child_pool_finish(struct child_pool *cp, int slot, int wstatus,
+			      bool waited)
+{
+	void *data = cp->slots[slot].data;
+	int status = 1;
+
+	if (waited && WIFEXITED(wstatus))
+		status = WEXITSTATUS(wstatus);
+
+	cp->slots[slot].pid = 0;
+	cp->slots[slot].data = NULL;
+	cp->running--;
+	if (status)
+		cp->failed++;
+	if (cp->done)
+		cp->done(data, status);
+}
+
+/* which child to block on: the first to finish if it is ours, else the oldest */
+static int child_pool_next(struct child_pool *cp)
+{
+	siginfo_t si;
+	int slot = -1;
+	int i;
+
+	memset(&si, 0, sizeof(si));
+	if (waitid(P_ALL, 0, &si, WEXITED | WNOWAIT) == 0 && si.si_pid > 0)
+		slot = child_pool_slot(cp, si.si_pid);
+	if (slot >= 0)
+		return slot;
+
+	for (i = 0; i < CHILD_POOL_MAX; i++)
+		if (cp->slots[i].pid > 0 &&
+		    (slot < 0 || cp->slots[i].seq < cp->slots[slot].seq))
+			slot = i;
+	return slot;
+}
+
+/**
+ * child_pool_reap() - collect children that have finished.
+ * @cp: pool.
+ * @block: if none has finished yet, wait for one.
+ *
+ * A child that cannot be waited for, or does not exit normally, is
+ * reported with status 1.
+ *
+ * Return: number of children reaped.
+ */
+int child_pool_reap(struct child_pool *cp, bool block)
+{
+	int reaped = 0;
+	int wstatus;
+	pid_t rv;
+	int i;
+
+	for (i = 0; i < CHILD_POOL_MAX; i++) {
+		if (cp->slots[i].pid <= 0)
+			continue;
+		rv = waitpid(cp->slots[i].pid, &wstatus, WNOHANG);
+		if (rv == 0)
+			continue;
+		child_pool_finish(cp, i, wstatus, rv > 0);
+		reaped++;
+	}
+
+	while (block && !reaped && cp->running) {
+		i = child_pool_next(cp);
+		rv = waitpid(cp->slots[i].pid, &wstatus, 0);
+		if (rv < 0 && errno == EINTR)
+			continue;
+		child_pool_finish(cp, i, wstatus, rv > 0);
+		reaped++;
+	}
+	return reaped;
+}
+
+/**
+ * child_pool_fork() - start a child in the pool.
+ * @cp: pool.
+ * @data: handed to the pool's callback when the child is reaped.
+ *
+ * Waits for a child to finish first if the pool is full.
+ *
+ * Return: as fork(), the caller does the work itself on -1.
+ */
+pid_t child_pool_fork(struct child_pool *cp, void *data)
+{
+	pid_t pid;
+	int slot;
+
+	while (cp->running >= cp->max)
+		child_pool_reap(cp, true);
+
+	fflush(stdout);
+	fflush(stderr);
+	pid = fork();
+	if (pid <= 0)
+		return pid;
+
+	slot = child_pool_slot(cp, 0);
+	cp->slots[slot].pid = pid;
+	cp->slots[slot].data = data;
+	cp->slots[slot].seq = ++cp->seq;
+	cp->running++;
+	return pid;
+}
+
+/**
+ * child_pool_wait() - wait for all children of the pool.
+ * @cp: pool.
+ *
+ * Return: number of children that failed since child_pool_init().
+ */
+int child_pool_wait(struct child_pool *cp)
+{
+	while (cp->running)
+		child_pool_reap(cp, true);
+	return cp->failed;
+}
+
+/* child_done_fn storing the status in the int @data points to */
+void child_store_status(void *data, int status)
+{
+	*(int *)data = status;
+}
+
+/* child_done_fn for metadata writes, @data is the member's name */
+void member_write_done(void *data, int status)
+{
+	if (status)
+		pr_err("Failed to write metadata to %s\n", (char *)data);
+}
+
 /**
  * sleep_for() - Sleeps for specified time.
  * @sec: Seconds to sleep for.